@@ -0,0 +1,186 @@
+"""
+Records the JSON-RPC responses a benchmark gets from the node, and replays them so every run sees the same chain, without a node.
+
+We hook the two ways ypricemagic talks to the node over http: web3's `make_post_request` and the `requests.post` that
+`y.utils.client` sends JSON-RPC batches with. `install` must run before `y` is imported, since importing `y` connects to the node.
+
+Responses are keyed by method and params. A key we recorded more than once, like `eth_blockNumber`, replays its responses in order
+and then repeats the last one. `eth_getLogs` ranges depend on how fast earlier responses came back, so a range we didn't record
+exactly is answered from the recorded ranges of the same filter that cover it.
+
+Explorer requests for contract sources aren't recorded. Replaying offline needs the ABIs that recording put in brownie's deployments db.
+"""
+import gzip
+import json
+import os
+import threading
+from typing import Any, Callable, Dict, List, Optional, Tuple
+
+RECORD = 'record'
+REPLAY = 'replay'
+
+
+class MissingFixture(Exception):
+    pass
+
+
+class RpcFixtures:
+    def __init__(self, path: str, mode: str) -> None:
+        assert mode in (RECORD, REPLAY), f'mode must be {RECORD} or {REPLAY}'
+        self.path = path
+        self.mode = mode
+        self.metadata: Dict[str, Any] = {}
+        # the number of requests we've sent or replayed
+        self.requests = 0
+        # {key: [response, ...]}
+        self._responses: Dict[str, List[Dict[str, Any]]] = {}
+        # {log filter key: [(from_block, to_block, logs), ...]}
+        self._logs: Dict[str, List[Tuple[int, int, List[Dict[str, Any]]]]] = {}
+        self._served: Dict[str, int] = {}
+        self._lock = threading.Lock()
+        if mode == REPLAY:
+            self.load()
+
+    def __repr__(self) -> str:
+        return f"<RpcFixtures {self.mode} '{self.path}' keys={len(self._responses)} requests={self.requests}>"
+
+    def load(self) -> None:
+        if not os.path.exists(self.path):
+            raise MissingFixture(f'{self.path} does not exist, record it first with `make benchmark-record`')
+        with gzip.open(self.path, 'rt') as f:
+            fixture = json.load(f)
+        self.metadata = fixture['metadata']
+        self._responses = fixture['responses']
+        for key, chunks in fixture['logs'].items():
+            self._logs[key] = [tuple(chunk) for chunk in chunks]
+
+    def save(self) -> None:
+        os.makedirs(os.path.dirname(self.path) or '.', exist_ok=True)
+        with self._lock:
+            fixture = {'metadata': self.metadata, 'responses': self._responses, 'logs': self._logs}
+            with gzip.open(self.path, 'wt') as f:
+                json.dump(fixture, f)
+
+    def handle(self, method: str, params: Any, send: Optional[Callable[[], Dict[str, Any]]]) -> Dict[str, Any]:
+        """ Returns the response to `method(params)`, without its id. `send()` must fetch it from the node when recording. """
+        with self._lock:
+            self.requests += 1
+        if self.mode == RECORD:
+            response = send()
+            self._record(method, params, response)
+            return response
+        return self._replay(method, params)
+
+    def _record(self, method: str, params: Any, response: Dict[str, Any]) -> None:
+        log_range = _log_range(method, params)
+        with self._lock:
+            if log_range is not None and 'result' in response:
+                # logs are only kept by range, so they aren't stored twice
+                filter_key, from_block, to_block = log_range
+                self._logs.setdefault(filter_key, []).append((from_block, to_block, response['result']))
+            else:
+                self._responses.setdefault(_key(method, params), []).append(response)
+
+    def _replay(self, method: str, params: Any) -> Dict[str, Any]:
+        key = _key(method, params)
+        with self._lock:
+            responses = self._responses.get(key)
+            if responses:
+                i = self._served.get(key, 0)
+                self._served[key] = i + 1
+                return responses[min(i, len(responses) - 1)]
+        log_range = _log_range(method, params)
+        if log_range is not None:
+            logs = self._logs_between(*log_range)
+            if logs is not None:
+                return {'jsonrpc': '2.0', 'result': logs}
+        raise MissingFixture(f'no recorded response for {key}, record the fixture again')
+
+    def _logs_between(self, filter_key: str, from_block: int, to_block: int) -> Optional[List[Dict[str, Any]]]:
+        """ Returns the logs between `from_block` and `to_block` if the ranges we recorded for `filter_key` cover them. """
+        chunks = sorted(self._logs.get(filter_key, []), key=lambda chunk: chunk[0])
+        covered_to = from_block - 1
+        logs = {}
+        for chunk_from, chunk_to, chunk_logs in chunks:
+            if chunk_to < from_block or chunk_from > to_block:
+                continue
+            if chunk_from > covered_to + 1:
+                # there's a gap we never recorded
+                return None
+            covered_to = max(covered_to, chunk_to)
+            for log in chunk_logs:
+                if from_block <= int(log['blockNumber'], 16) <= to_block:
+                    logs[(log['blockNumber'], log['transactionHash'], log['logIndex'])] = log
+        if covered_to < to_block:
+            return None
+        return [logs[key] for key in sorted(logs, key=lambda key: (int(key[0], 16), int(key[2], 16)))]
+
+
+def install(fixtures: RpcFixtures) -> None:
+    """ Sends every http JSON-RPC request thru `fixtures`. """
+    import requests
+    from web3.providers import rpc
+
+    make_post_request = rpc.make_post_request
+
+    def post(endpoint_uri: str, data: bytes, *args: Any, **kwargs: Any) -> bytes:
+        request = json.loads(data)
+        send = lambda: _without_id(json.loads(make_post_request(endpoint_uri, data, *args, **kwargs)))
+        response = fixtures.handle(request['method'], request.get('params', []), send)
+        return json.dumps({**response, 'id': request['id']}).encode()
+
+    rpc.make_post_request = post
+
+    requests_post = requests.post
+
+    def post_batch(url: str, *args: Any, json: Any = None, **kwargs: Any) -> Any:
+        if not isinstance(json, list) or not all(isinstance(request, dict) and 'jsonrpc' in request for request in json):
+            return requests_post(url, *args, json=json, **kwargs)
+        if fixtures.mode == RECORD:
+            response = requests_post(url, *args, json=json, **kwargs)
+            response.raise_for_status()
+            by_id = {item['id']: _without_id(item) for item in response.json()}
+            for request in json:
+                fixtures.handle(request['method'], request['params'], lambda request=request: by_id[request['id']])
+            return response
+        return _BatchResponse([{**fixtures.handle(request['method'], request['params'], None), 'id': request['id']} for request in json])
+
+    requests.post = post_batch
+
+
+class _BatchResponse:
+    status_code = 200
+
+    def __init__(self, body: List[Dict[str, Any]]) -> None:
+        self._body = body
+
+    def raise_for_status(self) -> None:
+        pass
+
+    def json(self) -> List[Dict[str, Any]]:
+        return self._body
+
+
+def _key(method: str, params: Any) -> str:
+    return json.dumps([method, params], sort_keys=True)
+
+
+def _log_range(method: str, params: Any) -> Optional[Tuple[str, int, int]]:
+    """ Returns `(filter key, from_block, to_block)` for an `eth_getLogs` with numbered blocks. """
+    if method != 'eth_getLogs' or not params:
+        return None
+    log_filter = dict(params[0])
+    from_block, to_block = log_filter.pop('fromBlock', None), log_filter.pop('toBlock', None)
+    blocks = []
+    for block in (from_block, to_block):
+        if isinstance(block, int):
+            blocks.append(block)
+        elif isinstance(block, str) and block.startswith('0x'):
+            blocks.append(int(block, 16))
+        else:
+            return None
+    return json.dumps(log_filter, sort_keys=True), blocks[0], blocks[1]
+
+
+def _without_id(response: Dict[str, Any]) -> Dict[str, Any]:
+    return {key: value for key, value in response.items() if key != 'id'}
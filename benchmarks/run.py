@@ -0,0 +1,129 @@
+"""
+Runs the benchmark scenarios against recorded RPC fixtures and reports wall time, RPC count and peak memory for each.
+
+```
+make benchmark-record   # once, against a live archive node, writes benchmarks/fixtures/
+make benchmark          # replays the fixtures, no node needed
+python -m benchmarks.run --scenario get_prices_500 --output bench_output.txt
+```
+
+Each scenario runs in a fresh process with an empty `cache/`, so cold scenarios really are cold and one scenario can't warm another.
+Request coalescing is turned off, since which calls get batched together depends on thread timing and the replay needs the same requests every time.
+Peak memory is the process's max RSS, so it includes importing `y` and the scenario's setup.
+"""
+import argparse
+import json
+import os
+import resource
+import subprocess
+import sys
+import tempfile
+import time
+from typing import Any, Dict, List
+
+BENCHMARKS_DIR = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(BENCHMARKS_DIR)
+FIXTURES_DIR = os.path.join(BENCHMARKS_DIR, 'fixtures')
+
+# when recording, scenarios run at this many blocks behind the head so everything they touch is finalized
+RECORD_DEPTH = 1_000
+
+
+def fixture_path(network: str, scenario: str) -> str:
+    return os.path.join(FIXTURES_DIR, network, f'{scenario}.json.gz')
+
+
+def run_scenario(name: str, network: str, mode: str) -> Dict[str, Any]:
+    """ Runs scenario `name` in this process. This connects `y` to `network`, so it can only run once per process. """
+    sys.path.insert(0, ROOT)
+    from benchmarks.rpc_fixtures import RECORD, RpcFixtures, install
+    from benchmarks.scenarios import SCENARIOS
+
+    scenario = SCENARIOS[name]
+    fixtures = RpcFixtures(fixture_path(network, name), mode)
+    install(fixtures)
+
+    os.environ['BROWNIE_NETWORK_ID'] = network
+    os.environ['YPRICEMAGIC_COALESCE_WINDOW'] = '0'
+    # `y` keeps its caches in `cache/` under the working directory
+    os.chdir(tempfile.mkdtemp(prefix=f'ypricemagic-bench-{name}-'))
+
+    import y  # connects to the node, or to the recording
+    from brownie import chain
+
+    if mode == RECORD:
+        fixtures.metadata['block'] = chain.height - RECORD_DEPTH
+        fixtures.metadata['chain_id'] = chain.id
+    block = fixtures.metadata['block']
+
+    state = scenario.setup(block)
+    setup_rss = _max_rss_mb()
+    requests = fixtures.requests
+    start = time.perf_counter()
+    scenario.run(state)
+    wall = time.perf_counter() - start
+    result = {
+        'scenario': name,
+        'wall_seconds': round(wall, 3),
+        'rpc_requests': fixtures.requests - requests,
+        'peak_rss_mb': round(_max_rss_mb(), 1),
+        'setup_peak_rss_mb': round(setup_rss, 1),
+    }
+    if mode == RECORD:
+        fixtures.save()
+    return result
+
+
+def main(argv: List[str] = None) -> None:
+    from benchmarks.scenarios import SCENARIOS
+
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[1])
+    parser.add_argument('--network', default=os.environ.get('BROWNIE_NETWORK_ID', 'mainnet'), help='the brownie network id')
+    parser.add_argument('--mode', choices=['record', 'replay'], default='replay')
+    parser.add_argument('--scenario', action='append', choices=list(SCENARIOS), help='run only these, can be repeated')
+    parser.add_argument('--output', help='also write the results to this file as json')
+    parser.add_argument('--child', help=argparse.SUPPRESS)
+    args = parser.parse_args(argv)
+
+    if args.child:
+        # the parent reads our result from the last line of stdout
+        print(json.dumps(run_scenario(args.child, args.network, args.mode)))
+        return
+
+    results, failed = [], []
+    for name in args.scenario or list(SCENARIOS):
+        process = subprocess.run(
+            [sys.executable, '-m', 'benchmarks.run', '--child', name, '--network', args.network, '--mode', args.mode],
+            cwd=ROOT, stdout=subprocess.PIPE, text=True,
+        )
+        lines = process.stdout.strip().splitlines()
+        if process.returncode or not lines:
+            failed.append(name)
+            print(f'{name} failed with exit code {process.returncode}', file=sys.stderr)
+            continue
+        results.append(json.loads(lines[-1]))
+
+    _report(results)
+    if args.output:
+        with open(args.output, 'w') as f:
+            json.dump(results, f, indent=2)
+    if failed:
+        sys.exit(1)
+
+
+def _report(results: List[Dict[str, Any]]) -> None:
+    columns = ['scenario', 'wall_seconds', 'rpc_requests', 'peak_rss_mb', 'setup_peak_rss_mb']
+    widths = [max([len(column)] + [len(str(result[column])) for result in results]) for column in columns]
+    print('  '.join(column.ljust(width) for column, width in zip(columns, widths)))
+    for result in results:
+        print('  '.join(str(result[column]).ljust(width) for column, width in zip(columns, widths)))
+
+
+def _max_rss_mb() -> float:
+    # linux reports KiB, macos reports bytes
+    rss = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    return rss / 1024 / 1024 if sys.platform == 'darwin' else rss / 1024
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,118 @@
+"""
+The benchmark scenarios. Each one runs in its own process, against an empty `cache/`, so nothing is warm unless its setup warms it.
+`setup(block)` runs untimed and returns whatever `run` needs. Only `run` is measured.
+These import `y` lazily, since `y` connects to the node on import and `benchmarks.rpc_fixtures.install` has to run first.
+"""
+from typing import Any, Callable, Dict, List, NamedTuple
+
+# mainnet tokens from different buckets, so a warm `get_price` touches more than one pricer
+MAINNET_TOKENS = [
+    '0x6B175474E89094C44Da98b954EedeAC495271d0F', # dai
+    '0xC02aaA39b223FE8D0A0e5C4F27eAD9083C756Cc2', # weth
+    '0x2260FAC5E5542a773Aa44fBCfeDf7C193bc2C599', # wbtc
+    '0x1f9840a85d5aF5bf1D1762F925BDADdC4201F984', # uni
+    '0x6c3F90f043a72FA612cbac8115EE7e52BDe6E490', # 3crv
+    '0xdA816459F1AB5631232FE5e97a05BBBb94970c95', # yvdai
+    '0x5d3a536E4D6DbD6114cc1Ead35777bAB948E3643', # cdai
+    '0xA478c2975Ab1Ea89e8196811F51A7B7Ade33eB11', # uni v2 dai/weth
+]
+
+# how many tokens `get_prices_500` prices
+NUM_TOKENS = 500
+
+# `price_series` prices each token at this many blocks, `SERIES_STEP` apart
+SERIES_BLOCKS = 100
+SERIES_STEP = 1_000
+
+
+class Scenario(NamedTuple):
+    description: str
+    setup: Callable[[int], Any]
+    run: Callable[[Any], Any]
+
+
+def _router() -> Any:
+    from y.prices.dex.uniswap.uniswap import uniswap_multiplexer
+    return uniswap_multiplexer.routers['uniswap v2']
+
+
+def _uniswap_pools_setup(block: int) -> Any:
+    return _router()
+
+
+def _uniswap_pools_run(router: Any) -> int:
+    return len(router.pools)
+
+
+def _curve_registry_run(block: int) -> int:
+    from y.prices.stable_swap.curve import CurveRegistry
+
+    # `CurveRegistry` is a singleton, which `y` built on import. We want a new one, loaded from scratch.
+    registry = type.__call__(CurveRegistry)
+    registry.stop()
+    return len(registry.pools)
+
+
+def _chainlink_feeds_setup(block: int) -> Any:
+    from y.prices.chainlink import chainlink
+
+    # make sure nothing loaded the feeds while `y` was imported
+    chainlink.__dict__.pop('feeds', None)
+    chainlink.__dict__.pop('_feed_confirmed_events', None)
+    return chainlink
+
+
+def _chainlink_feeds_run(chainlink: Any) -> int:
+    return len(chainlink.feeds)
+
+
+def _get_price_setup(block: int) -> Any:
+    from y.prices import magic
+
+    # loads the registries and indexes, at a different block than the one we time
+    magic.get_prices(MAINNET_TOKENS, block - 1, fail_to_None=True, silent=True)
+    return block
+
+
+def _get_price_run(block: int) -> List[Any]:
+    from y.prices import magic
+    return [magic.get_price(token, block, fail_to_None=True, silent=True) for token in MAINNET_TOKENS]
+
+
+def _get_prices_setup(block: int) -> Any:
+    from y.prices.dex.uniswap.v2_forks import UNISWAPS
+    from y.utils.multicall import multicall_same_func_no_input, multicall_same_func_same_contract_different_inputs
+    from y.networks import Network
+
+    # the oldest uniswap v2 pools and their tokens, which gives us a fixed mix of LPs and plain tokens
+    factory = UNISWAPS[Network.Mainnet]['uniswap v2']['factory']
+    pools = multicall_same_func_same_contract_different_inputs(factory, 'allPairs(uint256)(address)', inputs=list(range(NUM_TOKENS // 2)), block=block)
+    token0s = multicall_same_func_no_input(pools, 'token0()(address)', block=block)
+    token1s = multicall_same_func_no_input(pools, 'token1()(address)', block=block)
+    tokens = list(dict.fromkeys(pools + token0s + token1s))[:NUM_TOKENS]
+    return tokens, block
+
+
+def _get_prices_run(state: Any) -> List[Any]:
+    from y.prices import magic
+    tokens, block = state
+    return magic.get_prices(tokens, block, fail_to_None=True, silent=True)
+
+
+def _price_series_setup(block: int) -> Any:
+    return [block - SERIES_STEP * i for i in reversed(range(SERIES_BLOCKS))]
+
+
+def _price_series_run(blocks: List[int]) -> List[Any]:
+    from y.prices import magic
+    return magic.get_prices_matrix(MAINNET_TOKENS, blocks, fail_to_None=True, silent=True)
+
+
+SCENARIOS: Dict[str, Scenario] = {
+    'uniswap_v2_pools_cold': Scenario('index every uniswap v2 pool from an empty store', _uniswap_pools_setup, _uniswap_pools_run),
+    'curve_registry_cold': Scenario('load a new CurveRegistry from an empty store', lambda block: block, _curve_registry_run),
+    'chainlink_feeds_cold': Scenario('load Chainlink.feeds from an empty store', _chainlink_feeds_setup, _chainlink_feeds_run),
+    'get_price_warm': Scenario(f'get_price for {len(MAINNET_TOKENS)} tokens with the registries loaded', _get_price_setup, _get_price_run),
+    'get_prices_500': Scenario(f'get_prices for {NUM_TOKENS} tokens', _get_prices_setup, _get_prices_run),
+    'price_series': Scenario(f'{len(MAINNET_TOKENS)} tokens at {SERIES_BLOCKS} blocks', _price_series_setup, _price_series_run),
+}
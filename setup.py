@@ -15,9 +15,11 @@ setup(
     url='https://github.com/BobTheBuidler/ypricemagic',
     license='MIT',
     install_requires=[
+        'aiohttp>=3.7.4',
         'cachetools>=4.1.1',
         'eth-brownie>=1.18.1',
         'joblib>=1.0.1',
+        'numpy>=1.19',
     ],
     setup_requires=[
         'setuptools_scm',
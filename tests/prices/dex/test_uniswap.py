@@ -1,11 +1,16 @@
 import pytest
 from brownie import chain
 from tests.fixtures import mutate_addresses
+from y.classes.common import ERC20
+from y.constants import usdc, weth
 from y.networks import Network
 from y.prices import magic
 from y.prices.dex.uniswap import v3
 from y.prices.dex.uniswap.uniswap import uniswap_multiplexer
+from y.prices.dex.uniswap.v2 import reserve_tracker
 from y.prices.dex.uniswap.v1 import UniswapV1
+from y.utils.multicall import multicall_same_func_no_input
+from y.utils.raw_calls import raw_call
 
 V1_TOKENS = {
     Network.Mainnet: [
@@ -67,3 +72,48 @@ def test_uniswap_v3(token):
     alt_price = magic.get_price(token)
     print(token, price, alt_price)
     assert price == pytest.approx(alt_price, rel=5e-2)
+
+
+@pytest.mark.parametrize('router', uniswap_multiplexer.routers.values())
+def test_uniswap_v2_pool_index(router):
+    router.refresh_pools()
+    assert len(router.pools) >= raw_call(router.factory, 'allPairsLength()', output='int')
+    for pool in list(router.pools)[:10]:
+        token0, token1 = router.pools[pool].values()
+        assert router.pool_mapping[token0][pool] == token1
+        assert router.pool_mapping[token1][pool] == token0
+
+
+@pytest.mark.parametrize('router', uniswap_multiplexer.routers.values())
+def test_uniswap_v2_reserve_tracking(router):
+    # yfi has a handful of pools on most forks
+    token = '0x0bc529c00C6401aEF6D220BE8C6Ea1667F6Ad93e'
+    pools = list(router.pools_for_token(token))
+    if not pools:
+        pytest.skip(f'no pools for {token} on {router.label}')
+    router.track_reserves(token)
+    block = chain.height - 1_000
+    tracked = reserve_tracker.get_reserves(pools, block)
+    onchain = multicall_same_func_no_input(pools, 'getReserves()((uint112,uint112,uint32))', block=block)
+    assert tracked == [tuple(reserves[:2]) for reserves in onchain]
+
+
+@pytest.mark.parametrize('token', V2_TOKENS)
+def test_uniswap_v2_local_quotes(token):
+    router = uniswap_multiplexer.deepest_router(token)
+    if router.fee is None:
+        pytest.skip(f'{router.label} quotes on chain')
+    path = router.smol_brain_path_selector(token, usdc, weth)
+    amount_in = ERC20(token).scale
+    local, = router.get_quotes(amount_in, [path])
+    assert local == list(router.get_quote(amount_in, path))
+
+
+def test_uniswap_v3_get_prices():
+    if not v3.uniswap_v3:
+        pytest.skip(f'uniswap v3 is not supported on {Network.printable()}')
+    prices = v3.uniswap_v3.get_prices(V2_TOKENS)
+    spot_prices = v3.uniswap_v3.get_prices(V2_TOKENS, spot=True)
+    for token, price, spot_price in zip(V2_TOKENS, prices, spot_prices):
+        assert price == v3.uniswap_v3.get_price(token)
+        assert spot_price == pytest.approx(price, rel=5e-2)
@@ -137,3 +137,14 @@ def test_chainlink_before_feed():
     # try to fetch yfi price one block before feed is deployed
     price = chainlink.get_price('0x0bc529c00C6401aEF6D220BE8C6Ea1667F6Ad93e', 12742718)
     assert price is None
+
+
+def test_chainlink_round_history():
+    # yfi, one block a day for a month after the feed was deployed
+    token = '0x0bc529c00C6401aEF6D220BE8C6Ea1667F6Ad93e'
+    blocks = [12742718 + 6500 * i for i in range(1, 31)]
+    chainlink.index_round_history(token)
+    from_history = chainlink.get_price_series(token, blocks)
+    from_rpc = [chainlink.get_feed(token).latestAnswer(block_identifier=block) / chainlink.feed_scale(token) for block in blocks]
+    assert from_history == from_rpc
+    assert chainlink.get_price_from_history(token, 12742718) is None
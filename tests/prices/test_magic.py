@@ -0,0 +1,82 @@
+import asyncio
+
+import pytest
+from brownie import chain
+from tests.fixtures import blocks_for_contract
+from y.exceptions import PriceCycleError
+from y.networks import Network
+from y.prices import magic
+from y.prices.utils import dag
+
+SERIES_TOKENS = {
+    Network.Mainnet: [
+        '0x6B175474E89094C44Da98b954EedeAC495271d0F', # dai
+        '0xC02aaA39b223FE8D0A0e5C4F27eAD9083C756Cc2', # weth
+        '0x2260FAC5E5542a773Aa44fBCfeDf7C193bc2C599', # wbtc
+        '0x7Fc66500c84A76Ad7e9c93437bFc5Ac33E2DDaE9', # aave
+        '0x0bc529c00C6401aEF6D220BE8C6Ea1667F6Ad93e', # yfi
+        '0x6B3595068778DD592e39A122f4f5a5cF09C90fE2', # sushi
+    ],
+}.get(chain.id, [])
+
+
+@pytest.mark.parametrize('token', SERIES_TOKENS)
+def test_get_price_series(token):
+    blocks = blocks_for_contract(token)
+    prices = magic.get_price_series(token, blocks)
+    assert len(prices) == len(blocks)
+    for block, price in zip(blocks, prices):
+        assert price == pytest.approx(magic.get_price(token, block), rel=5e-2)
+
+
+def test_get_prices_matrix():
+    blocks = [chain.height - 1000, chain.height - 100, chain.height - 10]
+    matrix = magic.get_prices_matrix(SERIES_TOKENS, blocks, silent=True)
+    assert len(matrix) == len(SERIES_TOKENS)
+    assert all(len(series) == len(blocks) for series in matrix)
+
+
+def test_get_prices_batch():
+    block = chain.height - 10
+    prices = magic.get_prices(SERIES_TOKENS, block, silent=True)
+    batched = magic.get_prices(SERIES_TOKENS, block, silent=True, batch=True)
+    assert batched == pytest.approx(prices, rel=1e-6)
+
+
+def test_price_dag_levels():
+    yvdai = '0x19D3364A399d251E894aC732651be8B0E4e85001'
+    dai = '0x6B175474E89094C44Da98b954EedeAC495271d0F'
+    graph = dag.dependency_graph([yvdai])
+    assert dai in graph[yvdai]
+    levels = dag.levels(graph)
+    # underlyings come before the wrappers that depend on them
+    assert [i for i, level in enumerate(levels) if dai in level][0] < [i for i, level in enumerate(levels) if yvdai in level][0]
+
+
+def test_price_cycle_detection():
+    token = '0x6B175474E89094C44Da98b954EedeAC495271d0F'
+    block = chain.height - 10
+    with pytest.raises(PriceCycleError):
+        dag.resolver.resolve(token, block, lambda token, block: dag.resolver.resolve(token, block, lambda *_: 1))
+
+
+@pytest.mark.parametrize('token', SERIES_TOKENS)
+def test_get_price_async(token):
+    block = chain.height - 10
+    price = asyncio.run(magic.get_price_async(token, block))
+    assert price == pytest.approx(magic.get_price(token, block), rel=1e-6)
+
+
+def test_get_prices_async():
+    block = chain.height - 10
+    prices = asyncio.run(magic.get_prices_async(SERIES_TOKENS, block, silent=True))
+    assert prices == pytest.approx(magic.get_prices(SERIES_TOKENS, block, silent=True), rel=1e-6)
+
+
+@pytest.mark.parametrize('token', SERIES_TOKENS)
+def test_trace_price(token):
+    block = chain.height - 10
+    price, span = magic.trace_price(token, block)
+    assert price == pytest.approx(magic.get_price(token, block), rel=1e-6)
+    assert span.duration is not None
+    print(span.render())
@@ -8,7 +8,9 @@ from tests.prices.test_chainlink import FEEDS
 from tests.prices.test_popsicle import POPSICLES
 from tests.prices.test_synthetix import SYNTHS
 from y.constants import EEE_ADDRESS, WRAPPED_GAS_COIN
-from y.prices.utils.buckets import check_bucket
+from y.prices.utils import buckets
+from y.prices.utils.buckets import check_bucket, check_buckets
+from y.utils.store import PriceStore
 
 
 @pytest.mark.parametrize('token',ATOKENS)
@@ -38,3 +40,14 @@ def test_check_bucket_stablecoins(token):
 @pytest.mark.parametrize('token',SYNTHS)
 def test_check_bucket_synthetix(token):
     assert check_bucket(token) == 'synthetix'
+
+def test_check_buckets():
+    tokens = list(POPSICLES) + list(CTOKENS) + list(SYNTHS)
+    assert check_buckets(tokens) == [check_bucket(token) for token in tokens]
+
+def test_check_buckets_probes(monkeypatch, tmp_path):
+    tokens = list(POPSICLES) + list(CTOKENS) + list(SYNTHS) + list(ATOKENS)
+    expected = [check_bucket(token) for token in tokens]
+    # with nothing stored, every token is classified from the shared probes
+    monkeypatch.setattr(buckets, 'price_store', PriceStore(str(tmp_path / 'store.sqlite')))
+    assert check_buckets(tokens) == expected
@@ -0,0 +1,33 @@
+import pytest
+from brownie import chain
+from tests.prices.dex.test_uniswap import V2_TOKENS
+from y.contracts import contract_creation_block
+from y.prices.dex.uniswap.uniswap import uniswap_multiplexer
+from y.prices.utils.liquidity import MAX_HOPS, liquidity_graph
+
+
+@pytest.mark.parametrize('token', V2_TOKENS)
+def test_liquidity_graph_routes(token):
+    routes = liquidity_graph.routes(token)
+    assert routes, 'no routes found'
+    for route in routes:
+        assert len(route) <= MAX_HOPS
+        assert route[-1].token_out in liquidity_graph.anchors
+        for hop, next_hop in zip(route, route[1:]):
+            assert hop.token_out == next_hop.token_in
+
+
+@pytest.mark.parametrize('token', V2_TOKENS)
+def test_liquidity_graph_price(token):
+    price = liquidity_graph.get_price(token)
+    alt_price = uniswap_multiplexer.get_price(token)
+    print(token, price, alt_price)
+    assert price == pytest.approx(alt_price, rel=5e-2)
+
+
+@pytest.mark.parametrize('token', V2_TOKENS)
+def test_liquidity_graph_routes_at_block(token):
+    block = min(contract_creation_block(token) + 100_000, chain.height)
+    for route in liquidity_graph.routes(token, block):
+        for hop in route:
+            assert contract_creation_block(hop.pool) <= block
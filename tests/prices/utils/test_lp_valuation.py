@@ -0,0 +1,18 @@
+import pytest
+from y.prices.stable_swap.curve import curve
+from y.prices.utils.lp_valuation import value_lps
+
+CURVE_LPS = [
+    "0x6c3F90f043a72FA612cbac8115EE7e52BDe6E490", # 3crv
+    "0xC25a3A3b969415c80451098fa907EC722572917F", # sCRV
+    "0x075b1bb99792c9E1041bA13afEf80C91a1e70fB3", # crvRenWSBTC
+]
+
+
+def test_value_lps():
+    valuations = value_lps(CURVE_LPS)
+    for lp, valuation in zip(CURVE_LPS, valuations):
+        alt_price = curve.get_price(lp)
+        print(lp, valuation, alt_price)
+        assert valuation.tvl
+        assert valuation.price == pytest.approx(alt_price, rel=5e-2)
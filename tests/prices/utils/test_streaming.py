@@ -0,0 +1,18 @@
+from brownie import chain
+from tests.prices.dex.test_uniswap import V2_TOKENS
+from y.prices.utils.streaming import PriceStream
+
+
+def test_price_stream():
+    stream = PriceStream(V2_TOKENS)
+    block = chain.height - 10
+    updates = stream.process_block(block)
+    # the first block prices every token
+    assert set(updates) == set(stream.tokens)
+    assert stream.updates.get_nowait() == (block, updates)
+
+    updates = stream.process_block(block + 1)
+    # afterwards we only emit prices that changed
+    for token, price in updates.items():
+        assert token in stream.tokens
+        assert stream.prices[token] == price
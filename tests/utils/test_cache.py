@@ -0,0 +1,60 @@
+from y.utils.cache import BlockCache, CacheStats
+
+
+def test_block_cache_get_set():
+    cache, stats = BlockCache(), CacheStats()
+    cache.set(('f', 1), 'one', None, stats)
+    assert cache.get(('f', 1), stats) == 'one'
+    cache.get(('f', 2), stats)
+    assert (stats.hits, stats.misses) == (1, 1)
+
+
+def test_block_cache_expiry():
+    cache, stats = BlockCache(), CacheStats()
+    cache.set(('f', None), 'latest', -1, stats)
+    cache.get(('f', None), stats)
+    assert (stats.expired, stats.misses) == (1, 1)
+    assert cache.size == 0
+
+
+def test_block_cache_evicts_least_recently_used():
+    cache, stats = BlockCache(), CacheStats()
+    for i in (1, 2, 3):
+        cache.set(('f', i), i, None, stats)
+    # room for two entries, which are all the same size
+    cache.max_bytes = cache.size * 2 // 3 + 1
+    cache.get(('f', 1), stats)
+    cache.set(('f', 4), 4, None, stats)
+    assert stats.evictions == 2
+    assert cache.get(('f', 1), stats) == 1
+    assert cache.get(('f', 4), stats) == 4
+    misses = stats.misses
+    cache.get(('f', 2), stats)
+    cache.get(('f', 3), stats)
+    assert stats.misses == misses + 2
+
+
+def test_block_cache_drop_block_hashes():
+    cache, stats = BlockCache(), CacheStats()
+    cache.set(('f', 100, '0xaa'), 'stale', None, stats, block_hash='0xaa')
+    cache.set(('g', 100, '0xaa'), 'stale', None, stats, block_hash='0xaa')
+    cache.set(('f', 101, '0xbb'), 'fine', None, stats, block_hash='0xbb')
+    cache.set(('f', 50), 'final', None, stats)
+    cache.drop_block_hashes(100, {'0xaa'})
+    assert cache.get(('f', 101, '0xbb'), stats) == 'fine'
+    assert cache.get(('f', 50), stats) == 'final'
+    misses = stats.misses
+    cache.get(('f', 100, '0xaa'), stats)
+    cache.get(('g', 100, '0xaa'), stats)
+    assert stats.misses == misses + 2
+
+
+def test_block_cache_drop_after_eviction():
+    cache, stats = BlockCache(), CacheStats()
+    cache.set(('f', 100, '0xaa'), 'stale', None, stats, block_hash='0xaa')
+    cache.max_bytes = 0
+    cache.set(('f', 101, '0xbb'), 'fine', None, stats, block_hash='0xbb')
+    assert cache.size == 0
+    # everything for both hashes was evicted, so there's nothing left to drop
+    cache.drop_block_hashes(100, {'0xaa', '0xbb'})
+    assert cache.size == 0
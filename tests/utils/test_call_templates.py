@@ -0,0 +1,27 @@
+from brownie.convert.datatypes import EthAddress, HexBytes, Wei
+from y.utils.call_templates import call_template
+from y.utils.multicall import _decode_word
+
+ALICE = '0x' + '1' * 40
+
+
+def test_can_encode_plain_words():
+    template = call_template('transfer(address,uint256)(bool)')
+    assert template.can_encode([ALICE, 10])
+    # brownie converts these, so brownie's encoder has to handle them
+    assert not template.can_encode([ALICE, '1 ether'])
+    assert not template.can_encode([ALICE, Wei('1 ether').to('ether')])
+    assert not template.can_encode([ALICE])
+
+
+def test_encode():
+    template = call_template('transfer(address,uint256)(bool)')
+    assert template.encode(ALICE, 10) == template.selector + bytes(12) + bytes.fromhex('1' * 40) + (10).to_bytes(32, 'big')
+
+
+def test_decode_word_brownie_types():
+    word = bytes(12) + bytes.fromhex('1' * 40)
+    assert type(_decode_word(call_template('owner()(address)'), word)) is EthAddress
+    assert type(_decode_word(call_template('totalSupply()(uint256)'), word)) is Wei
+    assert type(_decode_word(call_template('DOMAIN_SEPARATOR()(bytes32)'), word)) is HexBytes
+    assert _decode_word(call_template('paused()(bool)'), (1).to_bytes(32, 'big')) is True
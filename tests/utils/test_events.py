@@ -0,0 +1,70 @@
+import pytest
+from y.utils.events import (TRANSFER, BalanceCheckpoints,
+                            checkpoints_to_weight,
+                            logs_to_balance_checkpoints)
+
+ZERO = '0x' + '0' * 40
+ALICE = '0x' + '1' * 40
+BOB = '0x' + '2' * 40
+
+
+def _topic(address):
+    return '0x' + '0' * 24 + address[2:]
+
+
+def _transfer(block, sender, receiver, amount):
+    return {'blockNumber': block, 'topics': [TRANSFER, _topic(sender), _topic(receiver)], 'data': '0x' + amount.to_bytes(32, 'big').hex()}
+
+
+LOGS = [
+    _transfer(10, ZERO, ALICE, 100),
+    _transfer(20, ALICE, BOB, 30),
+    # two transfers in one block make one checkpoint
+    _transfer(20, BOB, ALICE, 10),
+    # an erc721 transfer, which we skip
+    {'blockNumber': 25, 'topics': [TRANSFER, _topic(ALICE), _topic(BOB), '0x' + '0' * 63 + '1'], 'data': '0x'},
+    _transfer(30, ALICE, BOB, 5),
+    # amounts can be bigger than any numpy integer
+    _transfer(40, ZERO, BOB, 2 ** 200),
+]
+
+
+def test_balance_checkpoints():
+    checkpoints = BalanceCheckpoints(LOGS)
+    assert set(checkpoints.holders) == {ZERO, ALICE, BOB}
+    assert checkpoints.checkpoints(ALICE) == {10: 100, 20: 80, 30: 75}
+    assert checkpoints.checkpoints(BOB) == {20: 20, 30: 25, 40: 25 + 2 ** 200}
+    assert checkpoints.checkpoints(ZERO) == {10: -100, 40: -100 - 2 ** 200}
+    assert len(checkpoints) == 8
+
+
+def test_balance_at():
+    checkpoints = BalanceCheckpoints(LOGS)
+    assert checkpoints.balance_at(ALICE, 5) == 0
+    assert checkpoints.balance_at(ALICE, 10) == 100
+    assert checkpoints.balance_at(ALICE, 25) == 80
+    assert checkpoints.balance_at(ALICE, 1_000) == 75
+    assert checkpoints.balance_at('0x' + '3' * 40, 1_000) == 0
+
+
+def test_to_dict():
+    checkpoints = logs_to_balance_checkpoints(LOGS)
+    assert checkpoints[ALICE] == {10: 100, 20: 80, 30: 75}
+    # it's still a defaultdict, like it's always been
+    assert checkpoints['0x' + '3' * 40] == {}
+
+
+def test_weights():
+    checkpoints = BalanceCheckpoints(LOGS[:-1])
+    checkpoints_dict = checkpoints.to_dict()
+    for start, end in [(0, 50), (10, 30), (15, 35)]:
+        weights = checkpoints.weights(start, end)
+        for holder in checkpoints.holders:
+            assert weights[holder] == pytest.approx(checkpoints_to_weight(checkpoints_dict[holder], start, end))
+    assert checkpoints.weights(10, 30, [ALICE, '0x' + '3' * 40]) == {ALICE: pytest.approx(checkpoints_to_weight(checkpoints_dict[ALICE], 10, 30)), '0x' + '3' * 40: 0.0}
+
+
+def test_empty():
+    checkpoints = BalanceCheckpoints([])
+    assert len(checkpoints) == 0
+    assert checkpoints.weights(0, 10) == {}
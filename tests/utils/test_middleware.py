@@ -0,0 +1,107 @@
+import threading
+import time
+
+from eth_abi import decode_abi, encode_abi
+from eth_utils import encode_hex
+from hexbytes import HexBytes
+from y.utils import multicall
+from y.utils.middleware import TRY_AGGREGATE, RequestCoalescer
+
+TARGET = '0x' + '11' * 20
+
+# our fake node reverts this call inside a multicall, but not on its own
+FAILS_IN_BATCH = '0xdeadbeef'
+
+
+class FakeNode:
+    """ Answers each eth_call with its own calldata, and holds `eth_chainId` until `release` is set. """
+    def __init__(self) -> None:
+        self.requests = []
+        self.release = threading.Event()
+        self._lock = threading.Lock()
+
+    def __call__(self, method, params):
+        with self._lock:
+            self.requests.append((method, params))
+        if method == 'eth_chainId':
+            self.release.wait(10)
+            return {'jsonrpc': '2.0', 'id': 1, 'result': '0x1'}
+        data = HexBytes(params[0]['data'])
+        if str(params[0]['to']).lower() == str(multicall.multicall2).lower() and data[:4] == TRY_AGGREGATE:
+            _, calls = decode_abi(['bool', '(address,bytes)[]'], data[4:])
+            results = [(encode_hex(calldata) != FAILS_IN_BATCH, calldata) for _, calldata in calls]
+            return {'jsonrpc': '2.0', 'id': 1, 'result': encode_hex(encode_abi(['(bool,bytes)[]'], [results]))}
+        return {'jsonrpc': '2.0', 'id': 1, 'result': encode_hex(data)}
+
+    def aggregates(self):
+        return [params for method, params in self.requests if method == 'eth_call' and HexBytes(params[0]['data'])[:4] == TRY_AGGREGATE]
+
+
+def _call(data):
+    return [{'to': TARGET, 'data': data}, 'latest']
+
+
+def _run_concurrently(coalescer, node, calls):
+    '''
+    Sends `calls` while another request is in flight, so the coalescer sees them as concurrent.
+    Returns the response to each call.
+    '''
+    blocker = threading.Thread(target=coalescer, args=('eth_chainId', []))
+    blocker.start()
+    while not node.requests:
+        time.sleep(0.01)
+    responses = [None] * len(calls)
+
+    def send(i, params):
+        responses[i] = coalescer('eth_call', params)
+    threads = [threading.Thread(target=send, args=(i, params)) for i, params in enumerate(calls)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join(10)
+    node.release.set()
+    blocker.join(10)
+    return responses
+
+
+def test_coalescer_singleflight():
+    node = FakeNode()
+    coalescer = RequestCoalescer(node)
+    threads = [threading.Thread(target=coalescer, args=('eth_chainId', [])) for _ in range(5)]
+    for thread in threads:
+        thread.start()
+    # give every thread time to find the first one's request in flight
+    time.sleep(0.2)
+    node.release.set()
+    for thread in threads:
+        thread.join(10)
+    assert len(node.requests) == 1
+
+
+def test_coalescer_batches_concurrent_calls():
+    node = FakeNode()
+    data = ['0x00000001', '0x00000002', '0x00000003']
+    # a full batch goes out without waiting out the window
+    coalescer = RequestCoalescer(node, window=10, max_batch=len(data))
+    responses = _run_concurrently(coalescer, node, [_call(d) for d in data])
+    assert [response['result'] for response in responses] == data
+    assert len(node.aggregates()) == 1
+
+
+def test_coalescer_resends_failed_subcalls():
+    node = FakeNode()
+    data = ['0x00000001', FAILS_IN_BATCH, '0x00000003']
+    coalescer = RequestCoalescer(node, window=10, max_batch=len(data))
+    responses = _run_concurrently(coalescer, node, [_call(d) for d in data])
+    # the call that failed in the batch got the node's own answer, not a made up revert
+    assert [response['result'] for response in responses] == data
+    assert ('eth_call', _call(FAILS_IN_BATCH)) in node.requests
+
+
+def test_coalescer_window_zero_disables_batching():
+    node = FakeNode()
+    data = ['0x00000001', '0x00000002', '0x00000003']
+    coalescer = RequestCoalescer(node, window=0, max_batch=len(data))
+    responses = _run_concurrently(coalescer, node, [_call(d) for d in data])
+    assert [response['result'] for response in responses] == data
+    assert not node.aggregates()
@@ -0,0 +1,70 @@
+import pytest
+from y.utils.multicall import (MULTICALL_MAX_CALLDATA, MULTICALL_MAX_CALLS,
+                               MULTICALL_MAX_RETURNDATA, _chunk_bounds,
+                               _dispatch, _send_or_bisect)
+
+
+class BadItem(Exception):
+    pass
+
+
+def _send(items):
+    """ A fake multicall that fails whenever `'bad'` is in the batch, and otherwise echoes it. """
+    if 'bad' in items:
+        raise BadItem(f'batch of {len(items)} failed')
+    return list(items)
+
+
+def test_chunk_bounds_max_calls():
+    sizes = [(1, 1)] * (2 * MULTICALL_MAX_CALLS + 5)
+    assert list(_chunk_bounds(sizes)) == [
+        (0, MULTICALL_MAX_CALLS),
+        (MULTICALL_MAX_CALLS, 2 * MULTICALL_MAX_CALLS),
+        (2 * MULTICALL_MAX_CALLS, 2 * MULTICALL_MAX_CALLS + 5),
+    ]
+
+
+def test_chunk_bounds_byte_budgets():
+    calldata = MULTICALL_MAX_CALLDATA // 2 + 1
+    assert list(_chunk_bounds([(calldata, 0)] * 3)) == [(0, 1), (1, 2), (2, 3)]
+    returndata = MULTICALL_MAX_RETURNDATA // 3
+    assert list(_chunk_bounds([(0, returndata)] * 4)) == [(0, 3), (3, 4)]
+
+
+def test_chunk_bounds_oversized_call():
+    # a call over budget on its own still gets sent, in a chunk by itself
+    sizes = [(1, 1), (MULTICALL_MAX_CALLDATA * 2, 1), (1, 1)]
+    assert list(_chunk_bounds(sizes)) == [(0, 1), (1, 2), (2, 3)]
+
+
+def test_chunk_bounds_empty():
+    assert list(_chunk_bounds([])) == []
+
+
+def test_send_or_bisect():
+    items = list(range(7)) + ['bad'] + list(range(8, 16))
+    with pytest.raises(BadItem):
+        _send_or_bisect(items, _send, lambda e: False)
+    with pytest.raises(BadItem):
+        # we bisect down to the bad item, which fails on its own
+        _send_or_bisect(items, _send, lambda e: True)
+
+    good = list(range(16))
+    assert _send_or_bisect(good, _send, lambda e: True) == [good]
+
+
+def test_send_or_bisect_isolates_bad_calls():
+    def send(items):
+        # the batch fails when it's too big, like a multicall that runs out of gas
+        if len(items) > 4:
+            raise BadItem('out of gas')
+        return list(items)
+    outputs = _send_or_bisect(list(range(16)), send, lambda e: isinstance(e, BadItem))
+    assert outputs == [[0, 1, 2, 3], [4, 5, 6, 7], [8, 9, 10, 11], [12, 13, 14, 15]]
+
+
+def test_dispatch_keeps_order():
+    items = list(range(2 * MULTICALL_MAX_CALLS + 5))
+    outputs = _dispatch(items, [(1, 1)] * len(items), _send, lambda e: False)
+    assert len(outputs) == 3
+    assert [item for output in outputs for item in output] == items
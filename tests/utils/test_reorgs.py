@@ -0,0 +1,99 @@
+from types import SimpleNamespace
+
+import pytest
+from hexbytes import HexBytes
+from y.utils import reorgs
+from y.utils.reorgs import ReorgTracker
+
+
+def _hash(fork, number):
+    return HexBytes(f'{fork}-{number}'.encode().ljust(32, b'\0'))
+
+
+class FakeChain:
+    """ The blocks a fake node serves. """
+    def __init__(self) -> None:
+        self.blocks = {}
+        self.head = None
+
+    def build(self, height, fork='a', fork_at=0):
+        """ Grows or shrinks the chain to `height`, replacing every block from `fork_at` up with a block from `fork`. """
+        previous = self.blocks
+        self.blocks = {}
+        for number in range(height + 1):
+            block_fork = fork if number >= fork_at else None
+            if block_fork is None:
+                self.blocks[number] = previous[number]
+                continue
+            parent = self.blocks[number - 1].hash if number else HexBytes(b'\0' * 32)
+            self.blocks[number] = SimpleNamespace(number=number, hash=_hash(block_fork, number), parentHash=parent)
+        self.head = height
+        return self
+
+    def get_block(self, block_id):
+        if block_id == 'latest':
+            return self.blocks[self.head]
+        if isinstance(block_id, int):
+            return self.blocks[block_id]
+        return next(block for block in self.blocks.values() if block.hash.hex() == block_id)
+
+
+@pytest.fixture
+def fake_chain(monkeypatch):
+    chain = FakeChain()
+    monkeypatch.setattr(reorgs, 'web3', SimpleNamespace(eth=chain))
+    monkeypatch.setattr(reorgs, 'last_finalized_block', lambda: 0)
+    # we call `check_head` ourselves
+    monkeypatch.setattr(reorgs, 'HEAD_POLL_INTERVAL', float('inf'))
+    return chain
+
+
+def _tracker():
+    tracker = ReorgTracker()
+    reorged = []
+    tracker.on_reorg(lambda block, stale: reorged.append((block, stale)))
+    return tracker, reorged
+
+
+def test_no_reorg(fake_chain):
+    tracker, reorged = _tracker()
+    fake_chain.build(10)
+    assert tracker.check_head() is None
+    assert tracker.block_hash(8) == _hash('a', 8).hex()
+    fake_chain.build(15)
+    assert tracker.check_head() is None
+    assert not reorged
+
+
+def test_reorg_at_head(fake_chain):
+    tracker, reorged = _tracker()
+    fake_chain.build(10)
+    tracker.check_head()
+    fake_chain.build(10, fork='b', fork_at=10)
+    assert tracker.check_head() == 10
+    assert reorged == [(10, {_hash('a', 10).hex()})]
+    assert tracker.block_hash(10) == _hash('b', 10).hex()
+
+
+def test_reorg_behind_unchecked_blocks(fake_chain):
+    tracker, reorged = _tracker()
+    fake_chain.build(10)
+    tracker.check_head()
+    assert tracker.block_hash(8) == _hash('a', 8).hex()
+    # no head checks ran while the chain grew to 15, and blocks 8 and up were replaced
+    fake_chain.build(15, fork='b', fork_at=8)
+    assert tracker.check_head() == 8
+    assert reorged == [(8, {_hash('a', 8).hex(), _hash('a', 10).hex()})]
+    assert tracker.block_hash(8) == _hash('b', 8).hex()
+    assert tracker.block_hash(10) == _hash('b', 10).hex()
+
+
+def test_shorter_chain(fake_chain):
+    tracker, reorged = _tracker()
+    fake_chain.build(10)
+    tracker.check_head()
+    fake_chain.build(9, fork='b', fork_at=9)
+    # we never recorded block 9, so block 10 is the first one we know was replaced
+    assert tracker.check_head() == 10
+    assert reorged == [(10, {_hash('a', 10).hex()})]
+    assert tracker.block_hash(9) == _hash('b', 9).hex()
@@ -0,0 +1,36 @@
+import pytest
+from y.utils.store import LogStore
+
+KEY = 'test filter'
+
+
+@pytest.fixture
+def log_store(tmp_path):
+    return LogStore(str(tmp_path / 'store.sqlite'))
+
+
+def test_get_gaps_empty(log_store):
+    assert log_store.get_gaps(KEY, 0, 50) == [(0, 50)]
+
+
+def test_get_gaps(log_store):
+    log_store.add_chunk(KEY, 10, 19, [])
+    log_store.add_chunk(KEY, 30, 39, [])
+    assert log_store.get_gaps(KEY, 0, 50) == [(0, 9), (20, 29), (40, 50)]
+    assert log_store.get_gaps(KEY, 12, 35) == [(20, 29)]
+    assert log_store.get_gaps(KEY, 10, 19) == []
+    # chunks for other filters don't count
+    assert log_store.get_gaps('another filter', 10, 19) == [(10, 19)]
+
+
+def test_get_gaps_overlapping_chunks(log_store):
+    log_store.add_chunk(KEY, 10, 29, [])
+    log_store.add_chunk(KEY, 20, 39, [])
+    log_store.add_chunk(KEY, 40, 40, [])
+    assert log_store.get_gaps(KEY, 0, 50) == [(0, 9), (41, 50)]
+
+
+def test_get_logs(log_store):
+    logs = [{'blockNumber': block, 'logIndex': 0} for block in (10, 15, 19)]
+    log_store.add_chunk(KEY, 10, 19, logs)
+    assert log_store.get_logs(KEY, 12, 19) == logs[1:]
@@ -13,7 +13,8 @@ from y.exceptions import (CalldataPreparationError, CallReverted,
                           UnsupportedNetwork)
 from y.networks import Network
 from y.prices import magic
-from y.prices.magic import get_price, get_prices
+from y.prices.magic import (get_price, get_price_async, get_price_series,
+                            get_prices, get_prices_async, get_prices_matrix)
 from y.utils.multicall import fetch_multicall
 from y.utils.raw_calls import _balanceOf as balanceOf
 from y.utils.raw_calls import _balanceOfReadable as balanceOfReadable
@@ -38,6 +39,10 @@ __all__ = [
     # prices
     'get_price',
     'get_prices',
+    'get_price_series',
+    'get_prices_matrix',
+    'get_price_async',
+    'get_prices_async',
 
     # constants
     'weth',
@@ -1,26 +1,30 @@
 
 import logging
 from functools import cached_property, lru_cache
-from typing import Any, Optional, Union
+from typing import Any, Dict, List, Optional, Tuple, Union
 
 import brownie
 from brownie.exceptions import ContractNotFound
 from y import convert
 from y.classes.singleton import ContractSingleton
 from y.constants import EEE_ADDRESS
-from y.contracts import Contract, build_name, has_method
+from y.contracts import Contract, build_name, has_method, static_contract
 from y.datatypes import UsdPrice
 from y.decorators import log
 from y.erc20 import decimals, totalSupply
 from y.exceptions import ContractNotVerified, MessedUpBrownieContract
 from y.prices import magic
 from y.typing import AnyAddressType, Block
+from y.utils.cache import block_cache
 from y.utils.raw_calls import _name, _symbol
 
 logger = logging.getLogger(__name__)
 
 
 class ContractBase(metaclass=ContractSingleton):
+    # subclasses that only call a few known methods can set `(name, abi)` here, so `contract` never waits on the block explorer
+    static_abi: Optional[Tuple[str, List[Dict[str, Any]]]] = None
+
     def __init__(self, address: AnyAddressType, *args: Any, **kwargs: Any) -> None:
         self.address = convert.to_address(address)
         super().__init__(*args, **kwargs)
@@ -37,6 +41,9 @@ class ContractBase(metaclass=ContractSingleton):
     
     @cached_property
     def contract(self) -> brownie.Contract:
+        if self.static_abi is not None:
+            name, abi = self.static_abi
+            return static_contract(name, self.address, abi)
         return Contract(self.address)
     
     @cached_property
@@ -108,7 +115,7 @@ class ERC20(ContractBase):
         return 10 ** self._decimals(block=block)
 
     @log(logger)
-    @lru_cache
+    @block_cache
     def total_supply(self, block: Optional[Block] = None) -> int:
         return totalSupply(self.address, block=block)
     
@@ -1,7 +1,9 @@
 import logging
 import threading
+from collections import defaultdict
 from functools import lru_cache
-from typing import Any, Callable, List, Optional, Union
+from typing import (Any, Callable, Dict, Iterable, List, Optional, Tuple,
+                    Union)
 
 import brownie
 from brownie import chain, web3
@@ -18,13 +20,29 @@ from y.interfaces.ERC20 import ERC20ABI
 from y.networks import Network
 from y.typing import Address, AnyAddressType, Block
 from y.utils.cache import memory
+from y.utils.client import jsonrpc_batch
+from y.utils.store import creation_block_store
 
 logger = logging.getLogger(__name__)
 
 
 def Contract_erc20(address: AnyAddressType) -> brownie.Contract:
+    return static_contract('ERC20', address, ERC20ABI)
+
+
+def static_contract(name: str, address: AnyAddressType, abi: List[Dict[str, Any]]) -> brownie.Contract:
+    """
+    Returns a `brownie.Contract` for `address` built from `abi`, one of the interfaces in `y.interfaces`.
+    Unlike `Contract`, it never waits on the block explorer and never writes to brownie's deployments db,
+    so hot paths that only call a few known methods can use it freely. Handles are cached by `(name, address)`.
+    """
     address = convert.to_address(address)
-    return Contract.from_abi('ERC20',address,ERC20ABI)
+    key = (name, address)
+    if key not in _static_contracts:
+        with _lock_for(address):
+            if key not in _static_contracts:
+                _static_contracts[key] = brownie.Contract.from_abi(name, address, abi, persist=False)
+    return _static_contracts[key]
 
 
 def Contract_with_erc20_fallback(address: AnyAddressType) -> brownie.Contract:
@@ -38,14 +56,28 @@ def Contract_with_erc20_fallback(address: AnyAddressType) -> brownie.Contract:
 
 
 @log(logger)
-@memory.cache()
 def contract_creation_block(address: AnyAddressType, when_no_history_return_0: bool = False) -> int:
     """
-    Determine the block when a contract was created using binary search.
+    Determine the block when a contract was created. Goes through `contract_creation_blocks`, so we check the store first,
+    then ask otterscan's `ots_getContractCreator` if the node supports it, then fall back to a binary search over `eth_getCode`.
+    Blocks we find are persisted to the store.
     NOTE Requires access to historical state. Doesn't account for CREATE2 or SELFDESTRUCT.
     """
-    address = convert.to_address(address)
     logger.info("contract creation block %s", address)
+    return contract_creation_blocks([address], when_no_history_return_0=when_no_history_return_0)[0]
+
+
+@log(logger)
+def contract_creation_blocks(addresses: Iterable[AnyAddressType], when_no_history_return_0: bool = False) -> List[Optional[int]]:
+    """
+    Returns `[contract_creation_block(address) for address in addresses]`, but much faster for many addresses.
+
+    If the node supports otterscan's `ots_getContractCreator`, we ask it for each creation tx directly.
+    Otherwise the binary searches for every address run in lockstep, with each step's `eth_getCode` probes
+    sent in one JSON-RPC batch, so 100 addresses cost about as many round trips as 1.
+    NOTE Requires access to historical state. Doesn't account for CREATE2 or SELFDESTRUCT.
+    """
+    addresses = [convert.to_address(address) for address in addresses]
     height = chain.height
 
     if height == 0:
@@ -53,34 +85,107 @@ def contract_creation_block(address: AnyAddressType, when_no_history_return_0: b
             `chain.height` returns 0 on your node, which means it is not fully synced.
             You can only use this function on a fully synced node.''')
 
-    lo, hi = 0, height
-    while hi - lo > 1:
-        mid = lo + (hi - lo) // 2
-        try:
-            if get_code(address, mid):
-                hi = mid
+    creation_blocks = creation_block_store.get_creation_blocks(addresses)
+    pending = [address for address in dict.fromkeys(addresses) if address not in creation_blocks]
+
+    if pending and _otterscan_supported():
+        found = _creation_blocks_from_otterscan(pending)
+        creation_blocks.update(found)
+        creation_block_store.set_creation_blocks(found)
+        pending = [address for address in pending if address not in found]
+
+    if pending:
+        found = _creation_blocks_from_search(pending, height, when_no_history_return_0)
+        creation_blocks.update(found)
+        # a contract that isn't deployed yet has no creation block, and 0 just means we couldn't search
+        creation_block_store.set_creation_blocks({address: block for address, block in found.items() if block})
+
+    return [creation_blocks[address] for address in addresses]
+
+
+@lru_cache(maxsize=1)
+def _otterscan_supported() -> bool:
+    try:
+        web3.manager.request_blocking('ots_getApiLevel', [])
+        return True
+    except Exception:
+        return False
+
+
+def _creation_blocks_from_otterscan(addresses: List[Address]) -> Dict[Address, int]:
+    creators = jsonrpc_batch('ots_getContractCreator', [[address] for address in addresses])
+    found = [(address, creator['hash']) for address, creator in zip(addresses, creators) if creator]
+    txs = jsonrpc_batch('eth_getTransactionByHash', [[tx_hash] for _, tx_hash in found])
+    return {
+        address: int(tx['blockNumber'], 16) if isinstance(tx['blockNumber'], str) else tx['blockNumber']
+        for (address, _), tx in zip(found, txs)
+        if tx and tx['blockNumber'] is not None
+    }
+
+
+def _creation_blocks_from_search(addresses: List[Address], height: int, when_no_history_return_0: bool) -> Dict[Address, Optional[int]]:
+    searches = {address: [0, height] for address in addresses}
+    results = {}
+    while searches:
+        mids = {address: lo + (hi - lo) // 2 for address, (lo, hi) in searches.items()}
+        codes = jsonrpc_batch('eth_getCode', [[address, hex(mid)] for address, mid in mids.items()])
+
+        for (address, mid), code in zip(mids.items(), codes):
+            if code is None:
+                # the batch request failed for this one, `_has_code` will surface the node's error
+                try:
+                    has_code = _has_code(address, mid)
+                except _NoHistory:
+                    if when_no_history_return_0:
+                        results[address] = 0
+                        del searches[address]
+                        continue
+                    has_code = False
             else:
-                lo = mid
-        except ValueError as e:
-            if 'missing trie node' in str(e):
-                logger.critical('missing trie node, `contract_creation_block` may output a higher block than actual. Please try again using an archive node.')
-                if when_no_history_return_0:
-                    return 0
-            elif 'Server error: account aurora does not exist while viewing' in str(e):
-                logger.critical(str(e))
-                if when_no_history_return_0:
-                    return 0
-            elif 'No state available for block' in str(e):
-                logger.critical(str(e))
-                if when_no_history_return_0:
-                    return 0
+                has_code = code not in ('0x', '0x0')
+            
+            if has_code:
+                searches[address][1] = mid
             else:
-                raise
-            lo = mid
-    return hi if hi != height else None
+                searches[address][0] = mid
+
+        for address, (lo, hi) in list(searches.items()):
+            if hi - lo <= 1:
+                results[address] = hi if hi != height else None
+                del searches[address]
+    return results
+
+
+class _NoHistory(Exception):
+    pass
+
+
+def _has_code(address: Address, block: Block) -> bool:
+    try:
+        return bool(get_code(address, block))
+    except ValueError as e:
+        if 'missing trie node' in str(e):
+            logger.critical('missing trie node, `contract_creation_block` may output a higher block than actual. Please try again using an archive node.')
+        elif 'Server error: account aurora does not exist while viewing' in str(e):
+            logger.critical(str(e))
+        elif 'No state available for block' in str(e):
+            logger.critical(str(e))
+        else:
+            raise
+        raise _NoHistory(str(e))
+
+_static_contracts: Dict[Tuple[str, Address], brownie.Contract] = {}
+
+# we lock per address, so one slow explorer fetch doesn't block every other contract
+_contract_locks: Dict[Address, threading.Lock] = defaultdict(threading.Lock)
+_contract_locks_lock = threading.Lock()
+
+
+def _lock_for(address: Address) -> threading.Lock:
+    with _contract_locks_lock:
+        return _contract_locks[address]
 
 # cached Contract instance, saves about 20ms of init time
-_contract_lock = threading.Lock()
 
 @lru_cache
 class Contract(brownie.Contract):
@@ -96,7 +201,7 @@ class Contract(brownie.Contract):
         
         address = convert.to_address(address)
         
-        with _contract_lock:
+        with _lock_for(address):
             try:
                 try:
                     super().__init__(address, *args, owner=owner, **kwargs)
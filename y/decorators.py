@@ -1,4 +1,5 @@
 
+import functools
 import logging
 from random import randrange
 from sqlite3 import OperationalError
@@ -6,6 +7,7 @@ from time import sleep
 from typing import Any, Callable
 
 from requests.exceptions import HTTPError, ReadTimeout
+from y.utils import metrics
 
 retry_logger = logging.getLogger('auto_retry')
 
@@ -27,13 +29,19 @@ def continue_on_revert(func: Callable) -> Any:
 def log(logger: logging.Logger):
     """
     Decorates a function so both the inputs and outputs are logged with logger level DEBUG.
+    The log lines are only formatted when DEBUG is enabled, or when we're recording a `metrics.trace`.
     For convenience, also decorates the function with @auto_retry.
     """
 
     def log_decorator(func: Callable) -> Callable:
         assert logger, 'To use @debug_logging decorator, you must pass in a logger.'
 
+        @functools.wraps(func)
         def logging_wrap(*args: Any, **kwargs: Any) -> Any:
+            debug = logger.isEnabledFor(logging.DEBUG)
+            if not debug and not metrics.tracing():
+                return retry_superwrap(*args, **kwargs)
+
             fn_name = func.__name__
 
             if len(kwargs) == 0:
@@ -41,12 +49,16 @@ def log(logger: logging.Logger):
             else:
                 describer_string = f'{fn_name}{tuple([*args])}, kwargs: {[*kwargs.items()]}'
             
-            logger.debug(f'Fetching {describer_string}')
-            func_returns = retry_superwrap(*args,**kwargs)
-            logger.debug(f'{describer_string} returns: {func_returns}')
+            if debug:
+                logger.debug(f'Fetching {describer_string}')
+            with metrics.span(describer_string):
+                func_returns = retry_superwrap(*args,**kwargs)
+            if debug:
+                logger.debug(f'{describer_string} returns: {func_returns}')
             return func_returns
         
         @auto_retry
+        @functools.wraps(func)
         def retry_superwrap(*args: Any, **kwargs: Any) -> Callable:
             return func(*args, **kwargs)
 
@@ -69,6 +81,7 @@ def auto_retry(func):
     On repeat errors, will retry in increasing intervals.
     '''
 
+    @functools.wraps(func)
     def retry_wrap(*args, **kwargs):
         i = 0
         sleep_time = randrange(10,20)
@@ -89,18 +102,23 @@ def auto_retry(func):
                 )
                 if 1 > 10 or not any([err in str(e) for err in retry_on_errs]):
                     raise
-                retry_logger.warning(f'{str(e)} [{i}]')
+                _record_retry(func, e, i)
             except (ConnectionError, HTTPError, TimeoutError, ReadTimeout) as e:
                 # This happens when we pass too large of a request to the node. Do not retry.
                 if 'Too Large' in str(e):
                     raise
-                retry_logger.warning(f'{str(e)} [{i}]')
+                _record_retry(func, e, i)
             except OperationalError as e:
                 # This happens when brownie's deployments.db gets locked. Just retry.
                 if 'database is locked' not in str(e):
                     raise
-                retry_logger.warning(f'{str(e)} [{i}]')
+                _record_retry(func, e, i)
             i += 1
             sleep(i * sleep_time)
 
     return retry_wrap
+
+
+def _record_retry(func: Callable, e: Exception, i: int) -> None:
+    retry_logger.warning(f'{str(e)} [{i}]')
+    metrics.inc('auto_retry_retries_total', function=getattr(func, '__qualname__', repr(func)), error=type(e).__name__)
@@ -13,6 +13,9 @@ class NetworkNotSpecified(Exception):
 class PriceError(Exception):
     pass
 
+class PriceCycleError(PriceError):
+    pass
+
 class UnsupportedNetwork(Exception):
     pass
 
@@ -0,0 +1,2 @@
+# the methods every curve pool shares. `coins`, `balances` and `get_dy` take int128 or uint256 depending on the pool, so they aren't here.
+CURVE_POOL_ABI = [{"name":"get_virtual_price","outputs":[{"type":"uint256","name":""}],"inputs":[],"stateMutability":"view","type":"function"},{"name":"A","outputs":[{"type":"uint256","name":""}],"inputs":[],"stateMutability":"view","type":"function"},{"name":"fee","outputs":[{"type":"uint256","name":""}],"inputs":[],"stateMutability":"view","type":"function"}]
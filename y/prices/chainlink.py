@@ -1,19 +1,30 @@
+import asyncio
 import logging
+import threading
+from bisect import bisect_right
 from functools import cached_property, lru_cache
-from typing import Dict, Optional
+from typing import Any, Dict, List, Optional, Set, Tuple
 
 from brownie import ZERO_ADDRESS, chain
-from cachetools.func import ttl_cache
+from eth_utils import encode_hex, keccak
+from hexbytes import HexBytes
 from y import convert
 from y.classes.common import ERC20
 from y.classes.singleton import Singleton
-from y.contracts import Contract
+from y.contracts import (Contract, contract_creation_block,
+                         contract_creation_blocks, static_contract)
 from y.datatypes import UsdPrice
 from y.decorators import log
 from y.exceptions import UnsupportedNetwork
+from y.interfaces.chainlink import AGGREGATOR_PROXY_ABI
 from y.networks import Network
 from y.typing import Address, AnyAddressType, Block
-from y.utils.events import create_filter, decode_logs, get_logs_asap
+from y.utils.async_rpc import async_rpc
+from y.utils.cache import block_cache
+from y.utils.events import create_filter, decode_logs, get_logs_asap, get_logs_asap_generator
+from y.utils.multicall import fetch_multicall, fetch_multicall_series, multicall_same_func_same_contract_different_inputs
+from y.utils.raw_calls import raw_call
+from y.utils.store import is_finalized, last_finalized_block, round_store
 
 logger = logging.getLogger(__name__)
 
@@ -129,6 +140,57 @@ FEEDS = {
 }.get(chain.id, {})
 
 
+# AnswerUpdated(int256 indexed current, uint256 indexed roundId, uint256 updatedAt)
+ANSWER_UPDATED = encode_hex(keccak(text='AnswerUpdated(int256,uint256,uint256)'))
+
+
+class AggregatorHistory:
+    """
+    Every answer a chainlink aggregator has reported, indexed from its `AnswerUpdated` events.
+    Rounds through the last finalized block are kept in the `round_store`, so after the first run we only fetch new events.
+    """
+    def __init__(self, aggregator: Address) -> None:
+        self.aggregator = aggregator
+        self.blocks: List[Block] = []
+        self.answers: List[int] = []
+        self.last_block: Optional[Block] = None
+        self._lock = threading.Lock()
+
+    def __repr__(self) -> str:
+        return f"<AggregatorHistory {self.aggregator} rounds={len(self.blocks)} last_block={self.last_block}>"
+
+    @log(logger)
+    def refresh(self) -> None:
+        with self._lock:
+            finalized_block = last_finalized_block()
+            last_block = round_store.get_last_block(self.aggregator)
+            if last_block is None or last_block < finalized_block:
+                logs = get_logs_asap_generator(
+                    self.aggregator,
+                    [ANSWER_UPDATED],
+                    from_block=None if last_block is None else last_block + 1,
+                    to_block=finalized_block,
+                    cache=False,
+                )
+                rounds = [(log['blockNumber'], _int256(log['topics'][1])) for log in logs]
+                round_store.add_rounds(self.aggregator, rounds, last_block=finalized_block)
+                last_block = finalized_block
+            self.blocks, self.answers = round_store.get_rounds(self.aggregator)
+            self.last_block = last_block
+
+    def answer_at(self, block: Block) -> Optional[int]:
+        '''
+        Returns the latest answer as of `block`, or None if the aggregator hadn't answered yet.
+        `block` must not be after `self.last_block`.
+        '''
+        i = bisect_right(self.blocks, block) - 1
+        return None if i < 0 else self.answers[i]
+
+
+def _int256(topic: Any) -> int:
+    return int.from_bytes(HexBytes(topic), 'big', signed=True)
+
+
 class Chainlink(metaclass=Singleton):
     def __init__(self) -> None:
         if chain.id not in registries and len(FEEDS) == 0:
@@ -136,26 +198,35 @@ class Chainlink(metaclass=Singleton):
 
         if chain.id in registries:
             self.registry = Contract(registries[chain.id])
+
+        self._histories: Dict[Address, AggregatorHistory] = {}
+        self._histories_lock = threading.Lock()
+        self._indexed_assets: Set[Address] = set()
         
+    @cached_property
+    def _feed_confirmed_events(self) -> List[Any]:
+        """
+        Every `FeedConfirmed` event emitted by the registry, oldest first.
+        """
+        if chain.id not in registries:
+            return []
+        try:
+            log_filter = create_filter(str(self.registry), [self.registry.topics['FeedConfirmed']])
+            new_entries = log_filter.get_new_entries()
+        except ValueError as e:
+            if 'the method is currently not implemented: eth_newFilter' not in str(e):
+                raise
+            new_entries = get_logs_asap(str(self.registry), [self.registry.topics['FeedConfirmed']])
+        return decode_logs(new_entries)
+
     @cached_property
     @log(logger)
     def feeds(self) -> Dict[ERC20, str]:
-        if chain.id in registries:
-            try:
-                log_filter = create_filter(str(self.registry), [self.registry.topics['FeedConfirmed']])
-                new_entries = log_filter.get_new_entries()
-            except ValueError as e:
-                if 'the method is currently not implemented: eth_newFilter' not in str(e):
-                    raise
-                new_entries = get_logs_asap(str(self.registry), [self.registry.topics['FeedConfirmed']])
-
-            logs = decode_logs(new_entries)
-            feeds = {
-                log['asset']: log['latestAggregator']
-                for log in logs
-                if log['denomination'] == DENOMINATIONS['USD'] and log['latestAggregator'] != ZERO_ADDRESS
-            }
-        else: feeds = {}
+        feeds = {
+            log['asset']: log['latestAggregator']
+            for log in self._feed_confirmed_events
+            if log['denomination'] == DENOMINATIONS['USD'] and log['latestAggregator'] != ZERO_ADDRESS
+        }
         # for mainnet, we have some extra feeds to pull in
         # for non-mainnet, we have no registry so must get feeds manually
         feeds.update(FEEDS)
@@ -165,18 +236,20 @@ class Chainlink(metaclass=Singleton):
 
     @log(logger)
     def get_feed(self, asset: Address) -> Contract:
-        return Contract(self.feeds[convert.to_address(asset)])
+        return static_contract('ChainlinkAggregatorProxy [static]', self.feeds[convert.to_address(asset)], AGGREGATOR_PROXY_ABI)
 
     @log(logger)
     def __contains__(self, asset: AnyAddressType) -> bool:
         return convert.to_address(asset) in self.feeds
 
-    @ttl_cache(maxsize=None, ttl=600)
+    @block_cache
     @log(logger)
     def get_price(self, asset, block: Optional[Block] = None) -> UsdPrice:
         asset = convert.to_address(asset)
         if asset == ZERO_ADDRESS:
             return None
+        if block is not None and self._in_history(asset, block):
+            return self.get_price_from_history(asset, block)
         try:
             price = self.get_feed(asset).latestAnswer(block_identifier=block) / self.feed_scale(asset)
             logger.debug("chainlink -> %s", price)
@@ -184,6 +257,152 @@ class Chainlink(metaclass=Singleton):
         except ValueError:
             return None
     
+    async def get_price_async(self, asset: AnyAddressType, block: Optional[Block] = None) -> Optional[UsdPrice]:
+        """
+        Like `get_price`, but fetches the feed's answer and decimals with `async_rpc`. `self.feeds` must already be loaded.
+        """
+        asset = convert.to_address(asset)
+        if asset == ZERO_ADDRESS:
+            return None
+        feed = self.feeds[asset]
+        try:
+            answer, decimals = await asyncio.gather(
+                async_rpc.call(feed, 'latestAnswer()(int256)', block=block),
+                async_rpc.call(feed, 'decimals()(uint8)'),
+            )
+        except ValueError:
+            return None
+        price = answer / 10 ** decimals
+        logger.debug("chainlink -> %s", price)
+        return UsdPrice(price)
+    
+    @log(logger)
+    def get_prices(self, assets: List[AnyAddressType], block: Optional[Block] = None) -> List[Optional[UsdPrice]]:
+        """
+        Returns `[self.get_price(asset, block) for asset in assets]`, using one multicall for every feed's answer and decimals.
+        """
+        assets = [convert.to_address(asset) for asset in assets]
+        feeds = [None if asset == ZERO_ADDRESS else self.get_feed(asset) for asset in assets]
+        live_feeds = [feed for feed in feeds if feed is not None]
+        results = fetch_multicall(
+            *[[feed, 'latestAnswer'] for feed in live_feeds],
+            *[[feed, 'decimals'] for feed in live_feeds],
+            block=block,
+        )
+        answers = iter(zip(results[:len(live_feeds)], results[len(live_feeds):]))
+
+        prices = []
+        for feed in feeds:
+            answer, decimals = (None, None) if feed is None else next(answers)
+            prices.append(None if answer is None or decimals is None else answer / 10 ** decimals)
+        return prices
+
+    @log(logger)
+    def get_price_series(self, asset: AnyAddressType, blocks: List[Block]) -> List[Optional[UsdPrice]]:
+        """
+        Returns `[self.get_price(asset, block) for block in blocks]`.
+        Finalized blocks are answered from the asset's round history, which we index first if we need to.
+        The `latestAnswer` calls for any other blocks are batched across blocks.
+        """
+        asset = convert.to_address(asset)
+        if asset == ZERO_ADDRESS:
+            return [None for _ in blocks]
+        blocks = list(blocks)
+        if any(is_finalized(block) for block in blocks):
+            self.index_round_history(asset)
+        prices = {block: self.get_price_from_history(asset, block) for block in blocks if self._in_history(asset, block)}
+
+        recent = [block for block in blocks if block not in prices]
+        if recent:
+            scale = self.feed_scale(asset)
+            results = fetch_multicall_series([self.get_feed(asset), 'latestAnswer'], blocks=recent)
+            prices.update({block: None if answer is None else answer / scale for block, (answer,) in zip(recent, results)})
+        return [prices[block] for block in blocks]
+
+    @log(logger)
+    def index_round_history(self, asset: AnyAddressType) -> None:
+        """
+        Indexes the answers of every aggregator that has served `asset`, so `get_price` can answer finalized blocks with no RPC calls.
+        Call it again to pick up new rounds.
+        """
+        asset = convert.to_address(asset)
+        for _, aggregator in self.aggregator_segments(asset):
+            if aggregator is not None:
+                self.round_history(aggregator).refresh()
+        self._indexed_assets.add(asset)
+
+    @log(logger)
+    def get_price_from_history(self, asset: AnyAddressType, block: Block) -> Optional[UsdPrice]:
+        """
+        Returns `asset`'s price at `block` from the indexed round history, with a binary search and no RPC calls.
+        `block` must be finalized and the asset indexed with `index_round_history`.
+        """
+        asset = convert.to_address(asset)
+        segments = self.aggregator_segments(asset)
+        i = bisect_right([start for start, _ in segments], block) - 1
+        while i >= 0:
+            aggregator = segments[i][1]
+            if aggregator is None:
+                # the feed was removed from the registry
+                return None
+            answer = self.round_history(aggregator).answer_at(block)
+            if answer is not None:
+                price = answer / self.feed_scale(asset)
+                logger.debug("chainlink history -> %s", price)
+                return UsdPrice(price)
+            # the new aggregator hadn't answered yet, the previous one was still live
+            i -= 1
+        return None
+
+    @lru_cache(maxsize=None)
+    def aggregator_segments(self, asset: Address) -> List[Tuple[Block, Optional[Address]]]:
+        """
+        Returns `[(start_block, aggregator), ...]` for every aggregator that has served `asset`'s USD price, oldest first.
+        An aggregator of None means the feed was removed at `start_block`.
+
+        Registry assets follow the registry's `FeedConfirmed` events. For our manual feeds we walk the proxy's phases,
+        and since a proxy doesn't log when it switches phase, we take when each aggregator was deployed as its start.
+        """
+        asset = convert.to_address(asset)
+        manual_feeds = {convert.to_address(token): feed for token, feed in FEEDS.items()}
+        if asset in manual_feeds:
+            proxy = manual_feeds[asset]
+            phase_id = raw_call(proxy, 'phaseId()', output='int', return_None_on_failure=True)
+            if not phase_id:
+                # not a proxy, the feed is the aggregator
+                return [(contract_creation_block(proxy), convert.to_address(proxy))]
+            aggregators = multicall_same_func_same_contract_different_inputs(
+                proxy, 'phaseAggregators(uint16)(address)', inputs=list(range(1, phase_id + 1)), return_None_on_failure=True
+            )
+            aggregators = [convert.to_address(aggregator) for aggregator in aggregators if aggregator not in [None, ZERO_ADDRESS]]
+            return sorted(zip(contract_creation_blocks(aggregators), aggregators))
+
+        segments = []
+        for event in self._feed_confirmed_events:
+            if event['asset'] != asset or event['denomination'] != DENOMINATIONS['USD']:
+                continue
+            aggregator = None if event['latestAggregator'] == ZERO_ADDRESS else event['latestAggregator']
+            if not segments and aggregator is not None:
+                # an aggregator has answers from before it was added to the registry, which `get_price` would see
+                segments.append((contract_creation_block(aggregator), aggregator))
+            else:
+                segments.append((event.block_number, aggregator))
+        return segments
+
+    def round_history(self, aggregator: Address) -> AggregatorHistory:
+        with self._histories_lock:
+            if aggregator not in self._histories:
+                self._histories[aggregator] = AggregatorHistory(aggregator)
+            return self._histories[aggregator]
+
+    def _in_history(self, asset: Address, block: Block) -> bool:
+        if asset not in self._indexed_assets or not is_finalized(block):
+            return False
+        for _, aggregator in self.aggregator_segments(asset):
+            if aggregator is not None and (self.round_history(aggregator).last_block or -1) < block:
+                return False
+        return True
+    
     @lru_cache(maxsize=None)
     def feed_decimals(self, asset: AnyAddressType) -> int:
         asset = convert.to_address(asset)
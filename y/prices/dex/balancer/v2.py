@@ -14,6 +14,7 @@ from y.datatypes import UsdPrice, UsdValue
 from y.decorators import log
 from y.networks import Network
 from y.typing import Address, AnyAddressType, Block
+from y.utils.cache import block_cache
 from y.utils.events import decode_logs, get_logs_asap
 from y.utils.multicall import fetch_multicall
 from y.utils.raw_calls import raw_call
@@ -53,7 +54,7 @@ class BalancerV2Vault(ContractBase):
         return self.contract.getPoolTokens(pool_id, block_identifier = block)
 
     @log(logger)
-    @lru_cache(maxsize=10)
+    @block_cache
     def list_pools(self, block: Optional[Block] = None) -> Dict[HexBytes,EthAddress]:
         topics = ['0x3c13bc30b8e878c53fd2a36b679409c073afd75950be43d8858768e956fbc20e']
         try:
@@ -64,16 +65,17 @@ class BalancerV2Vault(ContractBase):
             raise
         return {event['poolId'].hex():event['poolAddress'] for event in events}
     
-    @lru_cache(maxsize=10)
+    @block_cache
     def get_pool_info(self, poolids: Tuple[HexBytes,...], block: Optional[Block] = None) -> List[Tuple]:
         return fetch_multicall(*[[self.contract,'getPoolTokens',poolId] for poolId in poolids], block=block)
 
     @log(logger)
     def deepest_pool_for(self, token_address: Address, block: Optional[Block] = None) -> Tuple[Optional[EthAddress],int]:
         pools = self.list_pools(block=block)
-        poolids = (poolid for poolid, pool in pools.items() if _is_standard_pool(pool))
+        # a tuple, so `get_pool_info` can key its cache on the pool ids
+        poolids = tuple(poolid for poolid, pool in pools.items() if _is_standard_pool(pool))
         pools_info = self.get_pool_info(poolids, block=block)
-        pools_info = {self.list_pools(block=block)[poolid]: info for poolid, info in zip(poolids, pools_info) if str(info) != "((), (), 0)"}
+        pools_info = {pools[poolid]: info for poolid, info in zip(poolids, pools_info) if str(info) != "((), (), 0)"}
         
         deepest_pool = {'pool': None, 'balance': 0}
         for pool, info in pools_info.items():
@@ -1,8 +1,7 @@
 import logging
-from typing import Dict, Optional
+from typing import Dict, List, Optional
 
 from brownie import chain
-from cachetools.func import ttl_cache
 from y import convert
 from y.datatypes import UsdPrice
 from y.decorators import log
@@ -13,6 +12,7 @@ from y.prices.dex.uniswap.v2 import (NotAUniswapV2Pool, UniswapPoolV2,
                                      UniswapRouterV2)
 from y.prices.dex.uniswap.v2_forks import UNISWAPS
 from y.typing import Address, AnyAddressType, Block
+from y.utils.cache import block_cache
 from y.utils.logging import gh_issue_request
 from y.utils.multicall import multicall_same_func_no_input
 
@@ -50,13 +50,13 @@ class UniswapMultiplexer:
         return self.v1.get_price(token_address, block)
     
     @log(logger)
-    @ttl_cache(ttl=600)
+    @block_cache
     def lp_price(self, token_address: AnyAddressType, block: Optional[Block] = None) -> UsdPrice:
         """ Get Uniswap/Sushiswap LP token price. """
         return UniswapPoolV2(token_address).get_price(block=block)
     
     @log(logger)
-    @ttl_cache(ttl=36000)
+    @block_cache
     def get_price(self, token_in: AnyAddressType, block: Optional[Block] = None, protocol: Optional[str] = None) -> Optional[UsdPrice]:
         """
         Calculate a price based on Uniswap Router quote for selling one `token_in`.
@@ -80,6 +80,19 @@ class UniswapMultiplexer:
         return None
     
 
+    @log(logger)
+    def get_price_series(self, token_in: AnyAddressType, blocks: List[Block]) -> List[Optional[UsdPrice]]:
+        """
+        Calculate prices for `token_in` at each block in `blocks` using the deepest router at the latest block.
+        Blocks without a quote return `None`.
+        """
+        token_in = convert.to_address(token_in)
+        router = self.deepest_router(token_in, block=max(blocks))
+        if router is None:
+            return [None for _ in blocks]
+        return router.get_price_series(token_in, blocks)
+    
+
     @log(logger)
     def deepest_router(self, token_in: AnyAddressType, block: Optional[Block] = None) -> Optional[UniswapRouterV2]:
         token_in = convert.to_address(token_in)
@@ -1,40 +1,46 @@
 
 import logging
-from collections import defaultdict
-from functools import cached_property, lru_cache
-from typing import Any, Dict, List, Optional, Tuple
+import threading
+from functools import cached_property
+from typing import (Any, Dict, Iterable, Iterator, List, Mapping, Optional,
+                    Set, Tuple)
 
-import brownie
 from brownie import chain
 from brownie.exceptions import EventLookupError, VirtualMachineError
-from cachetools.func import ttl_cache
+from hexbytes import HexBytes
 from multicall import Call, Multicall
 from y import convert
 from y.classes.common import ERC20, ContractBase, WeiBalance
 from y.constants import STABLECOINS, WRAPPED_GAS_COIN, sushi, usdc, weth
-from y.contracts import Contract
+from y.contracts import Contract, contract_creation_blocks
 from y.datatypes import UsdPrice
 from y.decorators import continue_on_revert, log
 from y.exceptions import (CantFindSwapPath, ContractNotVerified,
                           MessedUpBrownieContract, NonStandardERC20,
                           NotAUniswapV2Pool, call_reverted)
-from y.interfaces.uniswap.factoryv2 import UNIV2_FACTORY_ABI
+from y.interfaces.uniswap.routerv2 import UNIV2_ROUTER_ABI
 from y.networks import Network
 from y.prices import magic
-from y.prices.dex.uniswap.v2_forks import (ROUTER_TO_FACTORY,
-                                           ROUTER_TO_PROTOCOL, special_paths)
+from y.prices.dex.uniswap.v2_forks import (ROUTER_TO_FACTORY, ROUTER_TO_FEE,
+                                           ROUTER_TO_PROTOCOL, STANDARD_FEE,
+                                           special_paths)
 from y.typing import Address, AddressOrContract, AnyAddressType, Block
-from y.utils.events import decode_logs, get_logs_asap
+from y.utils.cache import block_cache
+from y.utils.events import get_logs_asap_generator
 from y.utils.multicall import (
-    fetch_multicall, multicall_same_func_no_input,
+    fetch_multicall, fetch_multicall_series, multicall_same_func_no_input,
     multicall_same_func_same_contract_different_inputs)
 from y.utils.raw_calls import raw_call
+from y.utils.store import last_finalized_block, pool_store, reserve_store
 
 logger = logging.getLogger(__name__)
 logger.addHandler(logging.StreamHandler())
 logger.setLevel(logging.INFO)
 
 Path = List[AddressOrContract]
+
+# the number of pools we write to the pool store at a time while indexing
+_POOL_INSERT_BATCH_SIZE = 10_000
 Reserves = Tuple[int,int,int]
 
 
@@ -90,7 +96,8 @@ class UniswapPoolV2(ERC20):
     
     @log(logger)
     def reserves(self, block: Optional[Block] = None) -> Tuple[WeiBalance, WeiBalance]:
-        reserves = Call(self.address, ['getReserves()((uint112,uint112,uint32))'], block_id=block)()
+        tracked = None if block is None else reserve_tracker.get_reserves([self.address], block)
+        reserves = tracked[0] if tracked else Call(self.address, ['getReserves()((uint112,uint112,uint32))'], block_id=block)()
         return (WeiBalance(reserve, token, block=block) for reserve, token in zip(reserves, self.tokens))
 
     @log(logger)
@@ -134,24 +141,242 @@ class UniswapPoolV2(ERC20):
         return token0, token1, supply, reserves
 
 
+class UniswapV2PoolIndex(Mapping):
+    """
+    `{pool: {'token0': token0, 'token1': token1}}` for every pool deployed by `factory`.
+    
+    The index is persisted in the `pool_store` along with the last block we've fetched `PairCreated` events through,
+    so after the first run we only need to fetch events for new blocks. Pools are read from disk as needed.
+    """
+    def __init__(self, factory: Address, label: str) -> None:
+        self.factory = factory
+        self.label = label
+        # pools created in blocks that aren't final yet are kept in memory only, in case of a reorg
+        self._recent: Dict[Address,Tuple[int,Address,Address]] = {}
+        self._lock = threading.Lock()
+        self.refresh()
+    
+    def __repr__(self) -> str:
+        return f"<UniswapV2PoolIndex {self.label} '{self.factory}'>"
+
+    def __getitem__(self, pool: Address) -> Dict[str,Address]:
+        if pool in self._recent:
+            _, token0, token1 = self._recent[pool]
+        else:
+            tokens = pool_store.get_pool(self.factory, pool)
+            if tokens is None:
+                raise KeyError(pool)
+            token0, token1 = tokens
+        return {'token0': token0, 'token1': token1}
+    
+    def __iter__(self) -> Iterator[Address]:
+        yield from pool_store.get_pools(self.factory)
+        yield from list(self._recent)
+    
+    def __len__(self) -> int:
+        return pool_store.count_pools(self.factory) + len(self._recent)
+    
+    def pools_for_token(self, token_address: Address) -> Dict[Address,Address]:
+        pools = pool_store.get_pools_for_token(self.factory, token_address)
+        for pool, (_, token0, token1) in list(self._recent.items()):
+            if token_address == token0:
+                pools[pool] = token1
+            elif token_address == token1:
+                pools[pool] = token0
+        return pools
+
+    @log(logger)
+    def refresh(self) -> None:
+        with self._lock:
+            last_block = pool_store.get_last_block(self.factory)
+            finalized_block = last_finalized_block()
+
+            if last_block is None:
+                logger.info(f'Fetching pools for {self.label} on {Network.printable()}. If this is your first time using ypricemagic, this can take a while. Please wait patiently...')
+                from_block = None
+            else:
+                from_block = last_block + 1
+            
+            if from_block is None or from_block <= finalized_block:
+                PairCreated = ['0x0d3648bd0f6ba80134a33ba9275ac585d9d315f0ad8355cddefde31afa28d0e9']
+                events = get_logs_asap_generator(self.factory, PairCreated, from_block=from_block, to_block=finalized_block, decode=True)
+                pools = []
+                try:
+                    for event in events:
+                        # the event's unnamed arg is `allPairs.length` after the pool was pushed
+                        pools.append((event[''] - 1, convert.to_address(event['pair']), convert.to_address(event['token0']), convert.to_address(event['token1'])))
+                        if len(pools) == _POOL_INSERT_BATCH_SIZE:
+                            pool_store.add_pools(self.factory, pools)
+                            pools = []
+                except EventLookupError:
+                    pass
+                finally:
+                    events.close()
+                pool_store.add_pools(self.factory, pools, last_block=finalized_block)
+            
+            self._fetch_missing_pools(finalized_block)
+
+            # pools we kept in memory are persisted once their `PairCreated` events are final
+            if self._recent:
+                indexed = pool_store.get_indices(self.factory)
+                for pool, (i, _, _) in list(self._recent.items()):
+                    if i in indexed:
+                        del self._recent[pool]
+    
+    def _fetch_missing_pools(self, finalized_block: Block) -> None:
+        """
+        Your node might not be able to look back far enough to see every `PairCreated` event, and pools created
+        since `finalized_block` aren't in the logs we fetched. We can get those from the factory's `allPairs` instead.
+        """
+        all_pairs_len = raw_call(self.factory,'allPairsLength()',output='int')
+        indexed = pool_store.get_indices(self.factory) | {idx for idx, _, _ in self._recent.values()}
+        missing = [i for i in range(all_pairs_len) if i not in indexed]
+        if not missing:
+            return
+
+        logger.debug(f"Oh no! Looks like your node can't look back that far. Checking for the missing {len(missing)} pools...")
+        logger.debug(f'pools: {missing}')
+        pools = multicall_same_func_same_contract_different_inputs(self.factory, 'allPairs(uint256)(address)', inputs=missing)
+        token0s = multicall_same_func_no_input(pools, 'token0()(address)')
+        token1s = multicall_same_func_no_input(pools, 'token1()(address)')
+        pools = [
+            (i, convert.to_address(pool), convert.to_address(token0), convert.to_address(token1))
+            for i, pool, token0, token1 in zip(missing, pools, token0s, token1s)
+        ]
+
+        # only pools that existed at `finalized_block` are safe to persist
+        finalized_len = raw_call(self.factory,'allPairsLength()',block=finalized_block,output='int',return_None_on_failure=True) or 0
+        pool_store.add_pools(self.factory, [pool for pool in pools if pool[0] < finalized_len])
+        self._recent.update({pool: (i, token0, token1) for i, pool, token0, token1 in pools if i >= finalized_len})
+
+
+class UniswapV2PoolMapping(Mapping):
+    """
+    `{token: {pool: paired_with}}` for every token with at least one pool in `index`.
+    """
+    def __init__(self, index: UniswapV2PoolIndex) -> None:
+        self.index = index
+    
+    def __getitem__(self, token_address: Address) -> Dict[Address,Address]:
+        pools = self.index.pools_for_token(token_address)
+        if not pools:
+            raise KeyError(token_address)
+        return pools
+
+    def __iter__(self) -> Iterator[Address]:
+        tokens = set(pool_store.get_tokens(self.index.factory))
+        for _, token0, token1 in list(self.index._recent.values()):
+            tokens.update([token0, token1])
+        return iter(tokens)
+
+    def __len__(self) -> int:
+        return len(set(self))
+
+
+# Sync(uint112 reserve0, uint112 reserve1)
+SYNC = '0x1c411e9a96e071241c2f21f7726b17ae89e3cab4c78be50e062b03a9fffbbad1'
+
+# the number of pools we fetch `Sync` events for with each log filter
+_SYNC_ADDRESS_BATCH_SIZE = 500
+
+
+class UniswapV2ReserveTracker:
+    """
+    Block-ordered reserve history for uniswap v2 style pools, built from their `Sync` events and kept in the `reserve_store`.
+
+    Tracking is opt-in, since a busy pool has millions of `Sync` events. Once a pool is tracked with `track`,
+    its reserves at any block up to the last finalized block we ingested are a local lookup.
+    """
+    def __init__(self) -> None:
+        self._lock = threading.Lock()
+
+    def __repr__(self) -> str:
+        return "<UniswapV2ReserveTracker>"
+
+    @log(logger)
+    def track(self, pools: Iterable[AnyAddressType]) -> None:
+        """ Ingests `Sync` events for `pools` through the last finalized block. """
+        pools = [convert.to_address(pool) for pool in pools]
+        with self._lock:
+            finalized_block = last_finalized_block()
+            last_blocks = reserve_store.get_last_blocks(pools)
+            new = [pool for pool in pools if pool not in last_blocks]
+            for pool, creation_block in zip(new, contract_creation_blocks(new, when_no_history_return_0=True)):
+                last_blocks[pool] = (creation_block or 0) - 1
+
+            # pools that are caught up to about the same block share a log filter
+            behind = sorted((last_block, pool) for pool, last_block in last_blocks.items() if last_block < finalized_block)
+            for i in range(0, len(behind), _SYNC_ADDRESS_BATCH_SIZE):
+                self._ingest(dict((pool, last_block) for last_block, pool in behind[i:i+_SYNC_ADDRESS_BATCH_SIZE]), finalized_block)
+
+    def _ingest(self, last_blocks: Dict[Address, Block], to_block: Block) -> None:
+        pools = list(last_blocks)
+        logs = get_logs_asap_generator(pools, [SYNC], from_block=min(last_blocks.values()) + 1, to_block=to_block, cache=False)
+        reserves = []
+        try:
+            for log in logs:
+                pool, block = convert.to_address(log['address']), log['blockNumber']
+                # the pool may already be caught up past the start of this filter
+                if block <= last_blocks[pool]:
+                    continue
+                data = HexBytes(log['data'])
+                reserves.append((pool, block, int.from_bytes(data[:32], 'big'), int.from_bytes(data[32:64], 'big')))
+                if len(reserves) == _POOL_INSERT_BATCH_SIZE:
+                    reserve_store.add_reserves(reserves)
+                    reserves = []
+        finally:
+            logs.close()
+        reserve_store.add_reserves(reserves, pools=pools, last_block=to_block)
+
+    def get_reserves(self, pools: Iterable[AnyAddressType], block: Block) -> Optional[List[Tuple[int, int]]]:
+        '''
+        Returns `(reserve0, reserve1)` at `block` for each of `pools`,
+        or None if any of them isn't tracked through `block`, so the caller should ask the chain instead.
+        '''
+        pools = [convert.to_address(pool) for pool in pools]
+        last_blocks = reserve_store.get_last_blocks(pools)
+        if any(last_blocks.get(pool, -1) < block for pool in pools):
+            return None
+        return [reserve_store.get_reserves(pool, block) for pool in pools]
+
+
+reserve_tracker = UniswapV2ReserveTracker()
+
+
+def get_amount_out(amount_in: int, reserve_in: int, reserve_out: int, fee: Tuple[int,int] = STANDARD_FEE) -> Optional[int]:
+    """
+    `UniswapV2Library.getAmountOut` with the fork's `fee`. Returns None where the library would revert.
+    """
+    if amount_in <= 0 or reserve_in <= 0 or reserve_out <= 0:
+        return None
+    numerator, denominator = fee
+    amount_in_with_fee = amount_in * numerator
+    return amount_in_with_fee * reserve_out // (reserve_in * denominator + amount_in_with_fee)
+
+
+def _hops(path: Path) -> List[Tuple[Address,Address]]:
+    path = [convert.to_address(str(token)) for token in path]
+    return list(zip(path, path[1:]))
+
+
 class UniswapRouterV2(ContractBase):
+    # we only need the quoting methods, which every fork shares
+    static_abi = ('UniswapV2Router [static]', UNIV2_ROUTER_ABI)
+
     def __init__(self, router_address: AnyAddressType, *args: Any, **kwargs: Any) -> None:
         super().__init__(router_address, *args, **kwargs)
 
         self.label = ROUTER_TO_PROTOCOL[self.address]
         self.factory = ROUTER_TO_FACTORY[self.address]
         self.special_paths = special_paths(self.address)
-
-        # we need the factory contract object cached in brownie so we can decode logs properly
-        if not ContractBase(self.factory)._is_cached:
-            brownie.Contract.from_abi('UniClone Factory [forced]', self.factory, UNIV2_FACTORY_ABI)
+        self.fee = ROUTER_TO_FEE[self.address]
     
 
     def __repr__(self) -> str:
         return f"<UniswapV2Router {self.label} '{self.address}'>"
 
 
-    @ttl_cache(ttl=36000)
+    @block_cache
     @log(logger)
     def get_price(
         self,
@@ -188,31 +413,116 @@ class UniswapRouterV2(ContractBase):
         
         # If we can't find a good path to stables, we might still be able to determine price from price of paired token
         deepest_pool = self.deepest_pool(token_in, block)
+        paired_path = None
         if path is None and deepest_pool:
             paired_with = self.pool_mapping[token_in][deepest_pool]
-            path = [token_in,paired_with]
-            quote = self.get_quote(amount_in, path, block=block)
-            if quote is not None:
-                amount_out = quote[-1] / ERC20(path[-1]).scale 
-                fees = 0.997 ** (len(path) - 1)
-                amount_out /= fees
-                paired_with_price = magic.get_price(paired_with, block, fail_to_None=True)
-                if paired_with_price:
-                    return amount_out * paired_with_price
-
-        # If we still don't have a workable path, try this smol brain method
+            paired_path = [token_in,paired_with]
+
+        # If we still don't have a workable path, we'll try this smol brain method
+        smol_path = None
         if path is None:
-            path = self.smol_brain_path_selector(token_in, token_out, paired_against)
+            smol_path = self.smol_brain_path_selector(token_in, token_out, paired_against)
+
+        # When we can quote locally, every candidate path costs the same one multicall, so we quote them all at once
+        if self.fee is not None:
+            paired_quote, quote = self.get_quotes(amount_in, [paired_path, path or smol_path], block=block)
+        else:
+            paired_quote, quote = self.get_quotes(amount_in, [paired_path], block=block)[0], None
+
+        if paired_quote is not None:
+            amount_out = paired_quote[-1] / ERC20(paired_path[-1]).scale 
+            fees = self._fees(paired_path)
+            amount_out /= fees
+            paired_with_price = magic.get_price(paired_with, block, fail_to_None=True)
+            if paired_with_price:
+                return amount_out * paired_with_price
+
+        if path is None:
+            path = smol_path
             logger.debug('smol')
         
-        fees = 0.997 ** (len(path) - 1)
+        fees = self._fees(path)
         logger.debug(f'router: {self.label}     path: {path}')
-        quote = self.get_quote(amount_in, path, block=block)
+        if self.fee is None:
+            quote = self.get_quote(amount_in, path, block=block)
         if quote is not None:
             amount_out = quote[-1] / ERC20(path[-1]).scale
             return UsdPrice(amount_out / fees)
 
 
+    @log(logger)
+    def get_price_series(
+        self,
+        token_in: Address,
+        blocks: List[Block],
+        token_out: Address = usdc.address,
+        paired_against: Address = WRAPPED_GAS_COIN
+        ) -> List[Optional[UsdPrice]]:
+        """
+        Calculate prices for `token_in` at each block in `blocks`.
+        The swap path is resolved once, at the latest block in `blocks`, and the `getAmountsOut` quotes
+        for every block are batched together. Blocks where the quote fails return `None`.
+        NOTE: Unlike `get_price`, this does not fall back to the price of the paired token.
+        """
+        token_in, token_out = str(token_in), str(token_out)
+
+        if chain.id == Network.BinanceSmartChain and token_out == usdc.address:
+            busd = Contract("0xe9e7CEA3DedcA5984780Bafc599bD69ADd087D56")
+            token_out = busd.address
+
+        if str(token_in) in STABLECOINS:
+            return [1 for _ in blocks]
+
+        try:
+            amount_in = ERC20(token_in).scale
+        except NonStandardERC20:
+            return [None for _ in blocks]
+
+        path = None
+        if str(token_out) in STABLECOINS:
+            try: path = self.get_path_to_stables(token_in, max(blocks))
+            except CantFindSwapPath: pass
+
+        if path is None:
+            path = self.smol_brain_path_selector(token_in, token_out, paired_against)
+
+        if self._is_cached:
+            results = fetch_multicall_series([self.contract, 'getAmountsOut', amount_in, path], blocks=blocks)
+            quotes = [result[0] for result in results]
+        else:
+            quotes = [self.get_quote(amount_in, path, block=block) for block in blocks]
+
+        fees = self._fees(path)
+        scale = ERC20(path[-1]).scale
+        return [None if quote is None else UsdPrice(quote[-1] / scale / fees) for quote in quotes]
+
+
+    @log(logger)
+    def path_pools(self, token_in: AnyAddressType, block: Optional[Block] = None) -> Tuple[Set[Address], Set[Address]]:
+        """
+        Returns `(pools, paired_with)`: the pools on each path `get_price` may quote `token_in` thru,
+        and the tokens whose prices `get_price` may multiply a quote by.
+        """
+        token_in, token_out = convert.to_address(token_in), usdc.address
+        if chain.id == Network.BinanceSmartChain:
+            token_out = Contract("0xe9e7CEA3DedcA5984780Bafc599bD69ADd087D56").address
+
+        paths, paired = [], set()
+        try:
+            paths.append(self.get_path_to_stables(token_in, block))
+        except CantFindSwapPath:
+            deepest_pool = self.deepest_pool(token_in, block)
+            if deepest_pool:
+                paired_with = self.pool_mapping[token_in][deepest_pool]
+                paths.append([token_in, paired_with])
+                paired.add(paired_with)
+            paths.append(self.smol_brain_path_selector(token_in, token_out, WRAPPED_GAS_COIN))
+
+        pools = {self._pool_for(*hop) for path in paths for hop in _hops(path)}
+        pools.discard(None)
+        return pools, paired
+
+
     @continue_on_revert
     @log(logger)
     def get_quote(self, amount_in: int, path: Path, block: Optional[Block] = None) -> Tuple[int,int]:
@@ -237,6 +547,66 @@ class UniswapRouterV2(ContractBase):
         else: return Call(self.address,['getAmountsOut(uint,address[])(uint[])',amount_in,path],[['amounts',None]],block_id=block)()['amounts']
 
 
+    @log(logger)
+    def get_quotes(self, amount_in: int, paths: List[Optional[Path]], block: Optional[Block] = None) -> List[Optional[List[int]]]:
+        """
+        Returns `[self.get_quote(amount_in, path, block) for path in paths]`, with None for any path that's None.
+
+        For forks with a flat fee, we compute the quotes ourselves from the reserves of every pool on every path,
+        fetched in one multicall or read from the `reserve_tracker`. We only ask the router for forks with other math
+        and for paths with a hop we don't have a pool for.
+        """
+        hops, reserves = {}, {}
+        if self.fee is not None:
+            for path in filter(None, paths):
+                for hop in _hops(path):
+                    if hop not in hops:
+                        hops[hop] = self._pool_for(*hop)
+            pools = sorted({pool for pool in hops.values() if pool})
+            if pools:
+                reserves = dict(zip(pools, self._get_reserves(pools, block, return_None_on_failure=True)))
+
+        quotes = []
+        for path in paths:
+            if path is None:
+                quotes.append(None)
+            elif self.fee is not None and all(hops[hop] for hop in _hops(path)):
+                quotes.append(self._quote_locally(amount_in, path, hops, reserves))
+            else:
+                quotes.append(self.get_quote(amount_in, path, block=block))
+        return quotes
+
+
+    def _quote_locally(self, amount_in: int, path: Path, hops: Dict[Tuple[Address,Address],Address], reserves: Dict[Address,Optional[Reserves]]) -> Optional[List[int]]:
+        amounts = [amount_in]
+        for token_in, token_out in _hops(path):
+            pool = hops[token_in, token_out]
+            if reserves[pool] is None:
+                return None
+            reserve0, reserve1 = reserves[pool][:2]
+            if token_in == self.pools[pool]['token0']:
+                amount_out = get_amount_out(amounts[-1], reserve0, reserve1, self.fee)
+            else:
+                amount_out = get_amount_out(amounts[-1], reserve1, reserve0, self.fee)
+            if amount_out is None:
+                return None
+            amounts.append(amount_out)
+        return amounts
+
+
+    def _fees(self, path: Path) -> float:
+        """ The share of `amount_in` left after each hop on `path` takes its fee. The router quotes already had them taken. """
+        numerator, denominator = self.fee or STANDARD_FEE
+        return (numerator / denominator) ** (len(path) - 1)
+
+
+    def _pool_for(self, token_in: Address, token_out: Address) -> Optional[Address]:
+        for pool, paired_with in self.pools_for_token(token_in).items():
+            if paired_with == token_out:
+                return pool
+        return None
+
+
     @log(logger)
     def smol_brain_path_selector(self, token_in: AddressOrContract, token_out: AddressOrContract, paired_against: AddressOrContract) -> Path:
         '''Chooses swap path to use for quote'''
@@ -260,68 +630,47 @@ class UniswapRouterV2(ContractBase):
     
 
     @cached_property
-    def pools(self) -> Dict[Address,Dict[Address,Address]]:
-        logger.info(f'Fetching pools for {self.label} on {Network.printable()}. If this is your first time using ypricemagic, this can take a while. Please wait patiently...')
-        PairCreated = ['0x0d3648bd0f6ba80134a33ba9275ac585d9d315f0ad8355cddefde31afa28d0e9']
-        events = decode_logs(get_logs_asap(self.factory, PairCreated))
-        try:
-            pairs = {
-                event['']: {
-                    convert.to_address(event['pair']): {
-                        'token0':convert.to_address(event['token0']),
-                        'token1':convert.to_address(event['token1']),
-                    }
-                }
-                for event in events
-            }
-            pools = {pool: tokens for i, pair in pairs.items() for pool, tokens in pair.items()}
-        except EventLookupError:
-            pairs, pools = {}, {}
-        del events
-        
-        all_pairs_len = raw_call(self.factory,'allPairsLength()',output='int')
-        if len(pairs) < all_pairs_len:
-            logger.debug(f"Oh no! Looks like your node can't look back that far. Checking for the missing {all_pairs_len - len(pairs)} pools...")
-            pools_your_node_couldnt_get = [i for i in range(all_pairs_len) if i not in pairs]
-            logger.debug(f'pools: {pools_your_node_couldnt_get}')
-            pools_your_node_couldnt_get = multicall_same_func_same_contract_different_inputs(
-                self.factory, 'allPairs(uint256)(address)', inputs=[i for i in pools_your_node_couldnt_get])
-            calls = [Call(pool, ['token0()(address)'], [[pool,None]]) for pool in pools_your_node_couldnt_get]
-            token0s = Multicall(calls)().values()
-            calls = [Call(pool, ['token1()(address)'], [[pool,None]]) for pool in pools_your_node_couldnt_get]
-            token1s = Multicall(calls)().values()
-            pools_your_node_couldnt_get = {
-                convert.to_address(pool): {
-                    'token0':convert.to_address(token0),
-                    'token1':convert.to_address(token1),
-                }
-                for pool, token0, token1
-                in zip(pools_your_node_couldnt_get,token0s,token1s)
-            }
-            pools.update(pools_your_node_couldnt_get)
-
-        return pools
+    def pools(self) -> "UniswapV2PoolIndex":
+        return UniswapV2PoolIndex(self.factory, self.label)
 
 
     @cached_property
-    def pool_mapping(self) -> Dict[Address,Dict[Address,Address]]:
-        pool_mapping = defaultdict(dict)
-        for pool, tokens in self.pools.items():
-            token0, token1 = tokens.values()
-            pool_mapping[token0][pool] = token1
-            pool_mapping[token1][pool] = token0
+    def pool_mapping(self) -> "UniswapV2PoolMapping":
+        pool_mapping = UniswapV2PoolMapping(self.pools)
         logger.info(f'Loaded {len(self.pools)} pools supporting {len(pool_mapping)} tokens on {self.label}')
         return pool_mapping
 
 
+    @log(logger)
+    def refresh_pools(self) -> None:
+        """ Index any pools created since we last checked. """
+        self.pools.refresh()
+
+
     def pools_for_token(self, token_address: Address) -> Dict[Address,Address]:
-        try: 
-            return self.pool_mapping[token_address]
-        except KeyError:
-            return {}
+        return self.pools.pools_for_token(token_address)
+
+
+    @log(logger)
+    def track_reserves(self, token_address: Optional[AnyAddressType] = None) -> None:
+        """
+        Ingests `Sync` events for every pool with `token_address`, or every pool we've indexed if you don't pass one.
+        Afterwards, `deepest_pool` and pool reserves at finalized blocks are local lookups.
+        """
+        pools = self.pools if token_address is None else self.pools_for_token(convert.to_address(token_address))
+        reserve_tracker.track(pools)
+
+
+    def _get_reserves(self, pools: Iterable[Address], block: Optional[Block], return_None_on_failure: bool = False) -> List[Optional[Reserves]]:
+        pools = list(pools)
+        if block is not None:
+            tracked = reserve_tracker.get_reserves(pools, block)
+            if tracked is not None:
+                return tracked
+        return multicall_same_func_no_input(pools, 'getReserves()((uint112,uint112,uint32))', block=block, return_None_on_failure=return_None_on_failure)
 
     @log(logger)
-    @lru_cache(maxsize=500)
+    @block_cache
     def deepest_pool(self, token_address: AnyAddressType, block: Optional[Block] = None, _ignore_pools: Tuple[Address,...] = ()) -> Address:
         token_address = convert.to_address(token_address)
         if token_address == WRAPPED_GAS_COIN or token_address in STABLECOINS:
@@ -329,7 +678,7 @@ class UniswapRouterV2(ContractBase):
         pools = self.pools_for_token(token_address)
 
         try:
-            reserves = multicall_same_func_no_input(pools, 'getReserves()((uint112,uint112,uint32))', block=block, return_None_on_failure=True)
+            reserves = self._get_reserves(pools, block, return_None_on_failure=True)
         except Exception as e:
             if call_reverted(e):
                 return None
@@ -351,11 +700,11 @@ class UniswapRouterV2(ContractBase):
 
 
     @log(logger)
-    @lru_cache(maxsize=500)
+    @block_cache
     def deepest_stable_pool(self, token_address: AnyAddressType, block: Optional[Block] = None) -> Dict[str, str]:
         token_address = convert.to_address(token_address)
         pools = {pool: paired_with for pool, paired_with in self.pools_for_token(token_address).items() if paired_with in STABLECOINS}
-        reserves = multicall_same_func_no_input(pools.keys(), 'getReserves()((uint112,uint112,uint32))', block=block)
+        reserves = self._get_reserves(pools, block)
 
         deepest_stable_pool = None
         deepest_stable_pool_balance = 0
@@ -373,7 +722,7 @@ class UniswapRouterV2(ContractBase):
 
 
     @log(logger)
-    @lru_cache(maxsize=500)
+    @block_cache
     def get_path_to_stables(self, token: AnyAddressType, block: Optional[Block] = None, _loop_count: int = 0, _ignore_pools: Tuple[Address,...] = ()) -> Path:
         if _loop_count > 10:
             raise CantFindSwapPath
@@ -103,6 +103,38 @@ FACTORY_TO_PROTOCOL = {UNISWAPS[name]['factory']: name for name in UNISWAPS}
 
 ROUTER_TO_PROTOCOL = {UNISWAPS[name]['router']: name for name in UNISWAPS}
 
+# the standard uniswap v2 swap fee, as `(numerator, denominator)` of the amount in that's swapped
+STANDARD_FEE = (997, 1000)
+
+# forks that charge something other than the standard fee.
+# None means the fork's math isn't a flat fee, eg fees that vary by pair, so we need to ask the router for quotes.
+FEES = {
+    Network.BinanceSmartChain: {
+        "pancakeswapv2":    (9975, 10000),
+        "pancakeswapv1":    (998, 1000),
+        "wault":            (998, 1000),
+        "apeswap":          (998, 1000),
+        "mdex":             None,
+        "jetswap":          (999, 1000),
+        "biswap":           None,
+    },
+    Network.Polygon: {
+        "wault":            (998, 1000),
+        "apeswap":          (998, 1000),
+        "jetswap":          (999, 1000),
+        "firebird":         None,
+    },
+    Network.Fantom: {
+        "spookyswap":       (998, 1000),
+        "jetswap":          (999, 1000),
+    },
+    Network.Arbitrum: {
+        "dxswap":           None,
+    },
+}.get(chain.id, {})
+
+ROUTER_TO_FEE = {UNISWAPS[name]['router']: FEES.get(name, STANDARD_FEE) for name in UNISWAPS}
+
 SPECIAL_PATHS = {
     Network.Mainnet: {
         "sushiswap": {
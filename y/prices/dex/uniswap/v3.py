@@ -1,9 +1,14 @@
+import logging
 import math
+import threading
+from functools import cached_property
 from itertools import cycle
-from typing import Optional
+from typing import Any, Dict, List, Optional, Set, Tuple
 
 from brownie import chain
+from brownie.exceptions import EventLookupError
 from eth_abi.packed import encode_abi_packed
+from multicall import Call
 from y.classes.common import ERC20
 from y.classes.singleton import Singleton
 from y.constants import usdc, weth
@@ -11,8 +16,15 @@ from y.contracts import Contract, contract_creation_block
 from y.datatypes import UsdPrice
 from y.exceptions import UnsupportedNetwork
 from y.networks import Network
-from y.typing import Address, Block
-from y.utils.multicall import fetch_multicall
+from y import convert
+from y.decorators import log
+from y.typing import Address, AnyAddressType, Block
+from y.utils.events import get_logs_asap_generator
+from y.utils.multicall import (aggregate, fetch_multicall,
+                               fetch_multicall_series, multicall_decimals)
+from y.utils.store import last_finalized_block, v3_pool_store
+
+logger = logging.getLogger(__name__)
 
 # https://github.com/Uniswap/uniswap-v3-periphery/blob/main/deploys.md
 UNISWAP_V3_FACTORY = '0x1F98431c8aD98523631AE4a59f267346ea31F984'
@@ -34,6 +46,69 @@ addresses = {
 
 FEE_DENOMINATOR = 1_000_000
 
+# the number of pools we write to the pool store at a time while indexing
+_POOL_INSERT_BATCH_SIZE = 10_000
+
+
+class UniswapV3PoolIndex:
+    """
+    Every pool deployed by a uniswap v3 factory, indexed from its `PoolCreated` events into the `v3_pool_store`.
+    Like the v2 index, we only fetch events since the last finalized block we indexed.
+    """
+    def __init__(self, factory: Contract) -> None:
+        self.factory = factory
+        self._lock = threading.Lock()
+        self.refresh()
+
+    def __repr__(self) -> str:
+        return f"<UniswapV3PoolIndex factory={self.factory.address} pools={len(self)}>"
+
+    def __len__(self) -> int:
+        return v3_pool_store.count_pools(self.factory.address)
+
+    @property
+    def last_block(self) -> Optional[Block]:
+        """ The last block we've indexed `PoolCreated` events thru, or None if we haven't indexed any. """
+        return v3_pool_store.get_last_block(self.factory.address)
+
+    def covers(self, block: Block) -> bool:
+        """ True if every pool that exists at `block` is indexed. Refreshes the index first if it's behind a finalized `block`. """
+        if block > last_finalized_block():
+            return False
+        if self.last_block is None or self.last_block < block:
+            self.refresh()
+        return self.last_block is not None and self.last_block >= block
+
+    def pools_for_token(self, token_address: AnyAddressType) -> Dict[Address, Tuple[Address, int]]:
+        """ Returns `{pool: (paired_with, fee)}` for each pool with `token_address`. """
+        return v3_pool_store.get_pools_for_token(self.factory.address, convert.to_address(token_address))
+
+    @log(logger)
+    def refresh(self) -> None:
+        with self._lock:
+            last_block = v3_pool_store.get_last_block(self.factory.address)
+            finalized_block = last_finalized_block()
+            from_block = None if last_block is None else last_block + 1
+            if from_block is not None and from_block > finalized_block:
+                return
+
+            events = get_logs_asap_generator(
+                self.factory.address, [self.factory.topics['PoolCreated']], from_block=from_block, to_block=finalized_block, decode=True
+            )
+            pools = []
+            try:
+                for event in events:
+                    pools.append((convert.to_address(event['pool']), convert.to_address(event['token0']), convert.to_address(event['token1']), event['fee']))
+                    if len(pools) == _POOL_INSERT_BATCH_SIZE:
+                        v3_pool_store.add_pools(self.factory.address, pools)
+                        pools = []
+            except EventLookupError:
+                pass
+            finally:
+                events.close()
+            v3_pool_store.add_pools(self.factory.address, pools, last_block=finalized_block)
+            logger.info(f'Loaded {len(self)} uniswap v3 pools')
+
 
 class UniswapV3(metaclass=Singleton):
     def __init__(self) -> None:
@@ -48,6 +123,10 @@ class UniswapV3(metaclass=Singleton):
     def __contains__(self, asset) -> bool:
         return chain.id in addresses
 
+    @cached_property
+    def pools(self) -> UniswapV3PoolIndex:
+        return UniswapV3PoolIndex(self.factory)
+
     def encode_path(self, path) -> bytes:
         types = [type for _, type in zip(path, cycle(['address', 'uint24']))]
         return encode_abi_packed(types, path)
@@ -60,22 +139,91 @@ class UniswapV3(metaclass=Singleton):
         if block and block < contract_creation_block(UNISWAP_V3_QUOTER):
             return None
 
+        paths = self._get_paths(token, block)
+        if not paths:
+            return None
+        results = fetch_multicall(*self._get_quote_calls(token, paths), block=block)
+        return self._best_output(results, paths)
+
+    @log(logger)
+    def get_prices(self, tokens: List[AnyAddressType], block: Optional[Block] = None, spot: bool = False) -> List[Optional[UsdPrice]]:
+        """
+        Returns `[self.get_price(token, block) for token in tokens]`, but quotes every token's paths in one multicall.
+
+        With `spot=True`, we skip the quoter and price each path from its pools' `slot0` instead, taking the path
+        whose first pool has the most liquidity. That's far cheaper for the node but ignores price impact and fees.
+        """
+        tokens = [convert.to_address(token) for token in tokens]
+        if block and block < contract_creation_block(UNISWAP_V3_QUOTER):
+            return [None for _ in tokens]
+
+        paths = {token: self._get_paths(token, block) for token in tokens}
+        if spot:
+            return self._spot_prices(tokens, paths, block)
+
+        scales = {token: 10 ** decimals for token, decimals in zip(tokens, multicall_decimals(tokens, block=block, return_None_on_failure=True)) if decimals is not None}
+        calls = [call for token in tokens if token in scales for call in self._get_quote_calls(token, paths[token], scales[token])]
+        results = iter(fetch_multicall(*calls, block=block) if calls else [])
+        return [
+            self._best_output([next(results) for _ in paths[token]], paths[token]) if token in scales else None
+            for token in tokens
+        ]
+
+    def get_price_series(self, token: Address, blocks: List[Block]) -> List[Optional[UsdPrice]]:
+        """
+        Returns `[self.get_price(token, block) for block in blocks]`, but builds the quote paths once and
+        batches the quoter multicalls for every block into JSON-RPC batches.
+        """
+        deploy_block = contract_creation_block(UNISWAP_V3_QUOTER)
+        live_blocks = [block for block in blocks if block >= deploy_block]
+        prices = dict.fromkeys(blocks)
+        paths = self._get_paths(token, max(live_blocks)) if live_blocks else []
+        if paths:
+            calls = self._get_quote_calls(token, paths)
+            for block, results in zip(live_blocks, fetch_multicall_series(*calls, blocks=live_blocks)):
+                prices[block] = self._best_output(results, paths)
+        return [prices[block] for block in blocks]
+
+    def _get_paths(self, token: Address, block: Optional[Block] = None) -> List[list]:
+        """
+        Returns the paths to quote for `token` at `block`. We skip fee tiers that have no pool, but only when the pool index
+        covers `block`. At the latest block a pool may be newer than the index, so we quote every fee tier.
+        Some pools may not exist yet at older blocks. Those quotes just fail.
+        """
+        prune = block is not None and self.pools.covers(block) and len(self.pools) > 0
         paths = []
         if token != weth:
+            weth_pools = self._pools_between(token, weth.address)
             paths += [
-                [token, fee, weth.address, self.fee_tiers[0], usdc.address] for fee in self.fee_tiers
+                [token, fee, weth.address, self.fee_tiers[0], usdc.address] for fee in self.fee_tiers if not prune or fee in weth_pools
             ]
 
-        paths += [[token, fee, usdc.address] for fee in self.fee_tiers]
+        usdc_pools = self._pools_between(token, usdc.address)
+        paths += [[token, fee, usdc.address] for fee in self.fee_tiers if not prune or fee in usdc_pools]
+        return paths
 
-        results = fetch_multicall(
-            *[
-                [self.quoter, 'quoteExactInput', self.encode_path(path), ERC20(token).scale]
-                for path in paths
-            ],
-            block=block,
-        )
+    def path_pools(self, token: Address) -> Set[Address]:
+        """ Returns the pools on the paths we quote `token` thru. """
+        pools = set()
+        for path in self._get_paths(token):
+            for token_in, fee, token_out in zip(path[::2], path[1::2], path[2::2]):
+                pool = self._pools_between(token_in, token_out).get(fee)
+                if pool:
+                    pools.add(pool)
+        return pools
 
+    def _pools_between(self, token: Address, paired_with: Address) -> Dict[int, Address]:
+        """ Returns `{fee: pool}` for the pools between `token` and `paired_with`. """
+        return {fee: pool for pool, (paired, fee) in self.pools.pools_for_token(token).items() if paired == paired_with}
+    
+    def _get_quote_calls(self, token: Address, paths: List[list], scale: Optional[int] = None) -> List[list]:
+        scale = scale or ERC20(token).scale
+        return [
+            [self.quoter, 'quoteExactInput', self.encode_path(path), scale]
+            for path in paths
+        ]
+
+    def _best_output(self, results: list, paths: List[list]) -> Optional[UsdPrice]:
         outputs = [
             amount / self.undo_fees(path) / 1e6
             for amount, path in zip(results, paths)
@@ -83,6 +231,51 @@ class UniswapV3(metaclass=Singleton):
         ]
         return UsdPrice(max(outputs)) if outputs else None
 
+    def _spot_prices(self, tokens: List[Address], paths: Dict[Address, List[list]], block: Optional[Block]) -> List[Optional[UsdPrice]]:
+        # [(token_in, pool, token_out), ...] for each path
+        hops = {}
+        for token in tokens:
+            for path in paths[token]:
+                hops[tuple(path)] = [
+                    (token_in, self._pools_between(token_in, token_out).get(fee), token_out)
+                    for token_in, fee, token_out in zip(path[::2], path[1::2], path[2::2])
+                ]
+        pools = list({pool for path_hops in hops.values() for _, pool, _ in path_hops if pool})
+        calls = [Call(pool, ['slot0()((uint160,int24,uint16,uint16,uint16,uint8,bool))'], [[('slot0', pool), None]]) for pool in pools]
+        calls += [Call(pool, ['liquidity()(uint128)'], [[('liquidity', pool), None]]) for pool in pools]
+        results = aggregate(calls, block=block, require_success=False) if calls else {}
+
+        hop_tokens = list({token for path_hops in hops.values() for token_in, _, token_out in path_hops for token in (token_in, token_out)})
+        decimals = dict(zip(hop_tokens, multicall_decimals(hop_tokens, block=block, return_None_on_failure=True)))
+
+        prices = []
+        for token in tokens:
+            best_price, best_liquidity = None, -1
+            for path in paths[token]:
+                path_hops = hops[tuple(path)]
+                price = _spot_price(path_hops, results, decimals)
+                liquidity = results.get(('liquidity', path_hops[0][1])) or 0
+                if price and liquidity > best_liquidity:
+                    best_price, best_liquidity = price, liquidity
+            prices.append(None if best_price is None else UsdPrice(best_price))
+        return prices
+
+
+def _spot_price(hops: List[Tuple[Address, Optional[Address], Address]], results: Dict[Any, Any], decimals: Dict[Address, Optional[int]]) -> Optional[float]:
+    """
+    Returns how much of the last token in `hops` one of the first is worth, from each pool's `sqrtPriceX96`.
+    Pools sort their tokens by address, so `token0` is always the lower one.
+    """
+    rate = 1
+    for token_in, pool, token_out in hops:
+        slot0 = results.get(('slot0', pool)) if pool else None
+        if not slot0 or not slot0[0] or decimals.get(token_in) is None or decimals.get(token_out) is None:
+            return None
+        # token1 per token0, in wei
+        price = (slot0[0] / 2 ** 96) ** 2
+        rate *= price if int(token_in, 16) < int(token_out, 16) else 1 / price
+        rate *= 10 ** decimals[token_in] / 10 ** decimals[token_out]
+    return rate
 
 uniswap_v3 = None
 try:
@@ -1,6 +1,6 @@
 import logging
-from functools import cached_property, lru_cache
-from typing import Any, Optional, Set
+from functools import cached_property
+from typing import Any, List, Optional, Set
 
 from brownie import chain, convert
 from multicall import Call
@@ -10,9 +10,12 @@ from y.constants import EEE_ADDRESS
 from y.contracts import has_methods
 from y.datatypes import UsdPrice
 from y.decorators import log
+from y.prices import magic
 from y.networks import Network
 from y.typing import AddressOrContract, AnyAddressType, Block
+from y.utils.cache import block_cache
 from y.utils.logging import gh_issue_request
+from y.utils.multicall import multicall_same_func_no_input
 from y.utils.raw_calls import raw_call
 
 logger = logging.getLogger(__name__)
@@ -74,12 +77,12 @@ class CToken(ERC20):
         return ERC20(underlying)
     
     @log(logger)
-    @lru_cache
+    @block_cache
     def underlying_per_ctoken(self, block: Optional[Block] = None) -> float:
         return self.exchange_rate(block=block) * 10 ** (self.decimals - self.underlying.decimals)
     
     @log(logger)
-    @lru_cache
+    @block_cache
     def exchange_rate(self, block: Optional[Block] = None) -> float:
         method = 'exchangeRateCurrent()(uint)'
         try:
@@ -143,6 +146,23 @@ class Compound(metaclass = Singleton):
     def get_price(self, token_address: AnyAddressType, block: Optional[Block] = None) -> UsdPrice:
         return CToken(token_address).get_price(block=block)
 
+    @log(logger)
+    def get_prices(self, token_addresses: List[AnyAddressType], block: Optional[Block] = None) -> List[Optional[UsdPrice]]:
+        """
+        Returns `[self.get_price(token_address, block) for token_address in token_addresses]`.
+        All exchange rates are fetched in one multicall and the underlyings are priced together.
+        Markets we can't price this way return `None`.
+        """
+        ctokens = [CToken(token_address) for token_address in token_addresses]
+        exchange_rates = multicall_same_func_no_input(ctokens, 'exchangeRateCurrent()(uint)', block=block, return_None_on_failure=True)
+        underlyings = [ctoken.underlying for ctoken in ctokens]
+        underlying_prices = dict(zip(underlyings, magic.get_prices(underlyings, block, fail_to_None=True, silent=True, batch=True)))
+        return [
+            None if exchange_rate is None or not underlying_prices[ctoken.underlying]
+            else UsdPrice(exchange_rate / 1e18 * 10 ** (ctoken.decimals - ctoken.underlying.decimals) * underlying_prices[ctoken.underlying])
+            for ctoken, exchange_rate in zip(ctokens, exchange_rates)
+        ]
+
     @log(logger)
     def __contains__(self, token_address: AddressOrContract) -> bool:
         return self.is_compound_market(token_address)
@@ -1,16 +1,16 @@
+import asyncio
 import logging
-from functools import lru_cache
-from typing import Iterable, List, Optional
+from typing import Iterable, List, Optional, Tuple
 
 from brownie import chain
 from brownie.exceptions import ContractNotFound
 from joblib.parallel import Parallel, delayed
 from tqdm import tqdm
 from y import convert
-from y.constants import WRAPPED_GAS_COIN
+from y.constants import STABLECOINS, WRAPPED_GAS_COIN
 from y.datatypes import UsdPrice
 from y.decorators import log
-from y.exceptions import NonStandardERC20, PriceError
+from y.exceptions import NonStandardERC20, PriceCycleError, PriceError
 from y.networks import Network
 from y.prices import convex, one_to_one, popsicle, yearn
 from y.prices.chainlink import chainlink
@@ -27,10 +27,16 @@ from y.prices.stable_swap import belt, froyo, mstablefeederpool, saddle
 from y.prices.stable_swap.curve import curve
 from y.prices.synthetix import synthetix
 from y.prices.tokenized_fund import basketdao, gelato, piedao, tokensets
+from y.prices.utils import dag, planner
 from y.prices.utils.buckets import check_bucket
+from y.prices.utils.liquidity import liquidity_graph
 from y.prices.utils.sense_check import _sense_check
 from y.typing import AnyAddressType, Block
+from y.utils import metrics
+from y.utils.async_rpc import async_rpc, run_in_executor
+from y.utils.cache import block_cache
 from y.utils.raw_calls import _symbol
+from y.utils.store import price_store
 
 logger = logging.getLogger(__name__)
 
@@ -58,18 +64,34 @@ def get_price(
 
     try:
         return _get_price(token_address, block, fail_to_None=fail_to_None, silent=silent)
-    except (ContractNotFound, NonStandardERC20, RecursionError):
+    except (ContractNotFound, NonStandardERC20, PriceCycleError):
         if fail_to_None:
             return None
         raise PriceError(f'could not fetch price for {_symbol(token_address)} {token_address} on {Network.printable()}')
 
 
+
+def trace_price(
+    token_address: AnyAddressType,
+    block: Optional[Block] = None,
+    fail_to_None: bool = False,
+    silent: bool = False
+    ) -> Tuple[Optional[UsdPrice], metrics.Span]:
+    '''
+    Same as `get_price`, but also returns the call tree of the lookup, with the RPCs each call sent.
+    `print(span.render())` to see it. A price we already had cached shows up as a tree with no RPCs.
+    '''
+    with metrics.trace(f'get_price {token_address} {block or "latest"}') as span:
+        price = get_price(token_address, block, fail_to_None=fail_to_None, silent=silent)
+    return price, span
+
 def get_prices(
     token_addresses: Iterable[AnyAddressType],
     block: Optional[Block] = None,
     fail_to_None: bool = False,
     silent: bool = False,
-    dop: int = 4
+    dop: int = 4,
+    batch: bool = False
     ) -> List[Optional[float]]:
     '''
     In every case:
@@ -79,15 +101,109 @@ def get_prices(
     When `get_prices` is unable to find a price:
     - if `fail_to_None == True`, ypricemagic will return `None` for that token
     - if `fail_to_None == False`, ypricemagic will raise a PriceError and prevent you from receiving prices for your other tokens
+
+    If `batch == True`, ypricemagic will classify all tokens first and price them bucket by bucket,
+    pulling the inputs they share in one multicall per bucket. This makes far fewer requests for large batches.
+    Wrapper tokens are priced after their underlyings, so an underlying many wrappers share is only priced once.
     '''
 
+    if batch:
+        return dag.get_prices(token_addresses, block, fail_to_None=fail_to_None, silent=silent, dop=dop)
+
     return Parallel(dop, 'threading')(
         delayed(get_price)(token_address, block, fail_to_None=fail_to_None, silent=silent)
         for token_address in (token_addresses if silent else tqdm(token_addresses))
     )
 
 
-@lru_cache(maxsize=None)
+async def get_price_async(
+    token_address: AnyAddressType,
+    block: Optional[Block] = None,
+    fail_to_None: bool = False,
+    silent: bool = False
+    ) -> Optional[UsdPrice]:
+    '''
+    Like `get_price`, but can be awaited.
+
+    Stablecoins, prices we already have in the store, and chainlink feeds whose bucket we already know are priced
+    directly on the event loop. Everything else runs the sync `get_price` on one of `EXECUTOR_WORKERS` threads,
+    so at most that many of those lookups are in flight at once, however many tokens you await.
+    '''
+    if block is None:
+        block = await async_rpc.get_block_number()
+    token_address = convert.to_address(token_address)
+
+    price = await _exit_early_async(token_address, block)
+    if price is not None:
+        return price
+    return await run_in_executor(get_price, token_address, block, fail_to_None=fail_to_None, silent=silent)
+
+
+async def get_prices_async(
+    token_addresses: Iterable[AnyAddressType],
+    block: Optional[Block] = None,
+    fail_to_None: bool = False,
+    silent: bool = False
+    ) -> List[Optional[UsdPrice]]:
+    '''
+    Returns `[await get_price_async(token_address, block) for token_address in token_addresses]`, but concurrently.
+    '''
+    if block is None:
+        block = await async_rpc.get_block_number()
+    return await asyncio.gather(*[
+        get_price_async(token_address, block, fail_to_None=fail_to_None, silent=silent)
+        for token_address in token_addresses
+    ])
+
+
+def get_price_series(
+    token_address: AnyAddressType,
+    blocks: Iterable[Block],
+    fail_to_None: bool = False,
+    silent: bool = False
+    ) -> List[Optional[UsdPrice]]:
+    '''
+    Returns `[get_price(token_address, block) for block in blocks]`, but much faster for long block ranges.
+
+    The bucket and swap path for `token_address` are resolved once, and the per-block calls
+    are batched together across blocks. Any block we can't price this way falls back to `get_price`.
+
+    `fail_to_None` and `silent` behave the same as in `get_price`.
+    '''
+    token_address = convert.to_address(token_address)
+    blocks = tuple(int(block) for block in blocks)
+    if not blocks:
+        return []
+    
+    try:
+        return _get_price_series(token_address, blocks, fail_to_None=fail_to_None, silent=silent)
+    except (ContractNotFound, NonStandardERC20, PriceCycleError):
+        if fail_to_None:
+            return [None for _ in blocks]
+        raise PriceError(f'could not fetch price for {_symbol(token_address)} {token_address} on {Network.printable()}')
+
+
+def get_prices_matrix(
+    token_addresses: Iterable[AnyAddressType],
+    blocks: Iterable[Block],
+    fail_to_None: bool = False,
+    silent: bool = False,
+    dop: int = 4
+    ) -> List[List[Optional[UsdPrice]]]:
+    '''
+    Returns `[get_price_series(token_address, blocks) for token_address in token_addresses]`.
+
+    In every case:
+    - if `silent == True`, tqdm will not be used
+    - if `silent == False`, tqdm will be used
+    '''
+    blocks = list(blocks)
+    return Parallel(dop, 'threading')(
+        delayed(get_price_series)(token_address, blocks, fail_to_None=fail_to_None, silent=silent)
+        for token_address in (token_addresses if silent else tqdm(token_addresses))
+    )
+
+
 def _get_price(
     token: AnyAddressType, 
     block: Block, 
@@ -95,6 +211,57 @@ def _get_price(
     silent: bool = False
     ) -> Optional[UsdPrice]:
 
+    # each (token, block) is fetched once no matter how many threads or wrappers ask for it
+    price = dag.resolver.resolve(token, block, _get_price_or_None)
+
+    if price is None:
+        symbol = _symbol(token, return_None_on_failure=True)
+        token_string = f"{symbol} {token}" if symbol else token
+        _fail_appropriately(token_string, fail_to_None=fail_to_None, silent=silent)
+    return price
+
+
+@block_cache
+def _get_price_or_None(token: AnyAddressType, block: Block) -> Optional[UsdPrice]:
+    # prices at finalized blocks never change, so we check the persistent store before doing any work
+    cached, price = price_store.get_price(token, block)
+    if not cached:
+        price = _fetch_price(token, block)
+        price_store.set_price(token, block, price)
+    return price
+
+
+async def _exit_early_async(
+    token: AnyAddressType, 
+    block: Block
+    ) -> Optional[UsdPrice]:
+    '''
+    Returns a price if we can get one without any sync calls, else `None`.
+    '''
+    if token in STABLECOINS:
+        return UsdPrice(1)
+
+    cached, price = price_store.get_price(token, block)
+    if cached and price is not None:
+        return price
+
+    # we only use the bucket if it's already known, classifying a token requires sync calls
+    cached, bucket = price_store.get_bucket(token)
+    if cached and bucket == 'chainlink feed':
+        if 'feeds' not in chainlink.__dict__:
+            await run_in_executor(getattr, chainlink, 'feeds')
+        price = await chainlink.get_price_async(token, block)
+        if price:
+            price_store.set_price(token, block, price)
+            return price
+    return None
+
+
+def _fetch_price(
+    token: AnyAddressType, 
+    block: Block
+    ) -> Optional[UsdPrice]:
+
     symbol = _symbol(token, return_None_on_failure=True)
     token_string = f"{symbol} {token}" if symbol else token
 
@@ -108,23 +275,32 @@ def _get_price(
     if price is not None:
         return price
 
-    if price is None and curve:
-        price = curve.get_price_for_underlying(token, block=block)
+    if curve:
+        with metrics.pricer('curve underlying'):
+            price = curve.get_price_for_underlying(token, block=block)
     
     if price is None and uniswap_v3:
-        price = uniswap_v3.get_price(token, block=block)
+        with metrics.pricer('uniswap v3'):
+            price = uniswap_v3.get_price(token, block=block)
 
     if price is None:
-        price = uniswap_multiplexer.get_price(token, block=block)
+        with metrics.pricer('uniswap multiplexer'):
+            price = uniswap_multiplexer.get_price(token, block=block)
 
     # If price is 0, we can at least try to see if balancer gives us a price. If not, its probably a shitcoin.
     if price is None or price == 0:
-        new_price = balancer_multiplexer.get_price(token, block=block)
+        with metrics.pricer('balancer'):
+            new_price = balancer_multiplexer.get_price(token, block=block)
+        if new_price:
+            price = new_price
+
+    # each protocol pricer above knows its own pools best, the graph is for tokens only a multi-hop route can price
+    if not price:
+        with metrics.pricer('liquidity graph'):
+            new_price = liquidity_graph.get_price(token, block=block)
         if new_price:
             price = new_price
 
-    if price is None:
-        _fail_appropriately(token_string, fail_to_None=fail_to_None, silent=silent)
     if price:
         _sense_check(token, price)
     return price
@@ -139,46 +315,120 @@ def _exit_early_for_known_tokens(
     bucket = check_bucket(token_address)
 
     price = None
+    if bucket is None:
+        return price
 
-    if bucket == 'atoken':                  price = aave.get_price(token_address, block=block)
-    elif bucket == 'balancer pool':         price = balancer_multiplexer.get_price(token_address, block)
-    elif bucket == 'basketdao':             price = basketdao.get_price(token_address, block)
+    with metrics.pricer(bucket):
+        if bucket == 'atoken':                  price = aave.get_price(token_address, block=block)
+        elif bucket == 'balancer pool':         price = balancer_multiplexer.get_price(token_address, block)
+        elif bucket == 'basketdao':             price = basketdao.get_price(token_address, block)
 
-    elif bucket == 'belt lp':               price = belt.get_price(token_address, block)
-    elif bucket == 'chainlink feed':        price = chainlink.get_price(token_address, block)
-    elif bucket == 'compound':              price = compound.get_price(token_address, block=block)
+        elif bucket == 'belt lp':               price = belt.get_price(token_address, block)
+        elif bucket == 'chainlink feed':        price = chainlink.get_price(token_address, block)
+        elif bucket == 'compound':              price = compound.get_price(token_address, block=block)
 
-    elif bucket == 'convex':                price = convex.get_price(token_address,block)
-    elif bucket == 'creth':                 price = creth.get_price_creth(token_address, block)
-    elif bucket == 'curve lp':              price = curve.get_price(token_address, block)
+        elif bucket == 'convex':                price = convex.get_price(token_address,block)
+        elif bucket == 'creth':                 price = creth.get_price_creth(token_address, block)
+        elif bucket == 'curve lp':              price = curve.get_price(token_address, block)
 
-    elif bucket == 'ellipsis lp':           price = ellipsis.get_price(token_address, block=block)
-    elif bucket == 'froyo':                 price = froyo.get_price(token_address, block=block)
-    elif bucket == 'gelato':                price = gelato.get_price(token_address, block=block)
+        elif bucket == 'ellipsis lp':           price = ellipsis.get_price(token_address, block=block)
+        elif bucket == 'froyo':                 price = froyo.get_price(token_address, block=block)
+        elif bucket == 'gelato':                price = gelato.get_price(token_address, block=block)
 
-    elif bucket == 'generic amm':           price = generic_amm.get_price(token_address, block=block)
-    elif bucket == 'ib token':              price = ib.get_price(token_address,block=block)
-    elif bucket == 'mooniswap lp':          price = mooniswap.get_pool_price(token_address, block=block)
+        elif bucket == 'generic amm':           price = generic_amm.get_price(token_address, block=block)
+        elif bucket == 'ib token':              price = ib.get_price(token_address,block=block)
+        elif bucket == 'mooniswap lp':          price = mooniswap.get_pool_price(token_address, block=block)
 
-    elif bucket == 'mstable feeder pool':   price = mstablefeederpool.get_price(token_address,block=block)
-    elif bucket == 'one to one':            price = one_to_one.get_price(token_address, block)
-    elif bucket == 'piedao lp':             price = piedao.get_price(token_address, block=block)
-    elif bucket == 'popsicle':              price = popsicle.get_price(token_address, block=block)
+        elif bucket == 'mstable feeder pool':   price = mstablefeederpool.get_price(token_address,block=block)
+        elif bucket == 'one to one':            price = one_to_one.get_price(token_address, block)
+        elif bucket == 'piedao lp':             price = piedao.get_price(token_address, block=block)
+        elif bucket == 'popsicle':              price = popsicle.get_price(token_address, block=block)
 
-    elif bucket == 'saddle':                price = saddle.get_price(token_address, block)
-    elif bucket == 'stable usd':            price = 1
-    elif bucket == 'synthetix':             price = synthetix.get_price(token_address, block)
+        elif bucket == 'saddle':                price = saddle.get_price(token_address, block)
+        elif bucket == 'stable usd':            price = 1
+        elif bucket == 'synthetix':             price = synthetix.get_price(token_address, block)
 
-    elif bucket == 'token set':             price = tokensets.get_price(token_address, block=block)
-    elif bucket == 'uni or uni-like lp':    price = uniswap_multiplexer.lp_price(token_address, block)
-    elif bucket == 'wrapped gas coin':      price = get_price(WRAPPED_GAS_COIN, block)
+        elif bucket == 'token set':             price = tokensets.get_price(token_address, block=block)
+        elif bucket == 'uni or uni-like lp':    price = uniswap_multiplexer.lp_price(token_address, block)
+        elif bucket == 'wrapped gas coin':      price = get_price(WRAPPED_GAS_COIN, block)
 
-    elif bucket == 'wsteth':                price = wsteth.wsteth.get_price(block)
-    elif bucket == 'yearn or yearn-like':   price = yearn.get_price(token_address, block)
+        elif bucket == 'wsteth':                price = wsteth.wsteth.get_price(block)
+        elif bucket == 'yearn or yearn-like':   price = yearn.get_price(token_address, block)
 
     return price
 
-         
+
+def _get_price_series(
+    token: str,
+    blocks: Tuple[Block,...],
+    fail_to_None: bool = False,
+    silent: bool = False
+    ) -> List[Optional[UsdPrice]]:
+
+    bucket = check_bucket(token)
+    prices = _series_for_known_tokens(token, bucket, blocks)
+
+    if prices is None and bucket is None:
+        prices = _series_for_swappable_tokens(token, blocks)
+
+    if prices is None:
+        prices = [None for _ in blocks]
+    
+    for price in prices:
+        if price:
+            _sense_check(token, price)
+
+    # anything we couldn't price in bulk goes thru the full pipeline one block at a time
+    return [
+        price if price else _get_price(token, block, fail_to_None=fail_to_None, silent=silent)
+        for price, block in zip(prices, blocks)
+    ]
+
+
+@log(logger)
+def _series_for_known_tokens(
+    token_address: str,
+    bucket: Optional[str],
+    blocks: Tuple[Block,...]
+    ) -> Optional[List[Optional[UsdPrice]]]:
+    '''
+    Returns `None` if we can't batch prices for `bucket` across blocks.
+    '''
+
+    if bucket == 'chainlink feed':          return chainlink.get_price_series(token_address, blocks)
+    elif bucket == 'stable usd':            return [1 for _ in blocks]
+    elif bucket == 'wrapped gas coin':      return get_price_series(WRAPPED_GAS_COIN, blocks)
+    return None
+
+
+@log(logger)
+def _series_for_swappable_tokens(
+    token_address: str,
+    blocks: Tuple[Block,...]
+    ) -> Optional[List[Optional[UsdPrice]]]:
+    '''
+    Runs the same fallback chain as `_get_price`, with each step batched across blocks.
+    Returns `None` if the token needs to be priced one block at a time.
+    '''
+
+    # curve pricing depends on the pool, we leave these for `_get_price`
+    if curve and token_address in curve.coin_to_pools:
+        return None
+
+    prices = [None for _ in blocks]
+
+    if uniswap_v3:
+        prices = uniswap_v3.get_price_series(token_address, blocks)
+
+    missing = [block for block, price in zip(blocks, prices) if price is None]
+    if missing:
+        uni_prices = dict(zip(missing, uniswap_multiplexer.get_price_series(token_address, missing)))
+        prices = [uni_prices[block] if price is None else price for block, price in zip(blocks, prices)]
+    
+    return prices
+
+
+
 def _fail_appropriately(
     token_string: str, 
     fail_to_None: bool = False, 
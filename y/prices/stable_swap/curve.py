@@ -1,24 +1,27 @@
 import logging
+import threading
 from collections import defaultdict
 from functools import cached_property, lru_cache
 from itertools import islice
-from typing import Any, Dict, List, Optional
+from typing import Any, Dict, Iterable, List, Optional
 
 import brownie
 from brownie import ZERO_ADDRESS, chain
 from brownie.exceptions import ContractNotFound
-from cachetools.func import ttl_cache
+from web3.types import LogReceipt
 from y.classes.common import ERC20, WeiBalance
 from y.classes.singleton import Singleton
 from y.constants import dai
-from y.contracts import Contract
+from y.contracts import Contract, static_contract
 from y.datatypes import UsdPrice, UsdValue
 from y.decorators import log
 from y.exceptions import (ContractNotVerified, MessedUpBrownieContract,
                           PriceError, UnsupportedNetwork, call_reverted)
+from y.interfaces.curve import CURVE_POOL_ABI
 from y.networks import Network
 from y.prices import magic
 from y.typing import Address, AddressOrContract, AnyAddressType, Block
+from y.utils.cache import block_cache
 from y.utils.events import create_filter, decode_logs, get_logs_asap
 from y.utils.middleware import ensure_middleware
 from y.utils.multicall import (
@@ -35,6 +38,9 @@ logger = logging.getLogger(__name__)
 
 ADDRESS_PROVIDER = '0x0000000022D53366457F9d5E68Ec105046FC4383'
 
+# how often, in seconds, the registry checks for new pools in the background
+REFRESH_INTERVAL = 600
+
 # fold underlying tokens into one of the basic tokens
 
 BASIC_TOKENS = {
@@ -97,6 +103,11 @@ class CurvePool(ERC20): # this shouldn't be ERC20 but works for inheritance for
     def contract(self) -> Contract:
         return Contract(self.address)
     
+    @cached_property
+    def _static_contract(self) -> brownie.Contract:
+        """ A handle with only the methods every curve pool shares, which never waits on the block explorer. """
+        return static_contract('CurvePool [static]', self.address, CURVE_POOL_ABI)
+
     @cached_property
     def factory(self) -> Contract:
         return curve.get_factory(self)
@@ -176,7 +187,7 @@ class CurvePool(ERC20): # this shouldn't be ERC20 but works for inheritance for
         return [ERC20(coin) for coin in coins if coin != ZERO_ADDRESS]
     
     @log(logger)
-    @lru_cache
+    @block_cache
     def get_balances(self, block: Optional[Block] = None) -> Dict[ERC20, int]:
         """
         Get {token: balance} of liquidity in the pool.
@@ -334,45 +345,86 @@ class CurveRegistry(metaclass=Singleton):
 
         self.pools = set()
         self.identifiers = defaultdict(list)
+        # all state below is updated in place by the poller thread while holding the lock
+        self._lock = threading.RLock()
+        self._last_block: Dict[str, Block] = {}
+        self._metapools_by_factory: Dict[str, List[str]] = {}
+        self._coin_to_pools: Optional[Dict[str, List[CurvePool]]] = None
+        self._stop = threading.Event()
         self.watch_events()
+        self._poller = threading.Thread(target=self._poll, name='CurveRegistry poller', daemon=True)
+        self._poller.start()
     
     def __repr__(self) -> str:
         return "<CurveRegistry>"
 
     def watch_events(self) -> None:
-        # TODO keep fresh in background
-
-        # fetch all registries and factories from address provider
-        log_filter = create_filter(str(self.address_provider))
-        try:
-            new_entries = log_filter.get_new_entries()
-        except: # Some nodes have issues with filters and/or rate limiting
-            new_entries = []
-        if not new_entries:
-            new_entries = get_logs_asap(str(self.address_provider), None)
-        
-        for event in decode_logs(new_entries):
-            if event.name == 'NewAddressIdentifier':
-                self.identifiers[event['id']].append(event['addr'])
-            elif event.name == 'AddressModified':
-                self.identifiers[event['id']].append(event['new_address'])
-
-        self.pools = {pool for pools in self.metapools_by_factory.values() for pool in pools}
+        """
+        Load any registries, factories and pools added since we last checked.
+        The first call reads the full history, after that we only tail new blocks.
+        """
+        with self._lock:
+            to_block = chain.height
+
+            # fetch all registries and factories from address provider
+            for event in decode_logs(self._get_new_logs(self.address_provider, to_block)):
+                if event.name == 'NewAddressIdentifier':
+                    self.identifiers[event['id']].append(event['addr'])
+                elif event.name == 'AddressModified':
+                    self.identifiers[event['id']].append(event['new_address'])
+
+            new_pools = self._refresh_factories()
+
+            # fetch pools from the latest registry
+            for event in decode_logs(self._get_new_logs(self.registry, to_block)):
+                if event.name == 'PoolAdded':
+                    new_pools.append(event['pool'])
+            
+            new_pools = [pool for pool in new_pools if pool not in self.pools]
+            if not new_pools:
+                return
+            
+            first_load = not self.pools
+            self.pools.update(new_pools)
+            if first_load:
+                logger.info(f'loaded {len(self.pools)} pools')
+            else:
+                logger.info(f'loaded {len(new_pools)} new pools')
+                # a token we checked before might be one of the new pools
+                CurveRegistry.get_pool.cache_clear()
+                CurveRegistry._pool_from_lp_token.cache_clear()
+    
+    def stop(self) -> None:
+        """ Stop refreshing in the background. """
+        self._stop.set()
+    
+    def _poll(self) -> None:
+        while not self._stop.wait(REFRESH_INTERVAL):
+            try:
+                self.watch_events()
+            except Exception as e:
+                logger.warning(f'{self} failed to refresh, will try again in {REFRESH_INTERVAL}s: {e}')
 
-        # fetch pools from the latest registry
-        log_filter = create_filter(str(self.registry))
-        try:
-            new_entries = log_filter.get_new_entries()
-        except: # Some nodes have issues with filters and/or rate limiting
-            new_entries = []
-        if not new_entries:
-            new_entries = get_logs_asap(str(self.registry), None)
-
-        for event in decode_logs(new_entries):
-            if event.name == 'PoolAdded':
-                self.pools.add(event['pool'])
-        
-        logger.info(f'loaded {len(self.pools)} pools')
+    def _get_new_logs(self, address: AddressOrContract, to_block: Block) -> List[LogReceipt]:
+        """
+        Returns logs emitted by `address` since we last checked, up to and including `to_block`.
+        """
+        address = str(address)
+        if address in self._last_block:
+            from_block = self._last_block[address] + 1
+            logs = get_logs_asap(address, None, from_block=from_block, to_block=to_block) if from_block <= to_block else []
+        else:
+            log_filter = create_filter(address)
+            try:
+                logs = log_filter.get_new_entries()
+            except: # Some nodes have issues with filters and/or rate limiting
+                logs = []
+            if not logs:
+                logs = get_logs_asap(address, None, to_block=to_block)
+            # the filter might have picked up blocks after `to_block`, we'll see those next time
+            logs = [log for log in logs if log['blockNumber'] <= to_block]
+        self._last_block[address] = to_block
+        return logs
 
     @property
     @log(logger)
@@ -383,29 +435,44 @@ class CurveRegistry(metaclass=Singleton):
             return Contract(raw_call(self.address_provider, 'get_registry()', output='address'))
 
     @property
-    @ttl_cache(ttl=3600)
-    def metapools_by_factory(self):
+    def metapools_by_factory(self) -> Dict[str, List[str]]:
         """
         Read cached pools spawned by each factory.
-        TODO Update on factory events
+        """
+        with self._lock:
+            return dict(self._metapools_by_factory)
+
+    def _refresh_factories(self) -> List[str]:
+        """
+        Fetch pools spawned by each factory since we last checked. Returns the new pools.
         """
         metapool_factories = [Contract(factory) for factory in self.identifiers[3]]
+        if not metapool_factories:
+            return []
         pool_counts = fetch_multicall(
             *[[factory, 'pool_count'] for factory in metapool_factories]
         )
-        pool_lists = iter(
-            fetch_multicall(
-                *[
-                    [factory, 'pool_list', i]
-                    for factory, pool_count in zip(metapool_factories, pool_counts)
-                    for i in range(pool_count)
-                ]
-            )
-        )
-        return {
-            str(factory): list(islice(pool_lists, pool_count))
-            for factory, pool_count in zip(metapool_factories, pool_counts)
-        }
+        known_counts = [len(self._metapools_by_factory.get(str(factory), [])) for factory in metapool_factories]
+        calls = [
+            [factory, 'pool_list', i]
+            for factory, known_count, pool_count in zip(metapool_factories, known_counts, pool_counts)
+            for i in range(known_count, pool_count)
+        ]
+        if not calls:
+            return []
+        pool_lists = iter(fetch_multicall(*calls))
+
+        new_pools = []
+        for factory, known_count, pool_count in zip(metapool_factories, known_counts, pool_counts):
+            if pool_count <= known_count:
+                continue
+            factory_pools = list(islice(pool_lists, pool_count - known_count))
+            # replace the list rather than extending it, so copies handed out by `metapools_by_factory` don't change under the caller
+            self._metapools_by_factory[str(factory)] = self._metapools_by_factory.get(str(factory), []) + factory_pools
+            new_pools.extend(factory_pools)
+            if self._coin_to_pools is not None:
+                self._add_to_coin_to_pools(factory_pools)
+        return new_pools
 
     @log(logger)
     def get_factory(self, pool: AddressOrContract) -> Contract:
@@ -422,8 +489,8 @@ class CurveRegistry(metaclass=Singleton):
         except StopIteration:
             return None
 
-    @log(logger)
     @lru_cache(maxsize=None)
+    @log(logger)
     def _pool_from_lp_token(self, token: AddressOrContract) -> str:
         return self.registry.get_pool_from_lp_token(token)
 
@@ -432,15 +499,15 @@ class CurveRegistry(metaclass=Singleton):
         return self.get_pool(token) is not None
     
     @log(logger)
-    @ttl_cache(maxsize=None, ttl=600)
+    @block_cache
     def get_price(self, token: Address, block: Optional[Block] = None) -> Optional[float]:
         tvl = self.get_pool(token).get_tvl(block=block)
         if tvl is None:
             return None
         return tvl / ERC20(token).total_supply_readable(block)
 
-    @log(logger)
     @lru_cache(maxsize=None)
+    @log(logger)
     def get_pool(self, token: Address) -> CurvePool:
         """
         Get Curve pool (swap) address by LP token address. Supports factory pools.
@@ -459,7 +526,7 @@ class CurveRegistry(metaclass=Singleton):
     @log(logger)
     def virtual_price(self, token: Address, block: Optional[Block] = None) -> int:
         pool = self.get_pool(token)
-        try: return pool.contract.get_virtual_price(block_identifier=block)
+        try: return pool._static_contract.get_virtual_price(block_identifier=block)
         except Exception as e:
             if call_reverted(e): return False
             else: raise
@@ -496,21 +563,33 @@ class CurveRegistry(metaclass=Singleton):
                 return None
             try:
                 return dy.value_usd()
-            except (PriceError,RecursionError): # TODO handle this case better
+            except PriceError: # TODO handle this case better
                 return None
         else:
             # TODO: handle this sitch if necessary
             return
 
 
-    @cached_property
+    @property
     def coin_to_pools(self) -> Dict[str, List[CurvePool]]:
-        mapping = defaultdict(set)
-        pools = {CurvePool(pool) for pools in self.metapools_by_factory.values() for pool in pools}
-        for pool in pools:
+        # the poller never changes a dict it handed out, so readers don't need the lock
+        if self._coin_to_pools is not None:
+            return self._coin_to_pools
+        with self._lock:
+            if self._coin_to_pools is None:
+                self._add_to_coin_to_pools(pool for pools in self._metapools_by_factory.values() for pool in pools)
+            return self._coin_to_pools
+    
+    def _add_to_coin_to_pools(self, pools: Iterable[str]) -> None:
+        """ Adds `pools` to a copy of `coin_to_pools` and swaps it in once it's complete. Call this with `self._lock` held. """
+        coin_to_pools = {coin: list(coin_pools) for coin, coin_pools in (self._coin_to_pools or {}).items()}
+        for pool in {CurvePool(pool) for pool in pools}:
             for coin in pool.get_coins:
-                mapping[coin].add(pool)
-        return {coin: list(pools) for coin, pools in mapping.items()}
+                if coin not in coin_to_pools:
+                    coin_to_pools[coin] = []
+                if pool not in coin_to_pools[coin]:
+                    coin_to_pools[coin].append(pool)
+        self._coin_to_pools = coin_to_pools
 
 try: curve = CurveRegistry()
 except UnsupportedNetwork: curve = set()
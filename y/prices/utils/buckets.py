@@ -1,9 +1,13 @@
 import logging
 from functools import lru_cache
+from typing import Callable, Dict, Iterable, List, Optional, Set, Tuple, Union
+
+from multicall import Call, Multicall
 
 from y import convert
 from y.constants import STABLECOINS
 from y.decorators import log
+from y.exceptions import call_reverted
 from y.prices import convex, one_to_one, popsicle, yearn
 from y.prices.chainlink import chainlink
 from y.prices.dex import mooniswap
@@ -20,6 +24,7 @@ from y.prices.stable_swap.curve import curve
 from y.prices.synthetix import synthetix
 from y.prices.tokenized_fund import basketdao, gelato, piedao, tokensets
 from y.typing import AnyAddressType
+from y.utils.store import price_store
 
 logger = logging.getLogger(__name__)
 
@@ -31,6 +36,51 @@ def check_bucket(
 
     token_address = convert.to_address(token_address)
 
+    # classifications are persisted so we don't have to probe the chain again after a restart
+    cached, bucket = price_store.get_bucket(token_address)
+    if not cached:
+        bucket = _check_bucket(token_address)
+        price_store.set_bucket(token_address, bucket)
+    return bucket
+
+
+@log(logger)
+def check_buckets(
+    token_addresses: Iterable[AnyAddressType]
+    ) -> List[str]:
+    '''
+    Returns `[check_bucket(token) for token in token_addresses]`.
+    
+    The on-chain probes for every predicate that only needs view calls are sent for
+    all unclassified tokens together in one multicall, instead of one token at a time.
+    '''
+    token_addresses = [convert.to_address(token) for token in token_addresses]
+
+    buckets, pending = {}, []
+    for token in dict.fromkeys(token_addresses):
+        cached, bucket = price_store.get_bucket(token)
+        if cached:
+            buckets[token] = bucket
+        else:
+            pending.append(token)
+    
+    if pending:
+        probes = _probe_methods(pending, set(_methods(_probes())))
+        for token in pending:
+            buckets[token] = _check_bucket(token, probes=probes.get(token))
+            price_store.set_bucket(token, buckets[token])
+
+    return [buckets[token] for token in token_addresses]
+
+
+def _check_bucket(
+    token_address: str,
+    probes: Optional[Dict[str,bool]] = None
+    ) -> str:
+
+    # if we've already probed the chain for `token_address`, we can skip the calls
+    probe = _Prober(token_address, probes)
+
     # these require neither calls to the chain nor contract initialization
     if token_address == "0xEeeeeEeeeEeEeeEeEeEeeEEEeeeeEeeeeeeeEEeE":       return 'wrapped gas coin'
     elif token_address in STABLECOINS:                                      return 'stable usd'
@@ -45,20 +95,20 @@ def check_bucket(
     elif convex.is_convex_lp(token_address):                                return 'convex'
 
     # these just require calls
-    elif balancer_multiplexer.is_balancer_pool(token_address):              return 'balancer pool'
-    elif yearn.is_yearn_vault(token_address):                               return 'yearn or yearn-like'
-    elif ib.is_ib_token(token_address):                                     return 'ib token'
+    elif probe('balancer pool', balancer_multiplexer.is_balancer_pool):     return 'balancer pool'
+    elif probe('yearn or yearn-like', yearn.is_yearn_vault):                return 'yearn or yearn-like'
+    elif probe('ib token', ib.is_ib_token):                                 return 'ib token'
 
-    elif gelato.is_gelato_pool(token_address):                              return 'gelato'
-    elif piedao.is_pie(token_address):                                      return 'piedao lp'
-    elif tokensets.is_token_set(token_address):                             return 'token set'
+    elif probe('gelato', gelato.is_gelato_pool):                            return 'gelato'
+    elif probe('piedao lp', piedao.is_pie):                                 return 'piedao lp'
+    elif probe('token set', tokensets.is_token_set):                        return 'token set'
 
-    elif ellipsis.is_eps_rewards_pool(token_address):                       return 'ellipsis lp'
-    elif mstablefeederpool.is_mstable_feeder_pool(token_address):           return 'mstable feeder pool'
+    elif probe('ellipsis lp', ellipsis.is_eps_rewards_pool):                return 'ellipsis lp'
+    elif probe('mstable feeder pool', mstablefeederpool.is_mstable_feeder_pool): return 'mstable feeder pool'
     elif saddle.is_saddle_lp(token_address):                                return 'saddle'
 
-    elif basketdao.is_basketdao_index(token_address):                       return 'basketdao'
-    elif popsicle.is_popsicle_lp(token_address):                            return 'popsicle'
+    elif probe('basketdao', basketdao.is_basketdao_index):                  return 'basketdao'
+    elif probe('popsicle', popsicle.is_popsicle_lp):                        return 'popsicle'
 
     # these just require contract initialization
     elif token_address in generic_amm:                                      return 'generic amm'
@@ -70,3 +120,101 @@ def check_bucket(
     elif token_address in curve:                                            return 'curve lp'
     elif token_address in chainlink:                                        return 'chainlink feed'
     elif token_address in synthetix:                                        return 'synthetix'
+
+
+# The view methods each predicate above probes for, as nested `(all | any, [method | probe])` specs.
+# These must match the `has_methods` checks inside the predicates so that `check_buckets` gets the same answers as `check_bucket`.
+Probe = Tuple[Callable, List[Union[str, 'Probe']]]
+
+PROBES: Dict[str, Probe] = {
+    'yearn or yearn-like': (any, [
+        (any, ['pricePerShare()(uint)','getPricePerShare()(uint)','getPricePerFullShare()(uint)','getSharesToUnderlying()(uint)']),
+        (all, ['exchangeRate()(uint)','underlying()(address)']),
+    ]),
+    'ib token':             (all, ['debtShareToVal(uint)(uint)','debtValToShare(uint)(uint)']),
+    'gelato':               (all, ['gelatoBalance0()(uint)','gelatoBalance1()(uint)']),
+    'piedao lp':            (all, ['getCap()(uint)']),
+    'token set': (any, [
+        (all, ["getComponents()(address[])", "naturalUnit()(uint)"]),
+        (all, ["getComponents()(address[])", "getModules()(address[])", "getPositions()(address[])"]),
+    ]),
+    'ellipsis lp':          (all, ['lpStaker()(address)','rewardTokens(uint)(address)','rewardPerToken(address)(uint)','minter()(address)']),
+    'mstable feeder pool':  (all, ['getPrice()((uint,uint))','mAsset()(address)']),
+    'basketdao':            (all, ['getAssetsAndBalances()(address[],uint[])']),
+    'popsicle':             (all, ['token0()(address)','token1()(address)','usersAmounts()((uint,uint))']),
+}
+
+# `is_balancer_pool` only checks the balancer versions on this chain, so `_probes` only adds their specs to 'balancer pool'.
+BALANCER_PROBES: Dict[str, Probe] = {
+    'v1': (all, ["getCurrentTokens()(address[])", "getTotalDenormalizedWeight()(uint)", "totalSupply()(uint)"]),
+    'v2': (all, ['getPoolId()(bytes32)','getPausedState()((bool,uint,uint))','getSwapFeePercentage()(uint)']),
+}
+
+@lru_cache(maxsize=None)
+def _probes() -> Dict[str, Probe]:
+    """ Returns `PROBES` plus the 'balancer pool' probe for this chain. We build it on first use so importing this module doesn't set up balancer. """
+    versions = [BALANCER_PROBES[version] for version in BALANCER_PROBES if getattr(balancer_multiplexer, version)]
+    return {'balancer pool': (any, versions), **PROBES}
+
+# Some predicates do more than probe for methods. When the probe comes back negative, we still run these.
+PROBE_FALLBACKS: Dict[str, Callable] = {
+    # pricePerShare can revert if totalSupply == 0, but the vault might still be verified
+    'yearn or yearn-like': yearn._is_yearn_vault_by_abi,
+}
+
+
+class _Prober:
+    def __init__(self, token_address: str, probes: Optional[Dict[str,bool]]) -> None:
+        self.token_address = token_address
+        self.probes = probes
+    
+    def __call__(self, bucket: str, predicate: Callable) -> bool:
+        if self.probes is None:
+            return predicate(self.token_address)
+        result = _evaluate(_probes()[bucket], self.probes)
+        if not result and bucket in PROBE_FALLBACKS:
+            result = PROBE_FALLBACKS[bucket](self.token_address)
+        return result
+
+
+def _evaluate(probe: Probe, probes: Dict[str,bool]) -> bool:
+    func, checks = probe
+    return func([probes[check] if isinstance(check, str) else _evaluate(check, probes) for check in checks])
+
+
+def _methods(probes: Union[Dict[str, Probe], Probe]) -> Iterable[str]:
+    for probe in (probes.values() if isinstance(probes, dict) else [probes]):
+        for check in probe[1]:
+            if isinstance(check, str):
+                yield check
+            else:
+                yield from _methods(check)
+
+
+# Each token adds `len(methods)` calls to the multicall, so we keep batches small enough to stay under the gas limit.
+PROBE_BATCH_SIZE = 20
+
+@log(logger)
+def _probe_methods(token_addresses: List[str], methods: Set[str]) -> Dict[str, Dict[str,bool]]:
+    '''
+    Returns `{token: {method: bool}}`, where `bool` is whether the call to `method` on `token` succeeded.
+
+    If a batch reverts as a whole (ie. one of the calls runs out of gas) we probe each of its tokens on its own.
+    A token whose own probes revert is left out, and `check_buckets` runs its predicates one at a time instead,
+    which is where `has_methods` retries each method on its own.
+    '''
+    probes = {}
+    batches = [token_addresses[i:i+PROBE_BATCH_SIZE] for i in range(0, len(token_addresses), PROBE_BATCH_SIZE)]
+    while batches:
+        batch = batches.pop()
+        calls = [Call(token, [method], [[(token, method), None]]) for token in batch for method in methods]
+        try:
+            results = Multicall(calls, require_success=False)()
+        except Exception as e:
+            if not call_reverted(e): raise
+            if len(batch) > 1:
+                batches.extend([token] for token in batch)
+            continue
+        for token in batch:
+            probes[token] = {method: results.get((token, method)) is not None for method in methods}
+    return probes
@@ -0,0 +1,214 @@
+import logging
+import multiprocessing
+import os
+import threading
+from typing import Dict, Iterable, List, Optional, Tuple
+
+from brownie import chain, network
+from y import convert
+from y.datatypes import UsdPrice
+from y.prices import magic
+from y.prices.dex.uniswap import v3
+from y.prices.dex.uniswap.uniswap import uniswap_multiplexer
+from y.prices.utils.buckets import check_buckets
+from y.typing import AnyAddressType, Block
+
+logger = logging.getLogger(__name__)
+
+"""
+Prices tokens on several networks at once, and fans big jobs out to worker processes.
+
+brownie connects each process to one network, and our singletons (`curve`, `chainlink`, `uniswap_v3`, ...) are built
+for that network at import time. So each network gets a `ChainEngine`: a pool of worker processes connected to it.
+Every process shares the SQLite store in `y.utils.store`, which keys everything by chain id, and the joblib cache,
+which lives in `cache/{chain.id}`. Before a job fans out, one worker indexes pools and buckets and persists them,
+so the rest of the workers read those indexes from the store instead of building their own.
+
+```
+coordinator = PriceCoordinator({'mainnet': 4, 'ftm-main': 2})
+prices = coordinator.get_prices({'mainnet': (eth_tokens, None), 'ftm-main': (ftm_tokens, None)})
+```
+"""
+
+# worker processes per network, if you don't say otherwise
+DEFAULT_PROCESSES = max(1, (os.cpu_count() or 2) // 2)
+
+# workers get this many tokens at a time, so a slow token doesn't hold up a whole process's share
+CHUNK_SIZE = 100
+
+# `y` connects to `$BROWNIE_NETWORK_ID` when it's imported, so that's how we tell a new worker which network to use.
+# We're changing our own environment to do it, so only one engine starts its workers at a time.
+_spawn_lock = threading.Lock()
+
+
+class ChainEngine:
+    """ A pool of worker processes connected to brownie network `network_id`. """
+    def __init__(self, network_id: str, processes: int = DEFAULT_PROCESSES) -> None:
+        self.network_id = network_id
+        self.processes = processes
+        self.chain_id: Optional[int] = None
+        self._pool = None
+        self._warm_lock = threading.Lock()
+
+    def __repr__(self) -> str:
+        return f"<ChainEngine {self.network_id} processes={self.processes} chain_id={self.chain_id}>"
+
+    def start(self) -> None:
+        if self._pool is not None:
+            return
+        # workers must not fork our brownie connection, so we always spawn fresh interpreters
+        context = multiprocessing.get_context('spawn')
+        with _spawn_lock:
+            previous = os.environ.get('BROWNIE_NETWORK_ID')
+            os.environ['BROWNIE_NETWORK_ID'] = self.network_id
+            try:
+                self._pool = context.Pool(self.processes, initializer=_init_worker, initargs=(self.network_id,))
+            finally:
+                if previous is None:
+                    del os.environ['BROWNIE_NETWORK_ID']
+                else:
+                    os.environ['BROWNIE_NETWORK_ID'] = previous
+        self.chain_id = self._pool.apply(_chain_id)
+
+    def close(self) -> None:
+        if self._pool is not None:
+            self._pool.close()
+            self._pool.join()
+            self._pool = None
+
+    def warm(self, tokens: Iterable[AnyAddressType]) -> Block:
+        '''
+        Indexes pools and buckets for `tokens` in one worker, so they're in the store before the rest of the workers need them.
+        Returns the chain height the worker saw, so every chunk of a job can be priced at the same block.
+        '''
+        self.start()
+        with self._warm_lock:
+            return self._pool.apply(_warm, (list(tokens),))
+
+    def get_prices(
+        self,
+        token_addresses: Iterable[AnyAddressType],
+        block: Optional[Block] = None,
+        fail_to_None: bool = False,
+        silent: bool = False,
+    ) -> List[Optional[UsdPrice]]:
+        '''
+        Same interface and output as `magic.get_prices`, computed by this engine's workers.
+        '''
+        return self.get_prices_async(token_addresses, block, fail_to_None, silent).get()
+
+    def get_prices_async(
+        self,
+        token_addresses: Iterable[AnyAddressType],
+        block: Optional[Block] = None,
+        fail_to_None: bool = False,
+        silent: bool = False,
+    ) -> "_PendingPrices":
+        """ Like `get_prices`, but returns at once. Call `.get()` on the result to wait for the prices. """
+        token_addresses = list(token_addresses)
+        height = self.warm(token_addresses)
+        block = height if block is None else block
+        chunks = [token_addresses[i:i + CHUNK_SIZE] for i in range(0, len(token_addresses), CHUNK_SIZE)]
+        result = self._pool.starmap_async(_get_prices, [(chunk, block, fail_to_None, silent) for chunk in chunks])
+        return _PendingPrices(result)
+
+    def __enter__(self) -> "ChainEngine":
+        self.start()
+        return self
+
+    def __exit__(self, *exc_info) -> None:
+        self.close()
+
+
+class _PendingPrices:
+    def __init__(self, result: "multiprocessing.pool.AsyncResult") -> None:
+        self._result = result
+
+    def get(self, timeout: Optional[float] = None) -> List[Optional[UsdPrice]]:
+        return [price for chunk in self._result.get(timeout) for price in chunk]
+
+
+class PriceCoordinator:
+    '''
+    Runs a `ChainEngine` for each network in `networks`, which maps brownie network ids to the number of worker processes to give each one.
+    Jobs for different networks run at the same time.
+    '''
+    def __init__(self, networks: Dict[str, int]) -> None:
+        self.engines = {network_id: ChainEngine(network_id, processes) for network_id, processes in networks.items()}
+
+    def __repr__(self) -> str:
+        return f"<PriceCoordinator networks={list(self.engines)}>"
+
+    def start(self) -> None:
+        for engine in self.engines.values():
+            engine.start()
+
+    def close(self) -> None:
+        for engine in self.engines.values():
+            engine.close()
+
+    def get_prices(
+        self,
+        jobs: Dict[str, Tuple[Iterable[AnyAddressType], Optional[Block]]],
+        fail_to_None: bool = False,
+        silent: bool = False,
+    ) -> Dict[str, List[Optional[UsdPrice]]]:
+        '''
+        `jobs` maps each network id to `(token_addresses, block)`. Returns `{network_id: prices}`.
+        '''
+        unknown = set(jobs) - set(self.engines)
+        if unknown:
+            raise ValueError(f'no engine for {unknown}, pass them to `PriceCoordinator` first')
+
+        # warming blocks until the worker is done, so we warm every network at once on our own threads
+        pending: Dict[str, _PendingPrices] = {}
+        errors: Dict[str, BaseException] = {}
+
+        def submit(network_id: str, tokens: Iterable[AnyAddressType], block: Optional[Block]) -> None:
+            try:
+                pending[network_id] = self.engines[network_id].get_prices_async(tokens, block, fail_to_None, silent)
+            except BaseException as e:
+                errors[network_id] = e
+
+        threads = [threading.Thread(target=submit, args=(network_id, tokens, block)) for network_id, (tokens, block) in jobs.items()]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        if errors:
+            raise next(iter(errors.values()))
+
+        return {network_id: pending[network_id].get() for network_id in jobs}
+
+    def __enter__(self) -> "PriceCoordinator":
+        self.start()
+        return self
+
+    def __exit__(self, *exc_info) -> None:
+        self.close()
+
+
+def _init_worker(network_id: str) -> None:
+    # importing `y` connected us to `$BROWNIE_NETWORK_ID`, make sure that's the network we were started for
+    if network.show_active() != network_id:
+        network.disconnect()
+        network.connect(network_id)
+    logger.debug('worker %d connected to %s', os.getpid(), network_id)
+
+
+def _chain_id() -> int:
+    return chain.id
+
+
+def _warm(tokens: List[AnyAddressType]) -> Block:
+    # these persist what they find in the store, where the other workers will look first
+    for router in uniswap_multiplexer.routers.values():
+        router.refresh_pools()
+    if v3.uniswap_v3:
+        v3.uniswap_v3.pools.refresh()
+    check_buckets([convert.to_address(token) for token in tokens])
+    return chain.height
+
+
+def _get_prices(tokens: List[AnyAddressType], block: Block, fail_to_None: bool, silent: bool) -> List[Optional[UsdPrice]]:
+    return magic.get_prices(tokens, block, fail_to_None=fail_to_None, silent=silent)
@@ -0,0 +1,231 @@
+import logging
+import threading
+from concurrent.futures import Future
+from typing import Callable, Dict, Iterable, List, Optional, Set, Tuple
+
+from brownie import chain
+from y import convert
+from y.constants import weth
+from y.datatypes import UsdPrice
+from y.exceptions import PriceCycleError
+from y.prices import convex, magic
+from y.prices.dex.uniswap.v2 import UniswapPoolV2
+from y.prices.lending.aave import aave
+from y.prices.lending.compound import CToken
+from y.prices.stable_swap.curve import curve
+from y.prices.utils import planner
+from y.prices.utils.buckets import check_bucket, check_buckets
+from y.prices.yearn import YearnInspiredVault
+from y.typing import Address, AnyAddressType, Block
+from y.utils.raw_calls import _symbol
+
+logger = logging.getLogger(__name__)
+
+"""
+Wrapper tokens, like vault shares, ctokens, atokens and LP tokens, are priced from the prices of their underlyings.
+Instead of letting every wrapper recurse into `magic.get_price` on its own, we:
+1. build the dependency graph of every token we were asked for, down to tokens with no underlyings
+2. price the graph level by level, leaves first, with each level batched thru the planner's multicalls
+3. leave each price in `magic`'s cache, so when a wrapper asks for its underlying the price is already there
+
+`Resolver` makes sure each `(token, block)` is computed once even when many threads ask for it, and turns a
+token that depends on itself into a `PriceCycleError` instead of a `RecursionError`.
+"""
+
+Key = Tuple[Address, Block]
+
+
+class Resolver:
+    def __init__(self) -> None:
+        self._lock = threading.Lock()
+        self._local = threading.local()
+        # {key: (future, the thread computing it)}
+        self._in_flight: Dict[Key, Tuple[Future, int]] = {}
+        # {thread: the key it's waiting for}
+        self._waiting_on: Dict[int, Key] = {}
+
+    def __repr__(self) -> str:
+        return f"<Resolver in_flight={len(self._in_flight)}>"
+
+    def resolve(self, token: Address, block: Block, fetch: Callable[[Address, Block], Optional[UsdPrice]]) -> Optional[UsdPrice]:
+        '''
+        Returns `fetch(token, block)`. If another thread is already fetching it, we wait for its result instead.
+        Raises `PriceCycleError` if `token` depends on itself at `block`.
+        '''
+        key = (token, block)
+        stack = self._stack()
+        if key in stack:
+            raise PriceCycleError(_describe_cycle(stack[stack.index(key):] + [key]))
+
+        me = threading.get_ident()
+        with self._lock:
+            entry = self._in_flight.get(key)
+            leader = entry is None
+            if leader:
+                future = Future()
+                self._in_flight[key] = (future, me)
+            else:
+                future, owner = entry
+                if self._waits_on(owner, me):
+                    # the thread fetching `key` is waiting, maybe thru other threads, on something we're fetching
+                    raise PriceCycleError(_describe_cycle(stack + [key]))
+                self._waiting_on[me] = key
+
+        if not leader:
+            try:
+                return future.result()
+            finally:
+                with self._lock:
+                    self._waiting_on.pop(me, None)
+
+        stack.append(key)
+        try:
+            price = fetch(token, block)
+            future.set_result(price)
+            return price
+        except BaseException as e:
+            future.set_exception(e)
+            raise
+        finally:
+            stack.pop()
+            with self._lock:
+                del self._in_flight[key]
+
+    def _stack(self) -> List[Key]:
+        if not hasattr(self._local, 'stack'):
+            self._local.stack = []
+        return self._local.stack
+
+    def _waits_on(self, thread: int, target: int) -> bool:
+        # caller holds the lock
+        seen = set()
+        while thread not in seen:
+            if thread == target:
+                return True
+            seen.add(thread)
+            key = self._waiting_on.get(thread)
+            if key is None or key not in self._in_flight:
+                return False
+            thread = self._in_flight[key][1]
+        return False
+
+
+resolver = Resolver()
+
+
+def underlyings(token: Address) -> List[Address]:
+    '''
+    Returns the tokens `token`'s price is computed from, or `[]` if we don't know of any.
+    This is only an optimization, so any failure just means no dependencies.
+    '''
+    try:
+        bucket = check_bucket(token)
+        if bucket == 'yearn or yearn-like':
+            return [YearnInspiredVault(token).underlying.address]
+        if bucket == 'compound':
+            return [CToken(token).underlying.address]
+        if bucket == 'atoken':
+            return [aave.underlying(token).address]
+        if bucket == 'convex':
+            return [convex.MAPPING[token]]
+        if bucket == 'wsteth':
+            return [weth.address]
+        if bucket == 'uni or uni-like lp':
+            return [coin.address for coin in UniswapPoolV2(token).tokens]
+        if bucket == 'curve lp':
+            return [coin.address for coin in curve.get_pool(token).get_coins]
+    except Exception as e:
+        logger.debug('could not find underlyings for %s: %s', token, e)
+    return []
+
+
+def dependency_graph(tokens: Iterable[Address]) -> Dict[Address, Set[Address]]:
+    '''
+    Returns `{token: underlyings}` for `tokens` and everything they depend on.
+    Edges that would close a cycle are dropped and logged, so the graph is always a DAG.
+    '''
+    # we find the graph one layer at a time, so each layer's tokens are classified together
+    found: Dict[Address, List[Address]] = {}
+    layer = list(dict.fromkeys(tokens))
+    while layer:
+        try:
+            check_buckets(layer)
+        except Exception as e:
+            # `underlyings` classifies them one at a time instead
+            logger.debug('could not classify %d tokens together: %s', len(layer), e)
+        for token in layer:
+            found[token] = [convert.to_address(underlying) for underlying in underlyings(token)]
+        layer = list(dict.fromkeys(underlying for token in layer for underlying in found[token] if underlying not in found))
+
+    graph: Dict[Address, Set[Address]] = {}
+    done: Set[Address] = set()
+    path: List[Address] = []
+
+    def visit(token: Address) -> None:
+        path.append(token)
+        graph[token] = set()
+        for underlying in found[token]:
+            if underlying in path:
+                logger.warning('dropping cyclic price dependency %s', _describe_cycle([(t, None) for t in path[path.index(underlying):] + [underlying]]))
+                continue
+            graph[token].add(underlying)
+            if underlying not in done:
+                visit(underlying)
+        path.pop()
+        done.add(token)
+
+    for token in tokens:
+        if token not in done:
+            visit(token)
+    return graph
+
+
+def levels(graph: Dict[Address, Set[Address]]) -> List[List[Address]]:
+    """ Returns the tokens in `graph` grouped so each level only depends on the levels before it. """
+    depth: Dict[Address, int] = {}
+
+    def depth_of(token: Address) -> int:
+        if token not in depth:
+            depth[token] = 1 + max((depth_of(underlying) for underlying in graph[token]), default=-1)
+        return depth[token]
+
+    grouped: Dict[int, List[Address]] = {}
+    for token in graph:
+        grouped.setdefault(depth_of(token), []).append(token)
+    return [grouped[i] for i in sorted(grouped)]
+
+
+def get_prices(
+    token_addresses: Iterable[AnyAddressType],
+    block: Optional[Block] = None,
+    fail_to_None: bool = False,
+    silent: bool = False,
+    dop: int = 4
+    ) -> List[Optional[UsdPrice]]:
+    '''
+    Same interface and output as `magic.get_prices`. Shared underlyings are priced once, before anything that depends on them.
+    '''
+    block = block or chain.height
+    token_addresses = [convert.to_address(token) for token in token_addresses]
+    graph = dependency_graph(dict.fromkeys(token_addresses))
+
+    prices: Dict[Address, Optional[UsdPrice]] = {}
+    for i, level in enumerate(levels(graph)):
+        logger.debug('pricing dag level %d: %d tokens', i, len(level))
+        for token, price in zip(level, planner.get_prices(level, block, fail_to_None=True, silent=True, dop=dop)):
+            prices[token] = price
+            if price is not None:
+                # the next level's wrappers will ask `magic` for this price
+                magic._get_price_or_None.prime(price, token, block)
+
+    # we priced each level silently, so we log and raise for the tokens we were asked for the same way `get_price` would
+    for token in dict.fromkeys(token_addresses):
+        if prices[token] is None:
+            symbol = _symbol(token, return_None_on_failure=True)
+            magic._fail_appropriately(f"{symbol} {token}" if symbol else token, fail_to_None=fail_to_None, silent=silent)
+    return [prices[token] for token in token_addresses]
+
+
+def _describe_cycle(keys: List[Tuple[Address, Optional[Block]]]) -> str:
+    block = keys[0][1]
+    return ' -> '.join(str(token) for token, _ in keys) + (f' at block {block}' if block is not None else '')
@@ -0,0 +1,278 @@
+import logging
+import threading
+from collections import deque
+from functools import cached_property
+from typing import Any, Dict, List, NamedTuple, Optional, Set, Tuple
+
+from hexbytes import HexBytes
+from multicall import Call
+from y import convert
+from y.contracts import contract_creation_blocks
+from y.constants import STABLECOINS, WRAPPED_GAS_COIN
+from y.datatypes import UsdPrice
+from y.decorators import log
+from y.prices import magic
+from y.prices.chainlink import chainlink
+from y.prices.dex.balancer.balancer import balancer_multiplexer
+from y.prices.dex.uniswap.uniswap import uniswap_multiplexer
+from y.prices.dex.uniswap.v2 import get_amount_out
+from y.prices.dex.uniswap.v3 import uniswap_v3
+from y.prices.stable_swap.curve import curve
+from y.typing import Address, AnyAddressType, Block
+from y.utils.cache import block_cache
+from y.utils.multicall import aggregate, multicall_decimals
+
+logger = logging.getLogger(__name__)
+
+"""
+One token liquidity graph over the pool indexes of every dex adapter we have:
+the `UniswapRouterV2` pool indexes, the `UniswapV3` pool index, `CurveRegistry.coin_to_pools` and the `BalancerV2Vault` pools.
+Tokens are nodes and each pool gives an edge between each pair of its tokens.
+
+To price a token we search the graph for short routes to an anchor, a token we can price without a swap, then fetch the state
+every candidate hop needs in one multicall. The deepest of the shortest routes that quote wins.
+"""
+
+# the most hops we'll take to get from a token to an anchor
+MAX_HOPS = 3
+
+# the most edges we follow out of each intermediate token. Edges to anchors always come first.
+MAX_EDGES_PER_TOKEN = 25
+
+# the most candidate routes we quote for one token
+MAX_ROUTES = 32
+
+
+class Edge(NamedTuple):
+    protocol: str
+    pool: Address
+    token_in: Address
+    token_out: Address
+    # the router for uniswap v2 forks, the fee for uniswap v3, the vault and pool id for balancer v2
+    extra: Any = None
+
+
+Route = Tuple[Edge, ...]
+
+
+def _key(edge: Edge) -> Tuple[str, Address, Address, Address]:
+    # `extra` can hold objects that don't hash by value
+    return edge[:4]
+
+
+class LiquidityGraph:
+    def __init__(self) -> None:
+        # `{token: [(pool, paired_with, vault, pool_id), ...]}` for the balancer v2 pools we've indexed so far
+        self._balancer_index: Dict[Address, List[Tuple[Address, Address, Address, Any]]] = {}
+        self._balancer_indexed: Set[Tuple[Address, Any]] = set()
+        self._balancer_lock = threading.Lock()
+
+    def __repr__(self) -> str:
+        return "<LiquidityGraph>"
+
+    @cached_property
+    def anchors(self) -> Set[Address]:
+        """ Tokens we can price without a swap. """
+        anchors = {convert.to_address(token) for token in STABLECOINS}
+        anchors.add(convert.to_address(WRAPPED_GAS_COIN))
+        if chainlink:
+            anchors.update(convert.to_address(str(token)) for token in chainlink.feeds)
+        return anchors
+
+    @block_cache
+    def edges(self, token: Address, block: Optional[Block] = None) -> List[Edge]:
+        '''
+        Returns an edge for every pool `token` can be swapped in at `block`, with edges to anchors first.
+        Like every `block_cache` function, the result for the latest block expires after `LATEST_TTL`, so new pools show up.
+        '''
+        edges = []
+        for router in uniswap_multiplexer.routers.values():
+            for pool, paired_with in router.pools_for_token(token).items():
+                edges.append(Edge('uniswap v2', pool, token, paired_with, router))
+        if uniswap_v3:
+            for pool, (paired_with, fee) in uniswap_v3.pools.pools_for_token(token).items():
+                edges.append(Edge('uniswap v3', pool, token, paired_with, fee))
+        if curve:
+            for pool in curve.coin_to_pools.get(token, []):
+                for coin in pool.get_coins:
+                    coin = convert.to_address(str(coin))
+                    if coin != token:
+                        edges.append(Edge('curve', pool.address, token, coin, pool))
+        for pool, paired_with, vault, pool_id in self._balancer_pools().get(token, []):
+            edges.append(Edge('balancer v2', pool, token, paired_with, (vault, pool_id)))
+        if block is not None and edges:
+            # the indexes are as of the chain head, so at an older block we leave out the pools that weren't deployed yet
+            pools = list({edge.pool for edge in edges})
+            created = dict(zip(pools, contract_creation_blocks(pools, when_no_history_return_0=True)))
+            edges = [edge for edge in edges if created[edge.pool] is not None and created[edge.pool] <= block]
+        return sorted(edges, key=lambda edge: edge.token_out not in self.anchors)
+
+    def _balancer_pools(self) -> Dict[Address, List[Tuple[Address, Address, Address, Any]]]:
+        '''
+        Returns `{token: [(pool, paired_with, vault, pool_id), ...]}` for every balancer v2 pool.
+        We only fetch the tokens of pools registered since the last call.
+        '''
+        v2 = balancer_multiplexer.v2
+        with self._balancer_lock:
+            for vault in v2.vaults if v2 else []:
+                # `list_pools` only caches the latest block for a little while, so we fetch it once, not once per pool
+                vault_pools = vault.list_pools()
+                pool_ids = tuple(pool_id for pool_id in vault_pools if (vault.address, pool_id) not in self._balancer_indexed)
+                if not pool_ids:
+                    continue
+                for pool_id, info in zip(pool_ids, vault.get_pool_info(pool_ids)):
+                    pool = vault_pools[pool_id]
+                    tokens = [convert.to_address(str(token)) for token in info[0]] if info else []
+                    for token in tokens:
+                        self._balancer_index.setdefault(token, []).extend((pool, other, vault.address, pool_id) for other in tokens if other != token)
+                    self._balancer_indexed.add((vault.address, pool_id))
+        return self._balancer_index
+
+    @log(logger)
+    @block_cache
+    def routes(self, token: AnyAddressType, block: Optional[Block] = None, max_hops: int = MAX_HOPS) -> List[Route]:
+        """
+        Returns up to `MAX_ROUTES` routes from `token` to an anchor at `block`, shortest first. Routes never revisit a token.
+        """
+        token = convert.to_address(token)
+        routes = []
+        queue = deque([(token, ())])
+        while queue and len(routes) < MAX_ROUTES:
+            current, route = queue.popleft()
+            visited = {token} | {edge.token_out for edge in route}
+            edges = self.edges(current, block)
+            for edge in edges[:MAX_EDGES_PER_TOKEN] if route else edges:
+                if edge.token_out in visited:
+                    continue
+                if edge.token_out in self.anchors:
+                    routes.append(route + (edge,))
+                elif len(route) + 1 < max_hops:
+                    queue.append((edge.token_out, route + (edge,)))
+        return routes[:MAX_ROUTES]
+
+    @log(logger)
+    def best_route(self, token: AnyAddressType, block: Optional[Block] = None) -> Optional[Tuple[Route, float]]:
+        '''
+        Returns `(route, rate)` for the deepest of the shortest routes from `token` that quote at `block`,
+        where `rate` is how much of the route's anchor one `token` is worth, or None if no route quotes.
+        '''
+        token = convert.to_address(token)
+        routes = self.routes(token, block)
+        if not routes:
+            return None
+        hops = list({_key(edge): edge for route in routes for edge in route}.values())
+        rates, depths = self._fetch_hops(hops, block)
+
+        best, best_key = None, None
+        for route in routes:
+            route_rates = [rates.get(_key(edge)) for edge in route]
+            if any(rate is None for rate in route_rates):
+                continue
+            rate = 1
+            for hop_rate in route_rates:
+                rate *= hop_rate
+            # fewer hops first, then the deepest pool for the token we're pricing
+            key = (-len(route), depths.get(_key(route[0])) or 0)
+            if best_key is None or key > best_key:
+                best, best_key = (route, rate), key
+        return best
+
+    @log(logger)
+    def get_price(self, token: AnyAddressType, block: Optional[Block] = None) -> Optional[UsdPrice]:
+        best = self.best_route(token, block)
+        if best is None:
+            return None
+        route, rate = best
+        anchor = route[-1].token_out
+        anchor_price = 1 if anchor in STABLECOINS else magic.get_price(anchor, block, fail_to_None=True)
+        if not anchor_price:
+            return None
+        logger.debug('liquidity graph route for %s: %s', token, [(edge.protocol, edge.pool) for edge in route])
+        return UsdPrice(rate * anchor_price)
+
+    def _fetch_hops(self, hops: List[Edge], block: Optional[Block]) -> Tuple[Dict[tuple, float], Dict[tuple, int]]:
+        """
+        Fetches the state every hop needs in one multicall.
+        Returns `{_key(hop): rate}` for each hop that quotes, and `{_key(hop): depth}` where `depth` is the pool's balance of `hop.token_in`.
+        """
+        tokens = list({token for edge in hops for token in (edge.token_in, edge.token_out)})
+        decimals = dict(zip(tokens, multicall_decimals(tokens, block=block, return_None_on_failure=True)))
+
+        calls = []
+        for i, edge in enumerate(hops):
+            if edge.protocol == 'uniswap v2':
+                calls.append(Call(edge.pool, ['getReserves()((uint112,uint112,uint32))'], [[('state', i), None]]))
+            elif edge.protocol == 'uniswap v3':
+                calls.append(Call(edge.pool, ['slot0()((uint160,int24,uint16,uint16,uint16,uint8,bool))'], [[('state', i), None]]))
+            elif edge.protocol == 'curve':
+                coins = [convert.to_address(str(coin)) for coin in edge.extra.get_coins]
+                amount_in = 10 ** (decimals[edge.token_in] or 18)
+                calls.append(Call(edge.pool, ['get_dy(int128,int128,uint256)(uint256)', coins.index(edge.token_in), coins.index(edge.token_out), amount_in], [[('state', i), None]]))
+            elif edge.protocol == 'balancer v2':
+                vault, pool_id = edge.extra
+                calls.append(Call(vault, ['getPoolTokens(bytes32)((address[],uint256[],uint256))', HexBytes(pool_id)], [[('state', i), None]]))
+                calls.append(Call(edge.pool, ['getNormalizedWeights()(uint256[])'], [[('weights', i), None]]))
+            if edge.protocol != 'balancer v2':
+                calls.append(Call(edge.token_in, ['balanceOf(address)(uint256)', edge.pool], [[('depth', i), None]]))
+        results = aggregate(calls, block=block, require_success=False) if calls else {}
+
+        rates, depths = {}, {}
+        for i, edge in enumerate(hops):
+            decimals_in, decimals_out = decimals[edge.token_in], decimals[edge.token_out]
+            state = results.get(('state', i))
+            if state is None or decimals_in is None or decimals_out is None:
+                continue
+            try:
+                rate, depth = _rate_and_depth(edge, state, results.get(('weights', i)), decimals_in, decimals_out)
+            except (ValueError, ZeroDivisionError, IndexError):
+                continue
+            if rate:
+                rates[_key(edge)] = rate
+                depths[_key(edge)] = depth if depth is not None else results.get(('depth', i))
+        return rates, depths
+
+
+def _rate_and_depth(edge: Edge, state: Any, weights: Optional[List[int]], decimals_in: int, decimals_out: int) -> Tuple[Optional[float], Optional[int]]:
+    """
+    Returns how much `edge.token_out` one `edge.token_in` is worth, and the pool's balance of `edge.token_in` if `state` has it.
+    Uniswap pools sort their tokens by address, so `token0` is always the lower one.
+    """
+    scale_in, scale_out = 10 ** decimals_in, 10 ** decimals_out
+    is_token0 = int(edge.token_in, 16) < int(edge.token_out, 16)
+
+    if edge.protocol == 'uniswap v2':
+        reserve_in, reserve_out = (state[0], state[1]) if is_token0 else (state[1], state[0])
+        fee = edge.extra.fee or (997, 1000)
+        amount_out = get_amount_out(scale_in, reserve_in, reserve_out, fee)
+        if amount_out is None:
+            return None, reserve_in
+        # like `UniswapRouterV2.get_price`, we undo the fee but keep the price impact
+        return amount_out / scale_out / (fee[0] / fee[1]), reserve_in
+
+    if edge.protocol == 'uniswap v3':
+        sqrt_price_x96 = state[0]
+        if not sqrt_price_x96:
+            return None, None
+        # token1 per token0, in wei
+        price = (sqrt_price_x96 / 2 ** 96) ** 2
+        rate = price if is_token0 else 1 / price
+        return rate * scale_in / scale_out, None
+
+    if edge.protocol == 'curve':
+        return state / scale_out, None
+
+    if edge.protocol == 'balancer v2':
+        if not weights:
+            # not a weighted pool, we don't do the math for those yet
+            return None, None
+        tokens = [convert.to_address(str(token)) for token in state[0]]
+        i, j = tokens.index(edge.token_in), tokens.index(edge.token_out)
+        balances = state[1]
+        # the spot price of a weighted pool, without the swap fee
+        rate = (balances[j] / weights[j]) / (balances[i] / weights[i])
+        return rate * scale_in / scale_out, balances[i]
+
+    return None, None
+
+
+liquidity_graph = LiquidityGraph()
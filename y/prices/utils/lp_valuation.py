@@ -0,0 +1,134 @@
+import logging
+from typing import Dict, Iterable, List, NamedTuple, Optional, Tuple
+
+from hexbytes import HexBytes
+from multicall import Call
+from y import convert
+from y.constants import EEE_ADDRESS
+from y.datatypes import UsdPrice, UsdValue
+from y.decorators import log
+from y.prices import magic
+from y.prices.stable_swap.curve import CurvePool, curve
+from y.prices.utils.buckets import check_bucket
+from y.typing import Address, AnyAddressType, Block
+from y.utils.multicall import aggregate, multicall_decimals
+
+logger = logging.getLogger(__name__)
+
+"""
+Values many curve and balancer v2 LP tokens at once. Pricing LPs one at a time reads each pool's balances and then
+prices each coin serially. Instead we:
+1. read every pool's balances, supply and virtual price in one chunked multicall
+2. price every distinct coin once, with `magic.get_prices(batch=True)`
+3. work out each LP's TVL and price from those
+
+Anything we can't value this way, like balancer v1 pools, is left as None for the caller to price on its own.
+"""
+
+# the most coins a curve pool can hold
+_MAX_CURVE_COINS = 8
+
+
+class LpValuation(NamedTuple):
+    price: Optional[UsdPrice]
+    tvl: Optional[UsdValue]
+    # curve only
+    virtual_price: Optional[float] = None
+
+
+_NOT_VALUED = LpValuation(None, None)
+
+
+@log(logger)
+def value_lps(lp_tokens: Iterable[AnyAddressType], block: Optional[Block] = None) -> List[LpValuation]:
+    '''
+    Returns an `LpValuation` for each of `lp_tokens`, which can be curve LPs or balancer v2 pools.
+    '''
+    lp_tokens = [convert.to_address(token) for token in lp_tokens]
+    buckets = {token: check_bucket(token) for token in dict.fromkeys(lp_tokens)}
+    curve_pools = {token: curve.get_pool(token) for token, bucket in buckets.items() if bucket == 'curve lp' and curve}
+    curve_pools = {token: pool for token, pool in curve_pools.items() if pool is not None}
+    balancer_pools = [token for token, bucket in buckets.items() if bucket == 'balancer pool']
+
+    # {lp: [(coin, balance), ...]}, supplies and virtual prices
+    holdings, supplies, virtual_prices = _fetch_pool_state(curve_pools, balancer_pools, block)
+
+    coins = list({coin for pool_holdings in holdings.values() for coin, _ in pool_holdings})
+    decimals = dict(zip(coins + list(holdings), multicall_decimals(coins + list(holdings), block=block, return_None_on_failure=True)))
+    if EEE_ADDRESS in decimals:
+        # curve's placeholder for the gas coin
+        decimals[EEE_ADDRESS] = 18
+    prices = dict(zip(coins, magic.get_prices(coins, block, fail_to_None=True, silent=True, batch=True))) if coins else {}
+
+    valuations = {}
+    for lp, pool_holdings in holdings.items():
+        tvl = _tvl(pool_holdings, decimals, prices)
+        supply, lp_decimals = supplies.get(lp), decimals.get(lp)
+        price = None
+        if tvl is not None and supply and lp_decimals is not None:
+            price = UsdPrice(tvl / (supply / 10 ** lp_decimals))
+        valuations[lp] = LpValuation(price, tvl, virtual_prices.get(lp))
+    return [valuations.get(token, _NOT_VALUED) for token in lp_tokens]
+
+
+def _fetch_pool_state(
+    curve_pools: Dict[Address, CurvePool],
+    balancer_pools: List[Address],
+    block: Optional[Block],
+    ) -> Tuple[Dict[Address, List[Tuple[Address, int]]], Dict[Address, int], Dict[Address, float]]:
+
+    calls = []
+    for lp, pool in curve_pools.items():
+        calls.append(Call(pool.address, ['get_virtual_price()(uint256)'], [[('virtual_price', lp), None]]))
+        for i, _ in enumerate(pool.get_coins[:_MAX_CURVE_COINS]):
+            calls.append(Call(pool.address, ['balances(uint256)(uint256)', i], [[('balance', lp, i), None]]))
+    for lp in list(curve_pools) + balancer_pools:
+        calls.append(Call(lp, ['totalSupply()(uint256)'], [[('supply', lp), None]]))
+    for lp in balancer_pools:
+        calls.append(Call(lp, ['getPoolId()(bytes32)'], [[('pool_id', lp), None]]))
+        calls.append(Call(lp, ['getVault()(address)'], [[('vault', lp), None]]))
+    results = aggregate(calls, block=block, require_success=False) if calls else {}
+
+    holdings = {}
+    for lp, pool in curve_pools.items():
+        coins = [coin.address for coin in pool.get_coins[:_MAX_CURVE_COINS]]
+        balances = [results.get(('balance', lp, i)) for i in range(len(coins))]
+        if any(balance is None for balance in balances):
+            # older pools take an int128 index, `get_balances` knows how to handle those
+            try:
+                holdings[lp] = [(coin.address, balance * 10 ** coin.decimals) for coin, balance in pool.get_balances(block=block).items()]
+            except Exception as e:
+                logger.debug('could not fetch balances for %s: %s', pool, e)
+            continue
+        holdings[lp] = list(zip(coins, balances))
+
+    # balancer v2 pools keep their balances in the vault
+    pool_calls = []
+    for lp in balancer_pools:
+        pool_id, vault = results.get(('pool_id', lp)), results.get(('vault', lp))
+        if pool_id is None or vault is None:
+            # not a v2 pool
+            continue
+        pool_calls.append(Call(vault, ['getPoolTokens(bytes32)((address[],uint256[],uint256))', HexBytes(pool_id)], [[lp, None]]))
+    pool_tokens = aggregate(pool_calls, block=block, require_success=False) if pool_calls else {}
+    for lp, info in pool_tokens.items():
+        if info is None:
+            continue
+        tokens, balances, _ = info
+        # some pools hold their own BPT, which isn't part of their TVL
+        holdings[lp] = [(convert.to_address(token), balance) for token, balance in zip(tokens, balances) if convert.to_address(token) != lp]
+
+    supplies = {lp: results.get(('supply', lp)) for lp in holdings}
+    virtual_prices = {lp: results[('virtual_price', lp)] / 1e18 for lp in curve_pools if results.get(('virtual_price', lp)) is not None}
+    return holdings, supplies, virtual_prices
+
+
+def _tvl(holdings: List[Tuple[Address, int]], decimals: Dict[Address, Optional[int]], prices: Dict[Address, Optional[float]]) -> Optional[UsdValue]:
+    tvl = 0
+    for coin, balance in holdings:
+        if not balance:
+            continue
+        if decimals.get(coin) is None or not prices.get(coin):
+            return None
+        tvl += balance / 10 ** decimals[coin] * prices[coin]
+    return UsdValue(tvl)
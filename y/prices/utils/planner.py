@@ -0,0 +1,114 @@
+import logging
+from collections import defaultdict
+from typing import Dict, Iterable, List, Optional
+
+from brownie import chain
+from joblib.parallel import Parallel, delayed
+from tqdm import tqdm
+from y import convert
+from y.classes.common import ERC20
+from y.constants import EEE_ADDRESS
+from y.datatypes import UsdPrice
+from y.decorators import log
+from y.prices import magic, yearn
+from y.prices.chainlink import chainlink
+from y.prices.lending.compound import compound
+from y.prices.utils.buckets import check_buckets
+from y.prices.utils.lp_valuation import value_lps
+from y.prices.utils.sense_check import _sense_check
+from y.typing import Address, AnyAddressType, Block
+from y.utils import metrics
+from y.utils.multicall import multicall_same_func_no_input
+from y.utils.store import price_store
+
+logger = logging.getLogger(__name__)
+
+"""
+The planner prices a batch of tokens in phases instead of running one full call chain per token:
+1. classify every token, with the probes shared in one multicall
+2. group the tokens by bucket
+3. pull the inputs the buckets share (decimals, feed answers, exchange rates, share prices, LP balances) in one multicall per bucket
+4. compute prices, sending anything we couldn't price in bulk thru `magic.get_price`
+"""
+
+# buckets we know how to price many tokens at a time
+BULK_BUCKETS = {'balancer pool', 'chainlink feed', 'compound', 'curve lp', 'stable usd', 'yearn or yearn-like'}
+
+
+def get_prices(
+    token_addresses: Iterable[AnyAddressType],
+    block: Optional[Block] = None,
+    fail_to_None: bool = False,
+    silent: bool = False,
+    dop: int = 4
+    ) -> List[Optional[UsdPrice]]:
+    '''
+    Same interface and output as `magic.get_prices`, but collapses the per-token calls into shared multicalls.
+    '''
+    block = block or chain.height
+    token_addresses = [convert.to_address(token) for token in token_addresses]
+    tokens = list(dict.fromkeys(token_addresses))
+
+    # phase 1: classify
+    buckets = dict(zip(tokens, check_buckets(tokens)))
+
+    # phase 2: group
+    tokens_by_bucket = defaultdict(list)
+    for token, bucket in buckets.items():
+        tokens_by_bucket[bucket].append(token)
+    logger.debug(f'planned {len(tokens)} tokens in {len(tokens_by_bucket)} buckets')
+
+    # phase 3: shared inputs
+    _prefetch_decimals(tokens)
+
+    prices: Dict[Address, Optional[UsdPrice]] = {}
+    for bucket, bucket_tokens in tokens_by_bucket.items():
+        if bucket in BULK_BUCKETS:
+            with metrics.pricer(f'{bucket} [bulk]'):
+                prices.update(zip(bucket_tokens, _bulk_price(bucket, bucket_tokens, block)))
+    
+    for token, price in prices.items():
+        if price:
+            _sense_check(token, price)
+            # like `magic._get_price_or_None`, so finalized prices we computed in bulk aren't computed again
+            price_store.set_price(token, block, price)
+    
+    # phase 4: everything else
+    remaining = [token for token in tokens if not prices.get(token)]
+    prices.update(zip(remaining, Parallel(dop, 'threading')(
+        delayed(magic.get_price)(token, block, fail_to_None=fail_to_None, silent=silent)
+        for token in (remaining if silent else tqdm(remaining))
+    )))
+
+    return [prices[token] for token in token_addresses]
+
+
+@log(logger)
+def _bulk_price(
+    bucket: str,
+    token_addresses: List[Address],
+    block: Block
+    ) -> List[Optional[UsdPrice]]:
+
+    if bucket == 'balancer pool':           return [valuation.price for valuation in value_lps(token_addresses, block)]
+    elif bucket == 'chainlink feed':        return chainlink.get_prices(token_addresses, block)
+    elif bucket == 'compound':              return compound.get_prices(token_addresses, block)
+    elif bucket == 'curve lp':              return [valuation.price for valuation in value_lps(token_addresses, block)]
+    elif bucket == 'stable usd':            return [1 for _ in token_addresses]
+    elif bucket == 'yearn or yearn-like':   return yearn.get_prices(token_addresses, block)
+    raise ValueError(f'bucket {bucket} cannot be priced in bulk')
+
+
+@log(logger)
+def _prefetch_decimals(token_addresses: List[Address]) -> None:
+    '''
+    Loads `ERC20.decimals` for every token in one multicall so the pricers don't fetch them one by one.
+    '''
+    tokens = [ERC20(token) for token in token_addresses if token != EEE_ADDRESS]
+    tokens = [token for token in tokens if 'decimals' not in token.__dict__]
+    if not tokens:
+        return
+    decimals = multicall_same_func_no_input(tokens, 'decimals()(uint256)', return_None_on_failure=True)
+    for token, decimal in zip(tokens, decimals):
+        if decimal is not None:
+            token.__dict__['decimals'] = decimal
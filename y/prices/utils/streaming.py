@@ -0,0 +1,250 @@
+import logging
+import queue
+import threading
+from collections import defaultdict
+from typing import Callable, Dict, Iterable, Optional, Set, Tuple
+
+from brownie import chain, web3
+from y import convert
+from y.constants import WRAPPED_GAS_COIN
+from y.datatypes import UsdPrice
+from y.prices import magic
+from y.prices.chainlink import ANSWER_UPDATED, chainlink
+from y.prices.dex.uniswap import uniswap_multiplexer
+from y.prices.dex.uniswap.v2 import SYNC, UniswapPoolV2
+from y.prices.dex.uniswap.v3 import uniswap_v3
+from y.prices.stable_swap.curve import curve
+from y.prices.utils.buckets import check_bucket
+from y.typing import Address, AnyAddressType, Block
+
+logger = logging.getLogger(__name__)
+
+"""
+Streams the latest prices for a set of tokens, one update per new block.
+Instead of repricing every token every block, we watch the logs that move each token's price:
+`Sync` for uniswap v2 pools, `Swap` for uniswap v3 pools and `AnswerUpdated` for chainlink aggregators.
+Each token watches its own pools and aggregators plus those of every token it routes thru, so when WETH's price moves,
+every token quoted thru a WETH pool is repriced too. Tokens whose price can move without one of those logs,
+like curve and yearn tokens, are repriced every block.
+"""
+
+# uniswap v3 `Swap(address,address,int256,int256,uint160,uint128,int24)`
+SWAP_V3 = '0xc42079f94a6350d7e6235f29174924f928cc2ac818eb64fed8004e115fbcca67'
+
+WATCHED_TOPICS = [SYNC, SWAP_V3, ANSWER_UPDATED]
+
+# the max number of addresses we put in one `eth_getLogs` filter
+_ADDRESS_BATCH_SIZE = 500
+
+# how often we ask the node for new blocks, in seconds
+POLL_INTERVAL = 0.5
+
+# we reprice every token this often, for the ones whose prices move in ways we can't see in logs
+FULL_REFRESH_BLOCKS = 100
+
+PriceUpdates = Dict[Address, Optional[UsdPrice]]
+
+
+class PriceStream:
+    '''
+    Reprices `tokens` on every new block and emits `(block, {token: price})` with the prices that changed.
+    Pass `callback` to get updates on the streaming thread, or read them from `stream.updates`.
+
+    ```
+    stream = PriceStream(tokens)
+    stream.start()
+    block, prices = stream.updates.get()
+    ```
+    '''
+    def __init__(
+        self,
+        tokens: Iterable[AnyAddressType],
+        callback: Optional[Callable[[Block, PriceUpdates], None]] = None,
+        poll_interval: float = POLL_INTERVAL,
+        full_refresh_blocks: int = FULL_REFRESH_BLOCKS,
+    ) -> None:
+        self.tokens = list(dict.fromkeys(convert.to_address(token) for token in tokens))
+        self.callback = callback
+        self.poll_interval = poll_interval
+        self.full_refresh_blocks = full_refresh_blocks
+        self.updates: "queue.Queue[tuple]" = queue.Queue()
+        self.prices: PriceUpdates = {}
+        self.last_block: Optional[Block] = None
+        self._stop = threading.Event()
+        self._thread: Optional[threading.Thread] = None
+        self._watched: Dict[Address, Set[Address]] = defaultdict(set)
+        self._blind: Set[Address] = set()
+        self._last_full_refresh: Optional[Block] = None
+        self._index()
+
+    def __repr__(self) -> str:
+        return f"<PriceStream tokens={len(self.tokens)} watched={len(self._watched)} last_block={self.last_block}>"
+
+    def start(self) -> None:
+        """ Starts streaming on a daemon thread. """
+        self._stop.clear()
+        self._thread = threading.Thread(target=self.run, name='ypricemagic price stream', daemon=True)
+        self._thread.start()
+
+    def stop(self) -> None:
+        self._stop.set()
+        if self._thread is not None:
+            self._thread.join()
+
+    def run(self) -> None:
+        """ Streams until `stop` is called. """
+        new_heads = _new_heads()
+        while not self._stop.is_set():
+            try:
+                head = new_heads()
+                if head is not None and (self.last_block is None or head > self.last_block):
+                    self.process_block(head)
+            except Exception as e:
+                logger.warning('price stream failed at block %s: %s', self.last_block, e)
+            self._stop.wait(self.poll_interval)
+
+    def process_block(self, block: Block) -> PriceUpdates:
+        '''
+        Reprices what changed between `self.last_block` and `block`, emits the updates and returns them.
+        '''
+        if self.last_block is None or self._last_full_refresh is None or block - self._last_full_refresh >= self.full_refresh_blocks:
+            to_price = list(self.tokens)
+            self._last_full_refresh = block
+        else:
+            to_price = self._changed_tokens(self.last_block + 1, block) | self._blind
+        updates = self._reprice(to_price, block)
+
+        self.last_block = block
+        if updates:
+            if self.callback is not None:
+                self.callback(block, updates)
+            self.updates.put((block, updates))
+        return updates
+
+    def _index(self) -> None:
+        """ Builds `{watched address: tokens}` for every token we stream, and `_blind` for the ones we'd miss updates for. """
+        sources: Dict[Address, Tuple[Set[Address], bool]] = {}
+        for token in self.tokens:
+            addresses, blind = self._sources(token, sources, set())
+            for address in addresses:
+                self._watched[address].add(token)
+            if blind:
+                # we can't see every log that moves this one, so we reprice it every block
+                self._blind.add(token)
+
+    def _sources(self, token: Address, known: Dict[Address, Tuple[Set[Address], bool]], visiting: Set[Address]) -> Tuple[Set[Address], bool]:
+        '''
+        Returns `(addresses, blind)`: the addresses whose watched logs move `token`'s price, including the pools and aggregators
+        of the tokens it routes thru, and whether the pricer magic uses for `token` reads state we can't see in those logs.
+        '''
+        if token in known:
+            return known[token]
+        if token in visiting:
+            # the token we started from already covers the rest of this cycle
+            return set(), False
+        visiting.add(token)
+
+        addresses, blind = set(), False
+        bucket = check_bucket(token)
+        if bucket == 'stable usd':
+            pass
+        elif bucket == 'chainlink feed':
+            aggregators = {aggregator for _, aggregator in chainlink.aggregator_segments(token)[-1:] if aggregator}
+            addresses |= aggregators
+            blind = not aggregators
+        elif bucket == 'wrapped gas coin':
+            addresses, blind = self._sources(convert.to_address(WRAPPED_GAS_COIN), known, visiting)
+        elif bucket == 'uni or uni-like lp':
+            # an LP token logs its own `Sync`, and its price moves with the prices of its tokens
+            addresses.add(token)
+            for underlying in UniswapPoolV2(token).tokens:
+                underlying_addresses, underlying_blind = self._sources(convert.to_address(str(underlying)), known, visiting)
+                addresses |= underlying_addresses
+                blind |= underlying_blind
+        elif bucket is not None or (curve and token in curve.coin_to_pools):
+            # every other bucket, and curve's pricer for underlying coins, read state that doesn't log our topics
+            blind = True
+        else:
+            sources = self._uniswap_sources(token, known, visiting)
+            if sources is None:
+                # balancer and the liquidity graph price from state we don't watch
+                blind = True
+            else:
+                addresses, blind = sources
+
+        visiting.discard(token)
+        known[token] = addresses, blind
+        return addresses, blind
+
+    def _uniswap_sources(self, token: Address, known: Dict[Address, Tuple[Set[Address], bool]], visiting: Set[Address]) -> Optional[Tuple[Set[Address], bool]]:
+        """
+        magic prices the rest with uniswap v3 first, then with the deepest uniswap v2 router that quotes them.
+        Returns the sources of whichever of those prices `token` now, or None if neither does.
+        """
+        if uniswap_v3 and uniswap_v3.get_price(token):
+            pools = uniswap_v3.path_pools(token)
+            return pools, not pools
+        for router in uniswap_multiplexer.routers_by_depth(token):
+            if not router.get_price(token):
+                continue
+            pools, paired = router.path_pools(token)
+            addresses, blind = set(pools), not pools
+            for paired_with in paired:
+                # the router multiplies its quote by the paired token's price
+                paired_addresses, paired_blind = self._sources(paired_with, known, visiting)
+                addresses |= paired_addresses
+                blind |= paired_blind
+            return addresses, blind
+        return None
+
+    def _changed_tokens(self, from_block: Block, to_block: Block) -> Set[Address]:
+        addresses = list(self._watched)
+        changed = set()
+        for i in range(0, len(addresses), _ADDRESS_BATCH_SIZE):
+            logs = web3.eth.get_logs({
+                'address': addresses[i:i + _ADDRESS_BATCH_SIZE],
+                'topics': [WATCHED_TOPICS],
+                'fromBlock': from_block,
+                'toBlock': to_block,
+            })
+            for log in logs:
+                changed |= self._watched.get(convert.to_address(log['address']), set())
+        return changed
+
+    def _reprice(self, tokens: Iterable[Address], block: Block) -> PriceUpdates:
+        """ Reprices `tokens` at `block` and returns the ones that changed. """
+        tokens = list(tokens)
+        changed = {}
+        if not tokens:
+            return changed
+        for token, price in zip(tokens, magic.get_prices(tokens, block, fail_to_None=True, silent=True)):
+            if price != self.prices.get(token, ...):
+                self.prices[token] = price
+                changed[token] = price
+        return changed
+
+
+def _new_heads() -> Callable[[], Optional[Block]]:
+    '''
+    Returns a function that returns the latest block number, or None if there isn't a new one.
+    We use a block filter where the node supports one, which works over http, websockets and IPC alike.
+    '''
+    try:
+        block_filter = web3.eth.filter('latest')
+    except Exception as e:
+        logger.debug('node does not support block filters, polling chain.height instead: %s', e)
+        return lambda: chain.height
+
+    def poll() -> Optional[Block]:
+        nonlocal block_filter
+        try:
+            if not block_filter.get_new_entries():
+                return None
+        except ValueError as e:
+            if 'filter not found' not in str(e):
+                raise
+            # nodes drop filters that aren't polled for a while, we might have missed blocks so we check the head now
+            logger.debug('block filter expired, creating a new one')
+            block_filter = web3.eth.filter('latest')
+        return chain.height
+    return poll
@@ -1,8 +1,9 @@
 import logging
-from functools import cached_property, lru_cache
-from typing import Any, Optional
+from functools import cached_property
+from typing import Any, List, Optional
 
 from brownie import chain
+from multicall import Call, Multicall
 from y import Network
 from y.classes.common import ERC20, WeiBalance
 from y.contracts import Contract, has_method, has_methods, probe
@@ -10,8 +11,9 @@ from y.datatypes import UsdPrice
 from y.decorators import log
 from y.exceptions import (CantFetchParam, ContractNotVerified,
                           MessedUpBrownieContract)
+from y.prices import magic
 from y.typing import AnyAddressType, Block
-from y.utils.cache import memory
+from y.utils.cache import block_cache, memory
 from y.utils.raw_calls import raw_call
 
 logger = logging.getLogger(__name__)
@@ -49,22 +51,56 @@ def is_yearn_vault(token: AnyAddressType) -> bool:
     # pricePerShare can revert if totalSupply == 0, which would cause `has_methods` to return `False`,
     # but it might still be a vault. This section will correct `result` for problematic vaults.
     if result is False:
-        try: 
-            contract = Contract(token)
-            result = any([
-                hasattr(contract,'pricePerShare'),
-                hasattr(contract,'getPricePerShare'),
-                hasattr(contract,'getPricePerFullShare'),
-                hasattr(contract,'getSharesToUnderlying'),
-            ])
-        except (ContractNotVerified, MessedUpBrownieContract): pass
+        result = _is_yearn_vault_by_abi(token)
 
     return result
 
+def _is_yearn_vault_by_abi(token: AnyAddressType) -> bool:
+    try: 
+        contract = Contract(token)
+        return any([
+            hasattr(contract,'pricePerShare'),
+            hasattr(contract,'getPricePerShare'),
+            hasattr(contract,'getPricePerFullShare'),
+            hasattr(contract,'getSharesToUnderlying'),
+        ])
+    except (ContractNotVerified, MessedUpBrownieContract):
+        return False
+
 @log(logger)
 def get_price(token: AnyAddressType, block: Optional[Block] = None) -> UsdPrice:
     return YearnInspiredVault(token).price(block=block)
 
+@log(logger)
+def get_prices(tokens: List[AnyAddressType], block: Optional[Block] = None) -> List[Optional[UsdPrice]]:
+    '''
+    Returns `[get_price(token, block) for token in tokens]`.
+    Every vault's share price is probed in a single multicall and the underlyings are priced together.
+    Vaults we can't price this way return `None`.
+    '''
+    vaults = [YearnInspiredVault(token) for token in tokens]
+    underlyings = {}
+    for vault in vaults:
+        try: underlyings[vault] = vault.underlying
+        except (AssertionError, CantFetchParam): pass
+    
+    calls = [Call(vault.address, [method], [[(vault.address, method), None]]) for vault in underlyings for method in share_price_methods]
+    results = Multicall(calls, block_id=block, require_success=False)() if calls else {}
+    underlying_prices = dict(zip(underlyings.values(), magic.get_prices(list(underlyings.values()), block, fail_to_None=True, silent=True, batch=True)))
+
+    prices = []
+    for vault in vaults:
+        # we need exactly one response to know how to scale it, same as `probe`
+        responses = [(method, results[(vault.address, method)]) for method in share_price_methods if results.get((vault.address, method)) is not None]
+        if vault not in underlyings or len(responses) != 1 or not underlying_prices[underlyings[vault]]:
+            prices.append(None)
+            continue
+        method, share_price = responses[0]
+        # v1 vaults use getPricePerFullShare scaled to 18 decimals
+        share_price /= 1e18 if method == 'getPricePerFullShare()(uint)' else underlyings[vault].scale
+        prices.append(UsdPrice(share_price * underlying_prices[underlyings[vault]]))
+    return prices
+
 class YearnInspiredVault(ERC20):
     # v1 vaults use getPricePerFullShare scaled to 18 decimals
     # v2 vaults use pricePerShare scaled to underlying token decimals
@@ -106,7 +142,7 @@ class YearnInspiredVault(ERC20):
         else: raise CantFetchParam(f'underlying for {self.__repr__()}')
 
     @log(logger)
-    @lru_cache
+    @block_cache
     def share_price(self, block: Optional[Block] = None) -> Optional[float]:
         method, share_price = probe(self.address, share_price_methods, block=block, return_method=True)
 
@@ -132,6 +168,6 @@ class YearnInspiredVault(ERC20):
             raise CantFetchParam(f'share_price for {self.__repr__()}')
     
     @log(logger)
-    @lru_cache
+    @block_cache
     def price(self, block: Optional[Block] = None) -> UsdPrice:
         return UsdPrice(self.share_price(block=block) * self.underlying.price(block=block))
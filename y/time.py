@@ -1,55 +1,107 @@
 import datetime
 import logging
+from typing import Dict, Iterable, List
 
-from brownie import chain, web3
+from brownie import chain
 from y.decorators import log
-from y.utils.cache import memory
-from y.utils.client import get_ethereum_client
+from y.utils.client import get_ethereum_client, jsonrpc_batch
+from y.utils.store import timestamp_store
 
 logger = logging.getLogger(__name__)
 
+# the number of blocks we probe per round trip while searching for a timestamp
+SEARCH_PROBES = 16
+
 
 @log(logger)
-@memory.cache() 
 def get_block_timestamp(height: int) -> int:
-    client = get_ethereum_client()
-    if client in ['tg', 'erigon']:
-        header = web3.manager.request_blocking(f"{client}_getHeaderByNumber", [height])
-        return int(header.timestamp, 16)
-    else:
-        return chain[height].timestamp
+    return get_block_timestamps([height])[0]
+
+
+@log(logger)
+def get_block_timestamps(heights: Iterable[int]) -> List[int]:
+    """
+    Returns the timestamp for each block in `heights`.
+    Timestamps come from the `timestamp_store` where we have them, the rest are fetched in JSON-RPC batches.
+    """
+    heights = list(heights)
+    timestamps = timestamp_store.get_timestamps(heights)
+    missing = sorted({height for height in heights if height not in timestamps})
+    if missing:
+        fetched = _fetch_timestamps(missing)
+        timestamp_store.set_timestamps(fetched)
+        timestamps.update(fetched)
+    return [timestamps[height] for height in heights]
 
 
 @log(logger)
-@memory.cache() 
 def last_block_on_date(date_string: str) -> int:
-    logger.debug('last block on date %d', date_string)
+    logger.debug('last block on date %s', date_string)
     date = datetime.datetime.strptime(date_string, "%Y-%m-%d")
     date = date.date()
+    # like `datetime.date.fromtimestamp`, dates are in local time
+    next_day = datetime.datetime.combine(date + datetime.timedelta(days=1), datetime.time())
     height = chain.height
-    lo, hi = 0, height
-    while hi - lo > 1:
-        mid = lo + (hi - lo) // 2
-        logger.debug('block: ' + str(mid))
-        logger.debug('mid: ' + str(datetime.date.fromtimestamp(get_block_timestamp(mid))))
-        logger.debug(date)
-        if datetime.date.fromtimestamp(get_block_timestamp(mid)) > date:
-            hi = mid
-        else:
-            lo = mid
-    hi = hi - 1
+    hi = _first_block_after(int(next_day.timestamp()) - 1, height) - 1
     return hi if hi != height else None
 
 
-@memory.cache()
 def closest_block_after_timestamp(timestamp: int) -> int:
     logger.info('closest block after timestamp %d', timestamp)
     height = chain.height
+    hi = _first_block_after(timestamp, height)
+    return hi if hi != height else None
+
+
+def _first_block_after(timestamp: int, height: int) -> int:
+    """
+    Returns the first block in `(0, height]` with a timestamp after `timestamp`, or `height` if there isn't one.
+
+    We start from the closest blocks we already know on either side of `timestamp`. Each round trip then probes
+    `SEARCH_PROBES` blocks around an interpolated guess, plus the midpoint so we never do worse than a binary search.
+    """
     lo, hi = 0, height
+    before, after = timestamp_store.bracket(timestamp)
+    if before and before[0] < hi:
+        lo = max(lo, before[0])
+    if after and lo < after[0] <= height:
+        hi = after[0]
+    if hi - lo <= 1:
+        return hi
+
+    ts_lo, ts_hi = get_block_timestamps([lo, hi])
+    if ts_hi <= timestamp:
+        return hi
+
     while hi - lo > 1:
-        mid = lo + (hi - lo) // 2
-        if get_block_timestamp(mid) > timestamp:
-            hi = mid
-        else:
-            lo = mid
-    return hi if hi != height else None
+        guess = lo + (timestamp - ts_lo + 1) * (hi - lo) // max(ts_hi - ts_lo, 1)
+        step = max((hi - lo) // (SEARCH_PROBES * SEARCH_PROBES), 1)
+        probes = {guess + step * i for i in range(-SEARCH_PROBES // 2, SEARCH_PROBES // 2)}
+        probes.add(lo + (hi - lo) // 2)
+        probes = sorted({min(max(probe, lo + 1), hi - 1) for probe in probes})
+
+        for block, block_timestamp in zip(probes, get_block_timestamps(probes)):
+            if block_timestamp <= timestamp:
+                if block > lo:
+                    lo, ts_lo = block, block_timestamp
+            elif block < hi:
+                hi, ts_hi = block, block_timestamp
+    return hi
+
+
+def _fetch_timestamps(heights: List[int]) -> Dict[int, int]:
+    client = get_ethereum_client()
+    if client in ['tg', 'erigon']:
+        headers = jsonrpc_batch(f"{client}_getHeaderByNumber", [[height] for height in heights])
+    else:
+        headers = jsonrpc_batch("eth_getBlockByNumber", [[hex(height), False] for height in heights])
+
+    timestamps = {}
+    for height, header in zip(heights, headers):
+        if header is None:
+            # the node failed this one, brownie will retry
+            timestamps[height] = chain[height].timestamp
+            continue
+        timestamp = header['timestamp']
+        timestamps[height] = int(timestamp, 16) if isinstance(timestamp, str) else timestamp
+    return timestamps
@@ -0,0 +1,103 @@
+import asyncio
+import logging
+from concurrent.futures import ThreadPoolExecutor
+from functools import partial
+from typing import Any, Callable, Dict, List, Optional
+
+import aiohttp
+from brownie import web3
+from eth_utils import to_bytes
+from y.typing import Address, Block
+from y.utils.call_templates import call_template
+
+logger = logging.getLogger(__name__)
+
+"""
+An asyncio JSON-RPC client for the connected node.
+One aiohttp session per event loop holds up to `MAX_CONNECTIONS` keep-alive connections,
+so one process can keep hundreds of requests in flight instead of a handful of blocked threads.
+Only the calls made thru `AsyncRPC` get that. Multicalls and raw calls are still sync, so anything that needs them
+runs on one of `EXECUTOR_WORKERS` threads and is limited to that many at a time.
+"""
+
+# the max number of concurrent connections to the node, per event loop
+MAX_CONNECTIONS = 100
+
+# the number of threads used to run sync code from async functions
+EXECUTOR_WORKERS = 32
+
+_executor = ThreadPoolExecutor(EXECUTOR_WORKERS, thread_name_prefix='ypricemagic')
+
+
+async def run_in_executor(func: Callable, *args: Any, **kwargs: Any) -> Any:
+    """
+    Runs sync `func` on a worker thread, so it doesn't block the event loop.
+    """
+    return await asyncio.get_running_loop().run_in_executor(_executor, partial(func, *args, **kwargs))
+
+
+class AsyncRPC:
+    def __init__(self, max_connections: int = MAX_CONNECTIONS) -> None:
+        self.max_connections = max_connections
+        self._sessions: Dict[asyncio.AbstractEventLoop, aiohttp.ClientSession] = {}
+        self._ids = iter(range(1, 2**63))
+
+    def __repr__(self) -> str:
+        return f"<AsyncRPC max_connections={self.max_connections}>"
+
+    @property
+    def endpoint_uri(self) -> Optional[str]:
+        endpoint = getattr(web3.provider, 'endpoint_uri', None)
+        return endpoint if endpoint and endpoint.startswith('http') else None
+
+    async def request(self, method: str, params: List[Any]) -> Any:
+        '''
+        Sends one JSON-RPC request and returns its `result`.
+        Like web3, raises `ValueError` with the node's error if the request fails.
+        '''
+        # we can only do http asynchronously, for anything else we use web3 on a worker thread
+        if self.endpoint_uri is None:
+            return await run_in_executor(web3.manager.request_blocking, method, params)
+
+        request = {'jsonrpc': '2.0', 'id': next(self._ids), 'method': method, 'params': params}
+        async with self._session().post(self.endpoint_uri, json=request) as response:
+            response.raise_for_status()
+            response = await response.json(content_type=None)
+        if 'error' in response:
+            raise ValueError(response['error'])
+        return response['result']
+
+    async def get_block_number(self) -> Block:
+        return int(await self.request('eth_blockNumber', []), 16)
+
+    async def eth_call(self, address: Address, data: bytes, block: Optional[Block] = None) -> bytes:
+        params = [{'to': str(address), 'data': '0x' + data.hex()}, 'latest' if block is None else hex(block)]
+        return to_bytes(hexstr=await self.request('eth_call', params))
+
+    async def call(self, address: Address, method: str, *args: Any, block: Optional[Block] = None) -> Any:
+        '''
+        Calls `method` on `address`, where `method` is a multicall-style signature like `'balanceOf(address)(uint)'`.
+        Returns the decoded output, unpacked if there's only one return value.
+        '''
+        template = call_template(method)
+        output = await self.eth_call(address, template.encode(*args), block=block)
+        if not output:
+            raise ValueError('No data was returned - the call likely reverted')
+        return template.decode(output)
+
+    def _session(self) -> aiohttp.ClientSession:
+        # aiohttp sessions are bound to the loop they were created on
+        loop = asyncio.get_running_loop()
+        if loop not in self._sessions or self._sessions[loop].closed:
+            connector = aiohttp.TCPConnector(limit=self.max_connections)
+            timeout = aiohttp.ClientTimeout(total=600)
+            self._sessions[loop] = aiohttp.ClientSession(connector=connector, timeout=timeout)
+        return self._sessions[loop]
+
+    async def close(self) -> None:
+        session = self._sessions.pop(asyncio.get_running_loop(), None)
+        if session is not None:
+            await session.close()
+
+
+async_rpc = AsyncRPC()
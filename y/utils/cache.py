@@ -1,6 +1,18 @@
+import functools
+import inspect
+import sys
+import threading
+import time
+from collections import OrderedDict
+from typing import Any, Callable, Dict, Hashable, Iterator, Optional, Set, Tuple
+
 from brownie import chain
 from joblib import Memory
 from y.decorators import auto_retry
+from y.typing import Block
+from y.utils import metrics
+from y.utils.reorgs import reorg_tracker
+from y.utils.store import is_finalized
 
 
 @auto_retry
@@ -8,3 +20,204 @@ def _memory():
     return Memory(f"cache/{chain.id}", verbose=0)
 
 memory = _memory()
+
+
+"""
+`block_cache` is our in-memory cache for functions that take a block.
+Results at finalized blocks never change, so they're kept until the memory budget evicts them.
+Results at an unfinalized block are keyed by the block's hash, so a reorg can't serve them, and are dropped when one happens.
+Results for the latest block expire after `LATEST_TTL` seconds.
+Every `block_cache` function shares one LRU under `CACHE_MAX_BYTES`, so a busy exporter can't grow without bound.
+"""
+
+# the approximate memory budget shared by every `block_cache` function
+CACHE_MAX_BYTES = 512 * 1024 * 1024
+
+# how long we keep results for `block=None`, in seconds
+LATEST_TTL = 60
+
+# the rough cost of an entry's bookkeeping, on top of its key and value
+_ENTRY_OVERHEAD = 200
+
+_NOT_FOUND = object()
+
+
+class CacheStats:
+    def __init__(self) -> None:
+        self.hits = 0
+        self.misses = 0
+        self.expired = 0
+        self.evictions = 0
+
+    def __repr__(self) -> str:
+        return f"<CacheStats hits={self.hits} misses={self.misses} expired={self.expired} evictions={self.evictions}>"
+
+    def as_dict(self) -> Dict[str, int]:
+        return {'hits': self.hits, 'misses': self.misses, 'expired': self.expired, 'evictions': self.evictions}
+
+
+class BlockCache:
+    """ The LRU behind `block_cache`. Each value is stored as `(value, size, expires_at, stats, block_hash)`. """
+    def __init__(self, max_bytes: int = CACHE_MAX_BYTES) -> None:
+        self.max_bytes = max_bytes
+        self.size = 0
+        self.stats: Dict[str, CacheStats] = {}
+        self._entries: OrderedDict = OrderedDict()
+        # `{block_hash: keys}` for the entries at unfinalized blocks, so a reorg only touches its own entries
+        self._by_hash: Dict[str, Set[Hashable]] = {}
+        self._lock = threading.Lock()
+
+    def __repr__(self) -> str:
+        return f"<BlockCache entries={len(self._entries)} size={self.size} max_bytes={self.max_bytes}>"
+
+    def get(self, key: Hashable, stats: CacheStats) -> Any:
+        with self._lock:
+            entry = self._entries.get(key)
+            if entry is None:
+                stats.misses += 1
+                return _NOT_FOUND
+            value, size, expires_at, _, _ = entry
+            if expires_at is not None and expires_at < time.monotonic():
+                self._pop(key)
+                stats.expired += 1
+                stats.misses += 1
+                return _NOT_FOUND
+            self._entries.move_to_end(key)
+            stats.hits += 1
+            return value
+
+    def set(self, key: Hashable, value: Any, ttl: Optional[float], stats: CacheStats, block_hash: Optional[str] = None) -> None:
+        """ Pass `block_hash` for results at an unfinalized block, so `drop_block_hashes` can find them. """
+        size = _ENTRY_OVERHEAD + _sizeof(key) + _sizeof(value)
+        expires_at = None if ttl is None else time.monotonic() + ttl
+        with self._lock:
+            if key in self._entries:
+                self._pop(key)
+            self._entries[key] = (value, size, expires_at, stats, block_hash)
+            if block_hash is not None:
+                self._by_hash.setdefault(block_hash, set()).add(key)
+            self.size += size
+            self._evict()
+
+    def clear(self) -> None:
+        with self._lock:
+            self._entries.clear()
+            self._by_hash.clear()
+            self.size = 0
+
+    def drop_block_hashes(self, block: Block, stale_hashes: Set[str]) -> None:
+        """ Drops every entry keyed by one of `stale_hashes`. `ReorgTracker` calls this after a reorg. """
+        with self._lock:
+            for block_hash in stale_hashes:
+                for key in list(self._by_hash.get(block_hash, ())):
+                    self._pop(key)
+
+    def _pop(self, key: Hashable) -> None:
+        _, size, _, _, block_hash = self._entries.pop(key)
+        self.size -= size
+        self._unindex(key, block_hash)
+
+    def _evict(self) -> None:
+        # least recently used first. Caller holds the lock.
+        while self.size > self.max_bytes and self._entries:
+            key, (_, size, _, stats, block_hash) = self._entries.popitem(last=False)
+            self.size -= size
+            self._unindex(key, block_hash)
+            stats.evictions += 1
+
+    def _unindex(self, key: Hashable, block_hash: Optional[str]) -> None:
+        if block_hash is None:
+            return
+        keys = self._by_hash[block_hash]
+        keys.discard(key)
+        if not keys:
+            del self._by_hash[block_hash]
+
+
+_cache = BlockCache()
+reorg_tracker.on_reorg(_cache.drop_block_hashes)
+
+
+def block_cache(func: Callable) -> Callable:
+    '''
+    Caches `func`, which must take a `block` argument, in the shared `BlockCache`.
+    Results at finalized blocks are kept until evicted, results at unfinalized blocks until they're evicted or reorged,
+    and results for the latest block expire after `LATEST_TTL`.
+    Calls with unhashable arguments aren't cached.
+    '''
+    name = func.__qualname__
+    stats = _cache.stats.setdefault(name, CacheStats())
+    params = list(inspect.signature(func).parameters.values())
+    block_index = next((i for i, param in enumerate(params) if param.name == 'block'), None)
+    if block_index is None:
+        raise ValueError(f'{name} has no `block` argument, use `lru_cache` instead')
+    block_default = params[block_index].default
+
+    def key_and_ttl(args: Tuple[Any, ...], kwargs: Dict[str, Any]) -> Tuple[Optional[tuple], Optional[float], Optional[str]]:
+        """ Returns `(key, ttl, block_hash)`, where `block_hash` is the hash we keyed an unfinalized block by. """
+        if 'block' in kwargs:
+            block = kwargs['block']
+        else:
+            block = args[block_index] if len(args) > block_index else block_default
+        key = (name, args, tuple(sorted(kwargs.items())) if kwargs else ())
+        try:
+            hash(key)
+        except TypeError:
+            return None, None, None
+
+        if not isinstance(block, int):
+            return key, LATEST_TTL, None
+        if is_finalized(block):
+            return key, None, None
+        block_hash = reorg_tracker.block_hash(block)
+        return key + (block_hash,), None, block_hash
+
+    @functools.wraps(func)
+    def wrapper(*args: Any, **kwargs: Any) -> Any:
+        key, ttl, block_hash = key_and_ttl(args, kwargs)
+        if key is None:
+            return func(*args, **kwargs)
+        value = _cache.get(key, stats)
+        if value is _NOT_FOUND:
+            value = func(*args, **kwargs)
+            _cache.set(key, value, ttl, stats, block_hash)
+        return value
+
+    def prime(value: Any, *args: Any, **kwargs: Any) -> None:
+        """ Caches `value` as the result of `func(*args, **kwargs)`, for results we computed some other way. """
+        key, ttl, block_hash = key_and_ttl(args, kwargs)
+        if key is not None:
+            _cache.set(key, value, ttl, stats, block_hash)
+
+    wrapper.cache_stats = lambda: stats.as_dict()
+    wrapper.prime = prime
+    return wrapper
+
+
+def cache_stats() -> Dict[str, Dict[str, int]]:
+    """ Returns `{function: {'hits': ..., 'misses': ..., 'expired': ..., 'evictions': ...}}` for every `block_cache` function. """
+    return {name: stats.as_dict() for name, stats in _cache.stats.items()}
+
+
+def _sizeof(obj: Any) -> int:
+    """ A rough size for `obj`. We look one level into containers, which is enough for the tuples and lists we cache. """
+    size = sys.getsizeof(obj)
+    if isinstance(obj, (tuple, list, set, frozenset)):
+        size += sum(sys.getsizeof(item) for item in obj)
+    elif isinstance(obj, dict):
+        size += sum(sys.getsizeof(k) + sys.getsizeof(v) for k, v in obj.items())
+    return size
+
+
+def _collect_metrics() -> Iterator[metrics.Sample]:
+    for name, stats in cache_stats().items():
+        labels = {'function': name}
+        for stat, value in stats.items():
+            yield f'block_cache_{stat}_total', 'counter', labels, value
+        lookups = stats['hits'] + stats['misses']
+        yield 'block_cache_hit_ratio', 'gauge', labels, stats['hits'] / lookups if lookups else 0
+    yield 'block_cache_bytes', 'gauge', {}, _cache.size
+    yield 'block_cache_entries', 'gauge', {}, len(_cache._entries)
+
+
+metrics.add_collector(_collect_metrics)
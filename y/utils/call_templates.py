@@ -0,0 +1,205 @@
+import logging
+from functools import lru_cache
+from typing import Any, Callable, Dict, List, Optional, Sequence, Tuple
+
+from eth_abi import decode_abi, encode_abi
+from eth_utils import function_signature_to_4byte_selector as fourbyte
+from eth_utils import to_checksum_address
+
+logger = logging.getLogger(__name__)
+
+"""
+Compiled call templates. Hashing a selector and building an ABI coder costs more CPU than the rest of a warm-cache
+call, so we do it once per signature and reuse the result. Calls whose arguments and return values are all
+static 32 byte words, ie `balanceOf(address)(uint256)`, skip eth_abi entirely.
+"""
+
+# the types we can encode and decode by slicing 32 byte words
+_STATIC_WORD_PREFIXES = ('uint', 'int', 'address', 'bool', 'bytes32')
+
+
+class CallTemplate:
+    def __init__(self, function: str, output_types: Sequence[str] = ()) -> None:
+        self.function = function
+        self.input_types = _split_types(function[function.index('(') + 1:-1])
+        self.output_types = tuple(output_types)
+        self.selector = fourbyte(function)
+        self._static_inputs = all(_is_static_word(type_) for type_ in self.input_types)
+        self._word_decoders = _word_decoders(self.output_types)
+
+    def __repr__(self) -> str:
+        return f"<CallTemplate {self.function}({','.join(self.output_types)})>"
+
+    @property
+    def is_static(self) -> bool:
+        """ True if we can decode this call's output without eth_abi. """
+        return self._word_decoders is not None
+
+    @property
+    def output_kinds(self) -> Optional[Tuple[str, ...]]:
+        """ The kind of each output word, ie `'uint'` or `'address'`, or None if the outputs aren't all static words. """
+        return tuple(_word_kind(type_) for type_ in self.output_types) if self.is_static else None
+
+    @property
+    def has_static_inputs(self) -> bool:
+        """ True if we can encode this call's inputs without eth_abi. """
+        return self._static_inputs
+
+    def can_encode(self, args: Sequence[Any]) -> bool:
+        """
+        True if we can encode `args` without eth_abi or brownie. Inputs brownie would convert first,
+        ie `'1 ether'` or a `Wei` string, need brownie's encoder.
+        """
+        return (
+            self._static_inputs
+            and len(args) == len(self.input_types)
+            and all(_is_plain_word(type_, arg) for type_, arg in zip(self.input_types, args))
+        )
+
+    def encode(self, *args: Any) -> bytes:
+        if len(args) != len(self.input_types):
+            raise ValueError(f'{self.function} takes {len(self.input_types)} args, you passed {len(args)}')
+        if not args:
+            return self.selector
+        if self.can_encode(args):
+            return self.selector + b''.join(_encode_word(type_, arg) for type_, arg in zip(self.input_types, args))
+        return self.selector + encode_abi(self.input_types, [_normalize_arg(type_, arg) for type_, arg in zip(self.input_types, args)])
+
+    def decode(self, data: bytes) -> Any:
+        '''
+        Decodes `data` returned by this call. A single output is returned unwrapped, several as a tuple.
+        Raises `ValueError` if `data` is too short.
+        '''
+        if self._word_decoders is not None:
+            if len(data) < 32 * len(self._word_decoders):
+                raise ValueError(f'{self.function} returned {len(data)} bytes, expected {32 * len(self._word_decoders)}')
+            decoded = tuple(decoder(data[32 * i:32 * (i + 1)]) for i, decoder in enumerate(self._word_decoders))
+        else:
+            decoded = tuple(decode_abi(self.output_types, data))
+        return decoded[0] if len(decoded) == 1 else decoded
+
+
+@lru_cache(maxsize=None)
+def call_template(signature: str, output_types: Optional[Tuple[str, ...]] = None) -> CallTemplate:
+    """
+    Returns the `CallTemplate` for `signature`. Pass a multicall style signature like `'balanceOf(address)(uint256)'`,
+    or a function signature like `'balanceOf(address)'` with `output_types`.
+    """
+    function, outputs = _split_signature(signature)
+    if output_types is None:
+        output_types = _split_types(outputs[1:-1]) if outputs else ()
+    return CallTemplate(function, output_types)
+
+
+@lru_cache(maxsize=None)
+def selector(function: str) -> bytes:
+    """ Returns the 4 byte selector for a function signature like `'balanceOf(address)'`. """
+    return fourbyte(function)
+
+
+def decode_many(templates: List[CallTemplate], results: List[Tuple[bool, bytes]]) -> List[Optional[Any]]:
+    '''
+    Decodes `(success, data)` pairs as returned by `tryAggregate`. Failed or undecodable calls are None.
+    '''
+    decoded = []
+    for template, (success, data) in zip(templates, results):
+        if not success:
+            decoded.append(None)
+            continue
+        try:
+            decoded.append(template.decode(data))
+        except Exception:
+            decoded.append(None)
+    return decoded
+
+
+def _split_signature(signature: str) -> Tuple[str, str]:
+    """ Splits `'name(inputs)(outputs)'` into `('name(inputs)', '(outputs)')`. """
+    depth = 0
+    for i, char in enumerate(signature):
+        if char == '(':
+            depth += 1
+        elif char == ')':
+            depth -= 1
+            if depth == 0:
+                return signature[:i + 1], signature[i + 1:]
+    raise ValueError(f'invalid signature: {signature}')
+
+
+def _split_types(types: str) -> Tuple[str, ...]:
+    """ Splits `'uint256,(address,uint256)[]'` on its top level commas. """
+    split, depth, start = [], 0, 0
+    for i, char in enumerate(types):
+        if char == '(':
+            depth += 1
+        elif char == ')':
+            depth -= 1
+        elif char == ',' and depth == 0:
+            split.append(types[start:i])
+            start = i + 1
+    if types[start:]:
+        split.append(types[start:])
+    return tuple(split)
+
+
+def _is_static_word(type_: str) -> bool:
+    return type_.startswith(_STATIC_WORD_PREFIXES) and '[' not in type_ and '(' not in type_
+
+
+def _word_decoders(output_types: Tuple[str, ...]) -> Optional[List[Callable[[bytes], Any]]]:
+    if not output_types or not all(_is_static_word(type_) for type_ in output_types):
+        return None
+    return [_WORD_DECODERS[_word_kind(type_)] for type_ in output_types]
+
+
+def _word_kind(type_: str) -> str:
+    for kind in ('uint', 'int', 'address', 'bool', 'bytes32'):
+        if type_.startswith(kind):
+            return kind
+    raise ValueError(type_)
+
+
+@lru_cache(maxsize=100_000)
+def _decode_address(word: bytes) -> str:
+    return to_checksum_address(word[12:])
+
+
+_WORD_DECODERS: Dict[str, Callable[[bytes], Any]] = {
+    'uint': lambda word: int.from_bytes(word, 'big'),
+    'int': lambda word: int.from_bytes(word, 'big', signed=True),
+    'address': _decode_address,
+    'bool': lambda word: word[-1] == 1,
+    'bytes32': bytes,
+}
+
+
+def _encode_word(type_: str, arg: Any) -> bytes:
+    kind = _word_kind(type_)
+    if kind == 'address':
+        return bytes(12) + bytes.fromhex(str(arg)[2:])
+    if kind == 'bytes32':
+        arg = bytes.fromhex(arg[2:]) if isinstance(arg, str) else bytes(arg)
+        return arg.ljust(32, b'\x00')
+    return int(arg).to_bytes(32, 'big', signed=kind == 'int')
+
+
+def _is_plain_word(type_: str, arg: Any) -> bool:
+    """ True if `arg` is already an int, bytes or address we can pack into a word as is. """
+    kind = _word_kind(type_)
+    if kind == 'address':
+        address = str(arg)
+        return len(address) == 42 and address[:2] == '0x'
+    if kind == 'bytes32':
+        return isinstance(arg, bytes) and len(arg) <= 32 or isinstance(arg, str) and len(arg) == 66 and arg[:2] == '0x'
+    if kind == 'bool':
+        return isinstance(arg, bool)
+    return isinstance(arg, int) and not isinstance(arg, bool)
+
+
+def _normalize_arg(type_: str, arg: Any) -> Any:
+    # eth_abi wants plain strings for addresses, not brownie Contracts or our ContractBase
+    if type_ == 'address':
+        return to_checksum_address(str(arg))
+    if type_ == 'address[]':
+        return [to_checksum_address(str(a)) for a in arg]
+    return arg
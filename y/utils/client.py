@@ -1,11 +1,19 @@
 import logging
+import time
+from operator import itemgetter
+from typing import Any, List, Optional, Union
 
+import requests
 from brownie import web3
 from cachetools.func import lru_cache
-from y.decorators import log
+from y.decorators import auto_retry, log
+from y.utils import metrics
 
 logger = logging.getLogger(__name__)
 
+# max number of requests we send to the node in a single JSON-RPC batch
+JSONRPC_BATCH_SIZE = 100
+
 @log(logger)
 @lru_cache(1)
 def get_ethereum_client() -> str:
@@ -18,3 +26,53 @@ def get_ethereum_client() -> str:
         return 'geth'
     logger.debug(f"client: {client}")
     return client
+
+
+@log(logger)
+def jsonrpc_batch(method: str, params: List[List[Any]]) -> List[Optional[Any]]:
+    """
+    Sends one `method` request per item in `params` using JSON-RPC batches of `JSONRPC_BATCH_SIZE`.
+    Returns the raw `result` for each request, in order, or `None` where the node returned an error.
+    Falls back to sequential requests for providers without an http endpoint, ie IPCProvider,
+    and for any batch the node rejects as a whole.
+    """
+    endpoint = getattr(web3.provider, 'endpoint_uri', None)
+    if not endpoint or not endpoint.startswith('http'):
+        return _request_each(method, params)
+
+    results = []
+    for i in range(0, len(params), JSONRPC_BATCH_SIZE):
+        chunk = params[i:i+JSONRPC_BATCH_SIZE]
+        batch = [{'jsonrpc': '2.0', 'id': id, 'method': method, 'params': param} for id, param in enumerate(chunk)]
+        start = time.perf_counter()
+        response = _post_jsonrpc_batch(endpoint, batch)
+        seconds = time.perf_counter() - start
+
+        if isinstance(response, dict):
+            # one error for the whole batch, ie the node doesn't support batches or this one is too big
+            metrics.record_rpc(method, seconds, error=True)
+            logger.debug('node rejected a batch of %d %s requests, sending them one by one: %s', len(chunk), method, response.get('error'))
+            results.extend(_request_each(method, chunk))
+            continue
+
+        # batches skip the middleware, so we count their requests here. each gets an equal share of the round trip.
+        for res in response:
+            metrics.record_rpc(method, seconds / len(response), error='error' in res)
+        results.extend(res.get('result') for res in sorted(response, key=itemgetter('id')))
+    return results
+
+
+def _request_each(method: str, params: List[List[Any]]) -> List[Optional[Any]]:
+    """ Sends each request thru web3, and so thru our middleware. """
+    results = []
+    for param in params:
+        try: results.append(web3.manager.request_blocking(method, param))
+        except ValueError: results.append(None)
+    return results
+
+
+@auto_retry
+def _post_jsonrpc_batch(endpoint: str, batch: List[dict]) -> Union[List[dict], dict]:
+    response = requests.post(endpoint, json=batch)
+    response.raise_for_status()
+    return response.json()
@@ -0,0 +1,205 @@
+import logging
+import re
+from functools import lru_cache
+from typing import Any, Callable, Dict, Iterator, List, Optional, Tuple
+
+from eth_utils import encode_hex, keccak, to_checksum_address
+from hexbytes import HexBytes
+from web3.types import LogReceipt
+
+logger = logging.getLogger(__name__)
+
+"""
+Decoders for the hot, fixed-shape events we scan the most, keyed by topic0.
+brownie's `_decode_logs` needs each contract's ABI in its deployments db and builds its event objects one attribute
+at a time. For these events we already know the layout, so we read the topics and data words straight into a tuple.
+
+Add an event with `register('EventName(type indexed name, type name, ...)')`.
+Logs whose topic0 we don't know, or that don't match the registered layout, return None so the caller can fall back to brownie.
+"""
+
+_WORD = 32
+
+_PARAM = re.compile(r'^\s*(?P<type>[a-z0-9\[\]]+)(?P<indexed>\s+indexed)?(?:\s+(?P<name>\w+))?\s*$')
+
+
+class FastEvent:
+    """ A decoded log, with the same lookups we use on brownie's events. """
+    __slots__ = 'name', 'address', 'block_number', 'transaction_hash', 'log_index', '_fields', '_values'
+
+    def __init__(self, name: str, fields: Tuple[str, ...], values: Tuple[Any, ...], log: LogReceipt) -> None:
+        self.name = name
+        self.address = log.get('address')
+        self.block_number = log.get('blockNumber')
+        self.transaction_hash = log.get('transactionHash')
+        self.log_index = log.get('logIndex')
+        self._fields = fields
+        self._values = values
+
+    def __repr__(self) -> str:
+        return f"<FastEvent {self.name} {dict(self.items())}>"
+
+    def __getitem__(self, key: Any) -> Any:
+        if isinstance(key, int):
+            return self._values[key]
+        try:
+            return self._values[self._fields.index(key)]
+        except ValueError:
+            raise KeyError(key) from None
+
+    def __contains__(self, key: str) -> bool:
+        return key in self._fields
+
+    def __iter__(self) -> Iterator[str]:
+        return iter(self._fields)
+
+    def __len__(self) -> int:
+        return len(self._fields)
+
+    def keys(self) -> Tuple[str, ...]:
+        return self._fields
+
+    def values(self) -> Tuple[Any, ...]:
+        return self._values
+
+    def items(self) -> List[Tuple[str, Any]]:
+        return list(zip(self._fields, self._values))
+
+
+class EventDecoder:
+    """ Decodes one event's logs without an ABI. Built once per event by `register`. """
+    def __init__(self, signature: str) -> None:
+        match = re.match(r'^\s*(\w+)\s*\((.*)\)\s*$', signature)
+        if match is None:
+            raise ValueError(f'cannot parse event signature {signature}')
+        self.name = match.group(1)
+        params = []
+        for param in filter(None, match.group(2).split(',')):
+            parsed = _PARAM.match(param)
+            if parsed is None:
+                raise ValueError(f'cannot parse event param {param} in {signature}')
+            params.append((parsed['type'], bool(parsed['indexed']), parsed['name'] or ''))
+
+        self.signature = f"{self.name}({','.join(type_ for type_, _, _ in params)})"
+        self.topic = encode_hex(keccak(text=self.signature))
+        self.fields = tuple(name for _, _, name in params)
+        self.num_topics = 1 + sum(indexed for _, indexed, _ in params)
+        # (read from topics?, topic or data word index, converter, dynamic?) for each param, in signature order
+        self._readers = []
+        topic_index, word_index = 1, 0
+        for type_, indexed, _ in params:
+            if indexed:
+                # dynamic types are hashed when indexed, so we can only hand back the hash
+                converter = HexBytes if type_ in _DYNAMIC else _CONVERTERS.get(type_, HexBytes)
+                self._readers.append((True, topic_index, converter, False))
+                topic_index += 1
+            else:
+                if type_ not in _CONVERTERS and type_ not in _DYNAMIC:
+                    raise ValueError(f'{type_} is not supported, decode {self.name} with brownie instead')
+                self._readers.append((False, word_index, _DYNAMIC.get(type_) or _CONVERTERS[type_], type_ in _DYNAMIC))
+                word_index += 1
+        self.num_words = word_index
+
+    def __repr__(self) -> str:
+        return f"<EventDecoder {self.signature}>"
+
+    def decode(self, log: LogReceipt) -> Optional[Tuple[Any, ...]]:
+        """ Returns the event's args as a tuple, or None if `log` doesn't match this event's layout. """
+        topics = log['topics']
+        if len(topics) != self.num_topics:
+            # a different event with the same topic0, like an erc721 Transfer
+            return None
+        data = to_bytes(log['data'])
+        if len(data) < self.num_words * _WORD:
+            return None
+        values = []
+        for from_topics, i, converter, dynamic in self._readers:
+            if from_topics:
+                values.append(converter(to_bytes(topics[i])))
+            elif dynamic:
+                offset = int.from_bytes(data[i * _WORD:(i + 1) * _WORD], 'big')
+                length = int.from_bytes(data[offset:offset + _WORD], 'big')
+                values.append(converter(data[offset + _WORD:offset + _WORD + length]))
+            else:
+                values.append(converter(data[i * _WORD:(i + 1) * _WORD]))
+        return tuple(values)
+
+    def decode_event(self, log: LogReceipt) -> Optional[FastEvent]:
+        values = self.decode(log)
+        return None if values is None else FastEvent(self.name, self.fields, values, log)
+
+
+@lru_cache(maxsize=1_000_000)
+def _address(word: bytes) -> str:
+    return to_checksum_address(word[-20:])
+
+
+def _uint(word: bytes) -> int:
+    return int.from_bytes(word, 'big')
+
+
+def _int(word: bytes) -> int:
+    return int.from_bytes(word, 'big', signed=True)
+
+
+def to_bytes(value: Any) -> bytes:
+    """ Log topics and data come back as hex strings or bytes depending on the provider and web3 version. """
+    if isinstance(value, str):
+        return bytes.fromhex(value[2:] if value.startswith('0x') else value)
+    return bytes(value)
+
+
+_CONVERTERS: Dict[str, Callable[[bytes], Any]] = {
+    'address': _address,
+    'bool': lambda word: bool(_uint(word)),
+    'bytes32': HexBytes,
+    **{f'uint{bits}': _uint for bits in range(8, 257, 8)},
+    **{f'int{bits}': _int for bits in range(8, 257, 8)},
+}
+_CONVERTERS['uint'], _CONVERTERS['int'] = _uint, _int
+
+_DYNAMIC: Dict[str, Callable[[bytes], Any]] = {
+    'bytes': HexBytes,
+    'string': lambda value: value.decode('utf-8', errors='replace'),
+}
+
+# {topic0: [decoders]}. More than one event can share a topic0 if only indexing differs.
+_decoders: Dict[str, List[EventDecoder]] = {}
+
+
+def register(signature: str) -> EventDecoder:
+    """ Adds a fast decoder for the event described by `signature`, like `Transfer(address indexed from, address indexed to, uint256 value)`. """
+    decoder = EventDecoder(signature)
+    _decoders.setdefault(decoder.topic, []).append(decoder)
+    return decoder
+
+
+def decode_log(log: LogReceipt) -> Optional[FastEvent]:
+    """ Returns `log` decoded as a `FastEvent`, or None if we don't have a decoder that fits it. """
+    if not log['topics']:
+        return None
+    topic = log['topics'][0]
+    decoders = _decoders.get(topic.lower() if isinstance(topic, str) else encode_hex(topic))
+    if decoders is None:
+        return None
+    for decoder in decoders:
+        event = decoder.decode_event(log)
+        if event is not None:
+            return event
+    return None
+
+
+register('Transfer(address indexed from, address indexed to, uint256 value)')
+# some old tokens don't index their Transfer args
+register('Transfer(address from, address to, uint256 value)')
+register('PairCreated(address indexed token0, address indexed token1, address pair, uint256)')
+register('PoolCreated(address indexed token0, address indexed token1, uint24 indexed fee, int24 tickSpacing, address pool)')
+register('Sync(uint112 reserve0, uint112 reserve1)')
+register('PoolRegistered(bytes32 indexed poolId, address indexed poolAddress, uint8 specialization)')
+# curve registry and address provider
+register('PoolAdded(address indexed pool, bytes rate_method_id)')
+register('NewAddressIdentifier(uint256 indexed id, address addr, string description)')
+register('AddressModified(uint256 indexed id, address new_address, uint256 version)')
+# chainlink feed registry and aggregators
+register('FeedConfirmed(address indexed asset, address indexed denomination, address indexed latestAggregator, address previousAggregator, uint16 nextPhaseId, address sender)')
+register('AnswerUpdated(int256 indexed current, uint256 indexed roundId, uint256 updatedAt)')
@@ -1,34 +1,41 @@
+import json
 import logging
-from collections import Counter, defaultdict
-from itertools import zip_longest
-from typing import Any, Dict, List, Optional
+import threading
+from collections import defaultdict, deque
+from concurrent.futures import ThreadPoolExecutor
+from itertools import islice, zip_longest
+from typing import Any, Dict, Iterable, Iterator, List, Optional, Tuple
 
+import numpy as np
 from brownie import chain, web3
-from brownie.convert.datatypes import EthAddress
-from brownie.network.event import EventDict, _decode_logs
+from brownie.convert.datatypes import EthAddress, HexBytes
+from brownie.network.event import _decode_logs
 from eth_typing import ChecksumAddress
-from joblib import Parallel, delayed
-from toolz import groupby
-from web3.middleware.filter import block_ranges
 from web3.types import LogReceipt
-from y.contracts import contract_creation_block
+from y.contracts import contract_creation_block, contract_creation_blocks
 from y.decorators import auto_retry
 from y.typing import Address, Block
-from y.utils.cache import memory
+from y.utils.decoders import decode_log, to_bytes
 from y.utils.middleware import BATCH_SIZE
+from y.utils.store import last_finalized_block, log_store
 
 logger = logging.getLogger(__name__)
 
 
-def decode_logs(logs: List[LogReceipt]) -> EventDict:
+def decode_logs(logs: List[LogReceipt]) -> List[Any]:
     """
     Decode logs to events and enrich them with additional info.
+    Events with a decoder in `y.utils.decoders` are decoded without an ABI.
+    Everything else goes thru brownie, which needs the contract's ABI in its deployments db.
     """
-    decoded = _decode_logs(logs)
-    for i, log in enumerate(logs):
-        setattr(decoded[i], "block_number", log["blockNumber"])
-        setattr(decoded[i], "transaction_hash", log["transactionHash"])
-        setattr(decoded[i], "log_index", log["logIndex"])
+    decoded: List[Any] = [decode_log(log) for log in logs]
+    slow = [i for i, event in enumerate(decoded) if event is None]
+    if slow:
+        for i, event in zip(slow, _decode_logs([logs[i] for i in slow])):
+            setattr(event, "block_number", logs[i]["blockNumber"])
+            setattr(event, "transaction_hash", logs[i]["transactionHash"])
+            setattr(event, "log_index", logs[i]["logIndex"])
+            decoded[i] = event
     return decoded
 
 
@@ -39,7 +46,7 @@ def create_filter(address, topics=None):
     Set fromBlock as the earliest creation block.
     """
     if isinstance(address, list):
-        start_block = min(map(contract_creation_block, address))
+        start_block = min(contract_creation_blocks(address))
     else:
         start_block = contract_creation_block(address)
 
@@ -48,48 +55,199 @@ def create_filter(address, topics=None):
 
 @auto_retry
 def get_logs_asap(address: Optional[Address], topics: Optional[List[str]], from_block: Optional[Block] = None, to_block: Optional[Block] = None, verbose: int = 0) -> List[Any]:
-    logs = []
+    logs = list(get_logs_asap_generator(address, topics, from_block, to_block))
+    if verbose > 0:
+        logger.info('fetched %d logs', len(logs))
+    return logs
+
 
+def get_logs_asap_generator(
+    address: Optional[Address],
+    topics: Optional[List[str]],
+    from_block: Optional[Block] = None,
+    to_block: Optional[Block] = None,
+    decode: bool = False,
+    in_flight: int = 8,
+    cache: bool = True
+    ) -> Iterator[Any]:
+    """
+    Like `get_logs_asap`, but yields logs in block order as batches complete instead of returning one big list.
+    At most `in_flight` batches are fetched or held in memory at any time.
+    Pass `decode=True` to yield decoded events instead of raw logs.
+    Pass `cache=False` to skip the `log_store`, if you persist what you need from the logs yourself.
+    """
     if from_block is None:
         from_block = 0 if address is None else contract_creation_block(address)
     if to_block is None:
         to_block = chain.height
 
-    ranges = list(block_ranges(from_block, to_block, BATCH_SIZE))
-    if verbose > 0:
-        logger.info('fetching %d batches', len(ranges))
-    
-    batches = Parallel(8, "threading", verbose=verbose)(delayed(_get_logs)(address, topics, start, end) for start, end in ranges)
-    
-    for batch in batches:
-        logs.extend(batch)
-        del batch
-    del batches
+    ranges = range_controller.ranges(from_block, to_block)
+    with ThreadPoolExecutor(in_flight) as executor:
+        pending = deque()
+        for start, end in islice(ranges, in_flight):
+            pending.append(executor.submit(_get_logs, address, topics, start, end, cache))
+        while pending:
+            batch = pending.popleft().result()
+            # keep the pipe full while the caller works through this batch
+            for start, end in islice(ranges, 1):
+                pending.append(executor.submit(_get_logs, address, topics, start, end, cache))
+            if decode and batch:
+                batch = decode_logs(batch)
+            yield from batch
+            del batch
 
-    return logs
 
+# `Transfer(address,address,uint256)`
+TRANSFER = '0xddf252ad1be2c89b69c2b068fc378daa952ba7f163c4a11628f55a4df523b3ef'
+
+
+class BalanceCheckpoints:
+    '''
+    Every holder's balance after each block it sent or received tokens in, built straight from Transfer logs.
+
+    Decoding each log with brownie and keeping a dict per holder takes hours and tens of GB for tokens with millions
+    of transfers. Instead we read `(block, from, to, amount)` from each log's topics and data into numpy arrays,
+    sort the balance deltas by holder and block, and take a cumulative sum per holder. Checkpoints live in flat
+    arrays sorted by holder, so queries for many holders at once are vectorized.
+
+    Balances are python ints in object arrays, since uint256 amounts don't fit any numpy integer type.
+    Weights are computed in float64.
+
+    ```
+    checkpoints = BalanceCheckpoints(get_logs_asap_generator(token, [TRANSFER]))
+    weights = checkpoints.weights(start_block, end_block)
+    ```
+    '''
+    def __init__(self, logs: Iterable[LogReceipt]) -> None:
+        ids: Dict[bytes, int] = {}
+        blocks, senders, receivers, amounts = [], [], [], []
+        skipped = 0
+        for log in logs:
+            transfer = _decode_transfer(log)
+            if transfer is None:
+                skipped += 1
+                continue
+            sender, receiver, amount = transfer
+            blocks.append(log['blockNumber'])
+            senders.append(ids.setdefault(sender, len(ids)))
+            receivers.append(ids.setdefault(receiver, len(ids)))
+            amounts.append(amount)
+        if skipped:
+            logger.debug('skipped %d logs that are not erc20 transfers', skipped)
+
+        self.holders: List[EthAddress] = [EthAddress(holder) for holder in ids]
+        self._ids: Dict[EthAddress, int] = {holder: i for i, holder in enumerate(self.holders)}
+
+        # each transfer is two balance deltas: one row for the sender, then one for the receiver
+        num_rows = 2 * len(blocks)
+        holder = np.empty(num_rows, dtype=np.int64)
+        holder[0::2], holder[1::2] = senders, receivers
+        block = np.repeat(np.array(blocks, dtype=np.int64), 2)
+        delta = np.empty(num_rows, dtype=object)
+        amounts = np.array(amounts, dtype=object)
+        delta[0::2], delta[1::2] = -amounts, amounts
+        del blocks, senders, receivers, amounts
+
+        # lexsort is stable, so transfers within a block keep their log order
+        order = np.lexsort((block, holder))
+        holder, block, delta = holder[order], block[order], delta[order]
+        del order
 
-def logs_to_balance_checkpoints(logs) -> Dict[EthAddress,int]:
+        if num_rows:
+            # a running total over every row, minus whatever the rows for earlier holders summed to
+            running = np.cumsum(delta)
+            starts = np.flatnonzero(np.append(True, holder[1:] != holder[:-1]))
+            before = np.empty_like(running)
+            before[0], before[1:] = 0, running[:-1]
+            balance = running - np.repeat(before[starts], np.diff(np.append(starts, num_rows)))
+        else:
+            balance = delta
+
+        # we only keep each holder's balance at the end of each block
+        last_in_block = np.append((holder[1:] != holder[:-1]) | (block[1:] != block[:-1]), True) if num_rows else np.ones(0, dtype=bool)
+        self._holder = holder[last_in_block]
+        self._block = block[last_in_block]
+        self._balance = balance[last_in_block]
+        self._balance_float = self._balance.astype(np.float64)
+        # `self._offsets[i]:self._offsets[i + 1]` are holder i's checkpoints
+        self._offsets = np.searchsorted(self._holder, np.arange(len(self.holders) + 1))
+        # the block of each holder's next checkpoint, if there is one
+        last_for_holder = np.append(self._holder[1:] != self._holder[:-1], True) if len(self._holder) else np.ones(0, dtype=bool)
+        self._next_block = np.append(self._block[1:], 0) if len(self._block) else self._block.copy()
+        self._next_block[last_for_holder] = np.iinfo(np.int64).max
+
+    def __repr__(self) -> str:
+        return f"<BalanceCheckpoints holders={len(self.holders)} checkpoints={len(self)}>"
+
+    def __len__(self) -> int:
+        return len(self._block)
+
+    def __contains__(self, holder: Address) -> bool:
+        return holder in self._ids
+
+    def checkpoints(self, holder: Address) -> Dict[Block, int]:
+        """ Returns `{block: balance}` for `holder`. """
+        start, end = self._slice(holder)
+        return dict(zip(self._block[start:end].tolist(), self._balance[start:end].tolist()))
+
+    def balance_at(self, holder: Address, block: Block) -> int:
+        """ Returns `holder`'s balance at the end of `block`. """
+        start, end = self._slice(holder)
+        i = np.searchsorted(self._block[start:end], block, side='right')
+        return self._balance[start + i - 1] if i else 0
+
+    def to_dict(self) -> Dict[EthAddress, Dict[Block, int]]:
+        """ Returns `{holder: {block: balance}}`, the format `logs_to_balance_checkpoints` has always returned. """
+        return defaultdict(dict, {holder: self.checkpoints(holder) for holder in self.holders})
+
+    def weights(self, start_block: Block, end_block: Block, holders: Optional[Iterable[Address]] = None) -> Dict[EthAddress, float]:
+        '''
+        Returns `{holder: checkpoints_to_weight(holder's checkpoints, start_block, end_block)}` for each of `holders`,
+        or for every holder if `holders` is None, computed for all of them at once.
+        '''
+        in_range = (self._block >= start_block) & (self._block <= end_block)
+        blocks = self._block[in_range]
+        durations = np.minimum(self._next_block[in_range], end_block) - blocks
+        weights = np.bincount(
+            self._holder[in_range],
+            weights=self._balance_float[in_range] * durations / (end_block - start_block),
+            minlength=len(self.holders),
+        )
+        if holders is None:
+            return dict(zip(self.holders, weights.tolist()))
+        return {holder: float(weights[self._ids[holder]]) if holder in self._ids else 0.0 for holder in holders}
+
+    def _slice(self, holder: Address) -> Tuple[int, int]:
+        i = self._ids.get(holder)
+        if i is None:
+            return 0, 0
+        return int(self._offsets[i]), int(self._offsets[i + 1])
+
+
+def _decode_transfer(log: LogReceipt) -> Optional[Tuple[bytes, bytes, int]]:
+    """ Returns `(from, to, amount)` for an erc20 Transfer, without going thru an ABI. """
+    topics, data = log['topics'], to_bytes(log['data'])
+    if len(topics) == 3 and len(data) >= 32:
+        return to_bytes(topics[1])[-20:], to_bytes(topics[2])[-20:], int.from_bytes(data[:32], 'big')
+    if len(topics) == 1 and len(data) >= 96:
+        # some old tokens don't index their Transfer args
+        return data[12:32], data[44:64], int.from_bytes(data[64:96], 'big')
+    # erc721 transfers index the token id instead
+    return None
+
+
+def logs_to_balance_checkpoints(logs: Iterable[LogReceipt]) -> Dict[EthAddress,int]:
     """
     Convert Transfer logs to `{address: {from_block: balance}}` checkpoints.
+    Use `BalanceCheckpoints` directly to query many holders without building a dict for each of them.
     """
-    balances = Counter()
-    checkpoints = defaultdict(dict)
-    for block, block_logs in groupby('blockNumber', logs).items():
-        events = decode_logs(block_logs)
-        for log in events:
-            # ZERO_ADDRESS tracks -totalSupply
-            sender, receiver, amount = log.values()  # there can be several different aliases
-            balances[sender] -= amount
-            checkpoints[sender][block] = balances[sender]
-            balances[receiver] += amount
-            checkpoints[receiver][block] = balances[receiver]
-    return checkpoints
+    return BalanceCheckpoints(logs).to_dict()
 
 
 def checkpoints_to_weight(checkpoints, start_block: Block, end_block: Block) -> float:
     total = 0
-    for a, b in zip_longest(list(checkpoints), list(checkpoints)[1:]):
+    blocks = list(checkpoints)
+    for a, b in zip_longest(blocks, blocks[1:]):
         if a < start_block or a > end_block:
             continue
         b = min(b, end_block) if b else end_block
@@ -97,19 +255,126 @@ def checkpoints_to_weight(checkpoints, start_block: Block, end_block: Block) ->
     return total
 
 
+# node responses that mean we should ask for a smaller block range
+_RANGE_TOO_LARGE_ERRORS = [
+    "Service Unavailable for url:",
+    "exceed maximum block range",
+    "too many results",
+    "Too Large",
+    "query returned more than",
+    "response size exceeded",
+]
+
+# node responses that mean the range itself is too wide, no matter how many logs are in it
+_RANGE_LIMIT_ERRORS = [
+    "exceed maximum block range",
+]
+
+# `LogRangeController` aims for about this many logs per `eth_getLogs` request
+TARGET_LOGS_PER_REQUEST = 5_000
+
+# the widest block range `LogRangeController` will ever request
+MAX_BLOCK_RANGE = 1_000_000
+
+
+class LogRangeController:
+    """
+    Picks the block range for each `eth_getLogs` request.
+    Ranges grow while responses are sparse, and shrink when responses are dense or the node rejects them.
+    """
+    def __init__(self, size: int = BATCH_SIZE, max_size: int = MAX_BLOCK_RANGE) -> None:
+        self.size = size
+        self.max_size = max_size
+        self._lock = threading.Lock()
+    
+    def __repr__(self) -> str:
+        return f"<LogRangeController size={self.size} max_size={self.max_size}>"
+    
+    def ranges(self, from_block: Block, to_block: Block) -> Iterator[Tuple[Block, Block]]:
+        """
+        Yields `(start, end)` ranges covering `from_block` to `to_block`.
+        Each range is sized when it's requested, so ranges adapt while earlier ones are still in flight.
+        """
+        start = from_block
+        while start <= to_block:
+            end = min(start + self.size - 1, to_block)
+            yield start, end
+            start = end + 1
+    
+    def record(self, start: Block, end: Block, num_logs: int) -> None:
+        """ Records a successful response for `[start, end]`. """
+        blocks = end - start + 1
+        with self._lock:
+            if num_logs < TARGET_LOGS_PER_REQUEST // 4 and blocks >= self.size:
+                self.size = min(self.size * 2, self.max_size)
+            elif num_logs > TARGET_LOGS_PER_REQUEST * 2:
+                self.size = max(self.size // 2, 1)
+    
+    def overflow(self, start: Block, end: Block, range_limit: bool = False) -> None:
+        """ Records that the node rejected `[start, end]`. Pass `range_limit=True` if the range was simply too wide. """
+        blocks = end - start + 1
+        with self._lock:
+            self.size = max(min(self.size, blocks // 2), 1)
+            if range_limit:
+                self.max_size = max(min(self.max_size, blocks - 1), 1)
+
+
+range_controller = LogRangeController()
+
+
 def _get_logs(
     address: Optional[ChecksumAddress],
     topics: Optional[List[str]],
     start: Block,
-    end: Block
+    end: Block,
+    cache: bool = True
     ) -> List[LogReceipt]:
-    if end - start == BATCH_SIZE - 1:
-        response = _get_logs_batch_cached(address, topics, start, end)
-    else:
-        response = _get_logs_no_cache(address, topics, start, end)
+    """
+    Logs for finalized blocks come from the `log_store` when we've fetched them before, whatever ranges we used then.
+    """
+    finalized_block = last_finalized_block()
+    if not cache or start > finalized_block:
+        return _get_logs_no_cache(address, topics, start, end)
+
+    response = _get_logs_cached(address, topics, start, min(end, finalized_block))
+    if end > finalized_block:
+        response += _get_logs_no_cache(address, topics, finalized_block + 1, end)
     return response
 
 
+def _get_logs_cached(
+    address: Optional[ChecksumAddress],
+    topics: Optional[List[str]],
+    start: Block,
+    end: Block
+    ) -> List[LogReceipt]:
+    key = _cache_key(address, topics)
+    for gap_start, gap_end in log_store.get_gaps(key, start, end):
+        log_store.add_chunk(key, gap_start, gap_end, _get_logs_no_cache(address, topics, gap_start, gap_end))
+    return log_store.get_logs(key, start, end)
+
+
+def _cache_key(address: Optional[Any], topics: Optional[List[Any]]) -> str:
+    """
+    Normalizes a log filter so equivalent filters share cache entries, regardless of address checksums or topic formatting.
+    """
+    def normalize(value: Any) -> Any:
+        if value is None:
+            return None
+        if isinstance(value, (list, tuple, set)):
+            return sorted(normalize(v) for v in value)
+        if isinstance(value, bytes):
+            return HexBytes(value).hex().lower()
+        return str(value).lower()
+
+    # one topic in a position is equivalent to a list of just that topic
+    topics = [[topic] if isinstance(topic, (str, bytes)) else topic for topic in topics] if topics else topics
+    return json.dumps({
+        'address': normalize(address),
+        'topics': [normalize(topic) for topic in topics] if topics else None,
+    }, sort_keys=True)
+
+
 @auto_retry
 def _get_logs_no_cache(
     address: Optional[ChecksumAddress],
@@ -126,25 +391,15 @@ def _get_logs_no_cache(
         else:
             response = web3.eth.get_logs({"address": address, "topics": topics, "fromBlock": start, "toBlock": end})
     except Exception as e:
-        if "Service Unavailable for url:" in str(e) or 'exceed maximum block range' in str(e):
+        if any(err in str(e) for err in _RANGE_TOO_LARGE_ERRORS) and end > start:
             logger.debug('your node is having trouble, breaking batch in half')
-            batch_size = (end - start + 1)
-            half_of_batch = batch_size // 2
-            batch1_end = start + half_of_batch
+            range_controller.overflow(start, end, range_limit=any(err in str(e) for err in _RANGE_LIMIT_ERRORS))
+            batch1_end = start + (end - start + 1) // 2 - 1
             batch2_start = batch1_end + 1
             batch1 = _get_logs_no_cache(address, topics, start, batch1_end)
             batch2 = _get_logs_no_cache(address, topics, batch2_start, end)
-            response = batch1 + batch2
+            return batch1 + batch2
         else:
             raise
+    range_controller.record(start, end, len(response))
     return response
-
-
-@memory.cache()
-def _get_logs_batch_cached(
-    address: Optional[str],
-    topics: Optional[List[str]],
-    start: Block,
-    end: Block
-    ) -> List[LogReceipt]:
-    return _get_logs_no_cache(address, topics, start, end)
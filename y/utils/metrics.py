@@ -0,0 +1,288 @@
+import contextvars
+import threading
+import time
+from bisect import bisect_left
+from collections import Counter, defaultdict
+from contextlib import contextmanager
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from typing import Any, Callable, Dict, Iterable, Iterator, List, Optional, Tuple
+
+"""
+Counters and histograms for where ypricemagic spends its RPC budget and its time:
+- `rpc_requests_total`, `rpc_errors_total` and `rpc_latency_seconds` for every request we send the node, by method
+- `pricer_calls_total`, `pricer_seconds` and `pricer_rpc_requests_total` for each bucket or fallback pricer.
+   Pricers nest, like a curve pool pricing its coins, so `pricer_seconds` includes the time spent in nested pricers.
+- `multicall_batch_size` and `multicall_bisections_total` for each multicall we send
+- `auto_retry_retries_total`, by function and error
+- `block_cache_*` for each `block_cache` function, read from `y.utils.cache` whenever we export
+
+Read them with `metrics.snapshot()`, or export them in the Prometheus text format with `metrics.to_prometheus()` or `metrics.serve(port)`.
+OpenTelemetry collectors can scrape the same endpoint with their prometheus receiver.
+
+`trace()` records the call tree of everything decorated with `@log` inside it, with the RPCs each call caused:
+
+```
+with trace() as t:
+    get_price(token, block)
+print(t.render())
+```
+"""
+
+# in seconds
+LATENCY_BUCKETS = (0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30)
+
+# in calls
+SIZE_BUCKETS = (1, 2, 5, 10, 25, 50, 100, 250, 500, 1000)
+
+Labels = Tuple[Tuple[str, str], ...]
+
+# a collector returns `(name, type, labels, value)` for each sample it wants exported
+Sample = Tuple[str, str, Dict[str, Any], float]
+
+
+class Histogram:
+    def __init__(self, buckets: Tuple[float, ...]) -> None:
+        self.buckets = buckets
+        # the last count is for values above the largest bucket
+        self.counts = [0] * (len(buckets) + 1)
+        self.sum = 0.0
+        self.count = 0
+
+    def __repr__(self) -> str:
+        return f"<Histogram count={self.count} sum={self.sum}>"
+
+    def observe(self, value: float) -> None:
+        self.counts[bisect_left(self.buckets, value)] += 1
+        self.sum += value
+        self.count += 1
+
+    def as_dict(self) -> Dict[str, Any]:
+        return {'buckets': dict(zip(list(self.buckets) + ['+Inf'], self.counts)), 'sum': self.sum, 'count': self.count}
+
+
+class Metrics:
+    def __init__(self) -> None:
+        self._counters: Dict[str, Dict[Labels, float]] = defaultdict(dict)
+        self._histograms: Dict[str, Dict[Labels, Histogram]] = defaultdict(dict)
+        self._collectors: List[Callable[[], Iterable[Sample]]] = []
+        self._lock = threading.Lock()
+
+    def __repr__(self) -> str:
+        return f"<Metrics counters={len(self._counters)} histograms={len(self._histograms)}>"
+
+    def inc(self, name: str, value: float = 1, **labels: Any) -> None:
+        key = _labels(labels)
+        with self._lock:
+            counter = self._counters[name]
+            counter[key] = counter.get(key, 0) + value
+
+    def observe(self, name: str, value: float, buckets: Tuple[float, ...] = LATENCY_BUCKETS, **labels: Any) -> None:
+        key = _labels(labels)
+        with self._lock:
+            histogram = self._histograms[name].get(key)
+            if histogram is None:
+                histogram = self._histograms[name][key] = Histogram(buckets)
+            histogram.observe(value)
+
+    @contextmanager
+    def timer(self, name: str, **labels: Any) -> Iterator[None]:
+        """ Observes how long the block takes, in seconds, in histogram `name`. """
+        start = time.perf_counter()
+        try:
+            yield
+        finally:
+            self.observe(name, time.perf_counter() - start, **labels)
+
+    def add_collector(self, collector: Callable[[], Iterable[Sample]]) -> None:
+        """ `collector()` is called on every export, for metrics that are cheaper to read than to keep up to date. """
+        self._collectors.append(collector)
+
+    def reset(self) -> None:
+        with self._lock:
+            self._counters.clear()
+            self._histograms.clear()
+
+    def snapshot(self) -> Dict[str, Dict[Labels, Any]]:
+        """ Returns `{name: {labels: value}}` for every metric, with histograms as dicts. """
+        with self._lock:
+            snapshot: Dict[str, Dict[Labels, Any]] = {name: dict(values) for name, values in self._counters.items()}
+            for name, histograms in self._histograms.items():
+                snapshot[name] = {key: histogram.as_dict() for key, histogram in histograms.items()}
+        for name, _, labels, value in self._collect():
+            snapshot.setdefault(name, {})[_labels(labels)] = value
+        return snapshot
+
+    def to_prometheus(self) -> str:
+        """ Returns every metric in the Prometheus text exposition format. """
+        lines = []
+        with self._lock:
+            for name, values in sorted(self._counters.items()):
+                lines.append(f'# TYPE {name} counter')
+                lines.extend(f'{name}{_format_labels(key)} {value}' for key, value in values.items())
+            for name, histograms in sorted(self._histograms.items()):
+                lines.append(f'# TYPE {name} histogram')
+                for key, histogram in histograms.items():
+                    cumulative = 0
+                    for le, count in zip(list(histogram.buckets) + ['+Inf'], histogram.counts):
+                        cumulative += count
+                        lines.append(f'{name}_bucket{_format_labels(key + (("le", str(le)),))} {cumulative}')
+                    lines.append(f'{name}_sum{_format_labels(key)} {histogram.sum}')
+                    lines.append(f'{name}_count{_format_labels(key)} {histogram.count}')
+        typed = set()
+        for name, type_, labels, value in self._collect():
+            if name not in typed:
+                lines.append(f'# TYPE {name} {type_}')
+                typed.add(name)
+            lines.append(f'{name}{_format_labels(_labels(labels))} {value}')
+        return '\n'.join(lines) + '\n'
+
+    def serve(self, port: int, addr: str = '') -> ThreadingHTTPServer:
+        """ Serves `to_prometheus()` at `http://{addr}:{port}/metrics` on a daemon thread. """
+        registry = self
+
+        class Handler(BaseHTTPRequestHandler):
+            def do_GET(self) -> None:
+                body = registry.to_prometheus().encode()
+                self.send_response(200)
+                self.send_header('Content-Type', 'text/plain; version=0.0.4')
+                self.send_header('Content-Length', str(len(body)))
+                self.end_headers()
+                self.wfile.write(body)
+
+            def log_message(self, *args: Any) -> None:
+                pass
+
+        server = ThreadingHTTPServer((addr, port), Handler)
+        threading.Thread(target=server.serve_forever, name='ypricemagic metrics', daemon=True).start()
+        return server
+
+    def _collect(self) -> Iterator[Sample]:
+        for collector in self._collectors:
+            yield from collector()
+
+
+metrics = Metrics()
+
+# shortcuts for the global registry
+inc = metrics.inc
+observe = metrics.observe
+timer = metrics.timer
+add_collector = metrics.add_collector
+
+
+class Span:
+    """ One call in a trace, with the calls it made and the RPCs it sent itself. """
+    __slots__ = 'name', 'duration', 'children', 'rpcs', 'rpc_seconds'
+
+    def __init__(self, name: str) -> None:
+        self.name = name
+        self.duration: Optional[float] = None
+        self.children: List[Span] = []
+        self.rpcs: Counter = Counter()
+        self.rpc_seconds = 0.0
+
+    def __repr__(self) -> str:
+        return f"<Span {self.name} children={len(self.children)} rpcs={sum(self.rpcs.values())}>"
+
+    def total_rpcs(self) -> Counter:
+        """ Returns `{method: count}` for the RPCs this span and everything under it sent. """
+        total = Counter(self.rpcs)
+        for child in self.children:
+            total.update(child.total_rpcs())
+        return total
+
+    def render(self, depth: int = 0) -> str:
+        duration = '...' if self.duration is None else f'{self.duration * 1000:.1f}ms'
+        rpcs = ', '.join(f'{method} x{count}' for method, count in self.rpcs.most_common())
+        line = '  ' * depth + f'{self.name} {duration}' + (f' [{rpcs}]' if rpcs else '')
+        return '\n'.join([line] + [child.render(depth + 1) for child in list(self.children)])
+
+
+_current_span: contextvars.ContextVar = contextvars.ContextVar('ypricemagic_span', default=None)
+_current_pricer: contextvars.ContextVar = contextvars.ContextVar('ypricemagic_pricer', default=None)
+
+
+def tracing() -> bool:
+    return _current_span.get() is not None
+
+
+@contextmanager
+def trace(name: str = 'trace') -> Iterator[Span]:
+    '''
+    Records the call tree of everything inside the block. Yields the root `Span`, call `.render()` on it after.
+    RPCs sent from threads we didn't start with `propagate` aren't attributed to the trace.
+    '''
+    root = Span(name)
+    token = _current_span.set(root)
+    start = time.perf_counter()
+    try:
+        yield root
+    finally:
+        root.duration = time.perf_counter() - start
+        _current_span.reset(token)
+
+
+@contextmanager
+def span(name: str) -> Iterator[Optional[Span]]:
+    """ Adds a child span to the current trace for the block, if we're tracing. """
+    parent = _current_span.get()
+    if parent is None:
+        yield None
+        return
+    child = Span(name)
+    parent.children.append(child)
+    token = _current_span.set(child)
+    start = time.perf_counter()
+    try:
+        yield child
+    finally:
+        child.duration = time.perf_counter() - start
+        _current_span.reset(token)
+
+
+@contextmanager
+def pricer(name: str) -> Iterator[None]:
+    """ Attributes the time and RPCs of the block to pricer `name`. """
+    metrics.inc('pricer_calls_total', pricer=name)
+    token = _current_pricer.set(name)
+    try:
+        with metrics.timer('pricer_seconds', pricer=name), span(f'pricer {name}'):
+            yield
+    finally:
+        _current_pricer.reset(token)
+
+
+def propagate(func: Callable) -> Callable:
+    '''
+    Returns `func` bound to the caller's trace and pricer, for running on another thread.
+    Call `propagate` once per submission, a bound function can't run on two threads at once.
+    '''
+    context = contextvars.copy_context()
+
+    def run(*args: Any, **kwargs: Any) -> Any:
+        return context.run(func, *args, **kwargs)
+    return run
+
+
+def record_rpc(method: str, seconds: float, error: bool = False) -> None:
+    """ Records one request to the node. Called by `y.utils.middleware.metrics_middleware`. """
+    metrics.inc('rpc_requests_total', method=method)
+    metrics.observe('rpc_latency_seconds', seconds, method=method)
+    if error:
+        metrics.inc('rpc_errors_total', method=method)
+    metrics.inc('pricer_rpc_requests_total', method=method, pricer=_current_pricer.get() or 'none')
+    current = _current_span.get()
+    if current is not None:
+        current.rpcs[method] += 1
+        current.rpc_seconds += seconds
+
+
+def _labels(labels: Dict[str, Any]) -> Labels:
+    return tuple(sorted((key, str(value)) for key, value in labels.items()))
+
+
+def _format_labels(labels: Labels) -> str:
+    if not labels:
+        return ''
+    escaped = (value.replace('\\', '\\\\').replace('"', '\\"').replace('\n', '\\n') for _, value in labels)
+    return '{' + ','.join(f'{key}="{value}"' for (key, _), value in zip(labels, escaped)) + '}'
@@ -1,17 +1,29 @@
+import json
 import logging
-from typing import Any, Callable
+import os
+import sys
+import threading
+import time
+from concurrent.futures import Future
+from typing import Any, Callable, Dict, List, Tuple
 
 from brownie import web3
+from brownie.convert.datatypes import HexBytes
+from cachetools import TTLCache
+from eth_abi import decode_abi, encode_abi
 from eth_utils import encode_hex
 from eth_utils import function_signature_to_4byte_selector as fourbyte
 from requests import Session
 from requests.adapters import HTTPAdapter
 from web3 import HTTPProvider, Web3
 from web3.middleware import filter
-from y.utils.cache import memory
+from y.utils import metrics
+from y.utils.cache import LATEST_TTL, memory
+from y.utils.store import is_finalized
 
 logger = logging.getLogger(__name__)
 
+# the initial block range for `eth_getLogs` requests. `y.utils.events` adjusts the range as it learns what the node can handle.
 BATCH_SIZE = (
     2_000 if 'moralis' in web3.provider.endpoint_uri
     else 10_000
@@ -24,13 +36,18 @@ CACHED_CALLS = [
 CACHED_CALLS = [encode_hex(fourbyte(data)) for data in CACHED_CALLS]
 
 
+# code at "latest" changes when a contract is deployed or self-destructs, so we only keep it in memory for a little while
+_latest_code = TTLCache(maxsize=10_000, ttl=LATEST_TTL)
+_latest_code_lock = threading.Lock()
+
+
 def should_cache(method: str, params: Any) -> bool:
     if method == "eth_call" and params[0]["data"] in CACHED_CALLS:
         return True
-    if method == "eth_getCode" and params[1] == "latest":
-        return True
-    if method == "eth_getLogs":
-        return int(params[0]["toBlock"], 16) - int(params[0]["fromBlock"], 16) == BATCH_SIZE - 1
+    if method == "eth_getCode":
+        # only finalized code can't be undone by a reorg
+        block = params[1]
+        return isinstance(block, str) and block.startswith("0x") and is_finalized(int(block, 16))
     return False
 
 
@@ -40,6 +57,15 @@ def cache_middleware(make_request: Callable, web3: Web3) -> Callable:
 
         if should_cache(method, params):
             response = memory.cache(make_request)(method, params)
+        elif method == "eth_getCode" and params[1] == "latest":
+            address = str(params[0]).lower()
+            with _latest_code_lock:
+                response = _latest_code.get(address)
+            if response is None:
+                response = make_request(method, params)
+                if "error" not in response:
+                    with _latest_code_lock:
+                        _latest_code[address] = response
         else:
             response = make_request(method, params)
 
@@ -48,6 +74,178 @@ def cache_middleware(make_request: Callable, web3: Web3) -> Callable:
     return middleware
 
 
+# eth_calls for the same block that arrive within this many seconds of each other are sent as one multicall.
+# `$YPRICEMAGIC_COALESCE_WINDOW=0` turns this off, the benchmarks do that so the requests they replay don't depend on thread timing.
+COALESCE_WINDOW = float(os.environ.get('YPRICEMAGIC_COALESCE_WINDOW', 0.005))
+
+# the max number of eth_calls we'll squeeze into one multicall
+COALESCE_MAX_BATCH = 100
+
+# read-only methods where identical concurrent requests can safely share one response
+SINGLEFLIGHT_METHODS = {
+    "eth_blockNumber",
+    "eth_call",
+    "eth_chainId",
+    "eth_getBalance",
+    "eth_getBlockByNumber",
+    "eth_getCode",
+    "eth_getLogs",
+    "eth_getStorageAt",
+    "eth_getTransactionReceipt",
+}
+
+TRY_AGGREGATE = fourbyte("tryAggregate(bool,(address,bytes)[])")
+
+
+class _Batch:
+    def __init__(self) -> None:
+        self.calls: List[Tuple[Any, Future]] = []
+        self.full = threading.Event()
+
+
+class RequestCoalescer:
+    """
+    Middleware that cuts down request volume when many threads hit the node at once:
+    - identical in-flight requests are only sent once, and every caller gets the response (singleflight)
+    - plain `eth_call`s for the same block that arrive within `COALESCE_WINDOW` are sent as one Multicall2 `tryAggregate`
+
+    Each subcall gets its own response. A subcall that fails inside the multicall is sent again on its own before we return
+    its error, since it can fail there and succeed alone, ie. if the batch hits the node's gas cap or the call checks `msg.sender`.
+    If the multicall itself fails, each call is sent on its own instead.
+    NOTE: Inside a multicall, `msg.sender` is the multicall contract rather than the zero address.
+    """
+    def __init__(self, make_request: Callable, window: float = COALESCE_WINDOW, max_batch: int = COALESCE_MAX_BATCH) -> None:
+        self.make_request = make_request
+        self.window = window
+        self.max_batch = max_batch
+        self._lock = threading.Lock()
+        self._in_flight: Dict[str, Future] = {}
+        self._batches: Dict[str, _Batch] = {}
+        self._active = 0
+
+    def __call__(self, method: str, params: Any) -> Any:
+        if method not in SINGLEFLIGHT_METHODS:
+            return self.make_request(method, params)
+
+        key = json.dumps([method, params], sort_keys=True, default=str)
+        with self._lock:
+            future = self._in_flight.get(key)
+            leader = future is None
+            if leader:
+                future = self._in_flight[key] = Future()
+            concurrent = self._active > 0
+            self._active += 1
+
+        try:
+            if not leader:
+                return dict(future.result())
+            try:
+                if concurrent and self.window > 0 and self._batchable(method, params):
+                    response = self._batched(params)
+                else:
+                    response = self.make_request(method, params)
+                future.set_result(response)
+                return response
+            except BaseException as e:
+                future.set_exception(e)
+                raise
+            finally:
+                with self._lock:
+                    del self._in_flight[key]
+        finally:
+            with self._lock:
+                self._active -= 1
+
+    def _batchable(self, method: str, params: Any) -> bool:
+        # we only batch plain calls, anything with a sender, value, gas or state override goes straight through
+        if method != "eth_call" or len(params) != 2 or set(params[0]) != {"to", "data"}:
+            return False
+        multicall = sys.modules.get("y.utils.multicall")
+        deploy_block = getattr(multicall, "multicall_deploy_block", None)
+        if deploy_block is None:
+            return False
+        if str(params[0]["to"]).lower() == str(multicall.multicall2).lower():
+            return False
+        block = params[1]
+        return block == "latest" or (isinstance(block, str) and block.startswith("0x") and int(block, 16) >= deploy_block)
+
+    def _batched(self, params: Any) -> Any:
+        block = params[1]
+        future = Future()
+        with self._lock:
+            batch = self._batches.get(block)
+            leader = batch is None
+            if leader:
+                batch = self._batches[block] = _Batch()
+            batch.calls.append((params, future))
+            if len(batch.calls) >= self.max_batch:
+                # the next call for this block starts a new batch
+                del self._batches[block]
+                batch.full.set()
+
+        if leader:
+            batch.full.wait(self.window)
+            with self._lock:
+                if self._batches.get(block) is batch:
+                    del self._batches[block]
+            self._send_batch(block, batch.calls)
+        return future.result()
+
+    def _send_batch(self, block: str, calls: List[Tuple[Any, Future]]) -> None:
+        if len(calls) == 1:
+            self._send_each(calls)
+            return
+
+        multicall2 = str(sys.modules["y.utils.multicall"].multicall2)
+        data = TRY_AGGREGATE + encode_abi(["bool", "(address,bytes)[]"], [False, [(params[0]["to"], HexBytes(params[0]["data"])) for params, _ in calls]])
+        try:
+            response = self.make_request("eth_call", [{"to": multicall2, "data": encode_hex(data)}, block])
+            if "error" in response:
+                raise ValueError(response["error"])
+            results, = decode_abi(["(bool,bytes)[]"], HexBytes(response["result"]))
+            assert len(results) == len(calls)
+        except Exception as e:
+            logger.debug("coalesced multicall failed, sending %d calls individually: %s", len(calls), e)
+            self._send_each(calls)
+            return
+
+        failed = []
+        for (success, output), (params, future) in zip(results, calls):
+            if success:
+                future.set_result({"jsonrpc": "2.0", "id": response.get("id"), "result": encode_hex(output)})
+            else:
+                failed.append((params, future))
+        if failed:
+            logger.debug("%d of %d coalesced calls failed, sending them individually", len(failed), len(calls))
+            self._send_each(failed)
+
+    def _send_each(self, calls: List[Tuple[Any, Future]]) -> None:
+        for params, future in calls:
+            try:
+                future.set_result(self.make_request("eth_call", params))
+            except BaseException as e:
+                future.set_exception(e)
+
+
+def coalescing_middleware(make_request: Callable, web3: Web3) -> Callable:
+    return RequestCoalescer(make_request)
+
+
+def metrics_middleware(make_request: Callable, web3: Web3) -> Callable:
+    """ Records every request that reaches the node, after caching and coalescing, in `y.utils.metrics`. """
+    def middleware(method: str, params: Any) -> Any:
+        start = time.perf_counter()
+        error = True
+        try:
+            response = make_request(method, params)
+            error = "error" in response
+            return response
+        finally:
+            metrics.record_rpc(method, time.perf_counter() - start, error=error)
+
+    return middleware
+
+
 def setup_middleware() -> None:
     # patch web3 provider with more connections and higher timeout
     if web3.provider:
@@ -67,7 +265,11 @@ def setup_middleware() -> None:
     # patch and inject local filter middleware
     filter.MAX_BLOCK_REQUEST = BATCH_SIZE
     web3.middleware_onion.add(filter.local_filter_middleware)
+    # inside `cache_middleware`, so calls it caches are still cached when they get coalesced
+    web3.middleware_onion.add(coalescing_middleware)
     web3.middleware_onion.add(cache_middleware)
+    # innermost, so we only count what the node actually sees
+    web3.middleware_onion.inject(metrics_middleware, layer=0)
 
 def ensure_middleware() -> None:
     setup_middleware()
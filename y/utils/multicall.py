@@ -1,21 +1,27 @@
 import logging
 from collections import defaultdict
+from concurrent.futures import ThreadPoolExecutor
 from itertools import count, product
 from operator import itemgetter
-from typing import Any, Callable, Iterable, List, Optional, Tuple, Union
+from typing import (Any, Callable, Dict, Iterable, Iterator, List, Optional,
+                    Tuple, Union)
 
 import brownie
 import requests
 from brownie import chain, web3
+from brownie.convert.datatypes import EthAddress, HexBytes, Wei
 from eth_abi.exceptions import InsufficientDataBytes
 from web3.exceptions import CannotHandleRequest
 from y import convert
 from y.contracts import Contract, contract_creation_block
 from y.decorators import log
-from y.exceptions import continue_if_call_reverted
+from y.exceptions import call_reverted, continue_if_call_reverted
 from y.interfaces.multicall2 import MULTICALL2_ABI
 from y.networks import Network
 from y.typing import Address, AddressOrContract, AnyAddressType, Block
+from y.utils.call_templates import CallTemplate, call_template
+from y.utils import metrics
+from y.utils.client import jsonrpc_batch
 from y.utils.raw_calls import _decimals, _totalSupply
 
 from multicall import Call, Multicall
@@ -46,6 +52,35 @@ code = "0x608060405234801561001057600080fd5b50600436106100b45760003560e01c806372
 multicall_deploy_block = contract_creation_block(multicall2.address)
 
 
+# we split multicalls into chunks so no single `tryAggregate` runs into the node's gas or response size limits
+MULTICALL_MAX_CALLS = 1_000
+
+# rough byte budgets for the calldata and returndata of each chunk
+MULTICALL_MAX_CALLDATA = 128_000
+MULTICALL_MAX_RETURNDATA = 512_000
+
+# the number of chunks we send at once
+MULTICALL_THREADS = 8
+
+_executor = ThreadPoolExecutor(MULTICALL_THREADS, thread_name_prefix='multicall')
+
+
+@log(logger)
+def aggregate(calls: Iterable[Call], block: Optional[Block] = None, require_success: bool = True) -> Dict[Any, Any]:
+    """
+    Same as `Multicall(calls, block_id=block, require_success=require_success)()`,
+    but big batches are split into chunks by call count and estimated size, and the chunks are sent concurrently.
+    """
+    calls = list(calls)
+    sizes = [_estimate_call_size(call) for call in calls]
+    # with `require_success`, a reverted call fails its whole chunk, so there's nothing to gain by bisecting
+    should_bisect = (lambda e: not call_reverted(e)) if require_success else (lambda e: True)
+    output = {}
+    for chunk_output in _dispatch(calls, sizes, lambda chunk: Multicall(chunk, block_id=block, require_success=require_success)(), should_bisect):
+        output.update(chunk_output)
+    return output
+
+
 @log(logger)
 def multicall_same_func_no_input(
     addresses: Iterable[AnyAddressType],
@@ -57,7 +92,7 @@ def multicall_same_func_no_input(
 
     addresses = _clean_addresses(addresses)
     calls = [Call(address, [method], [[address,apply_func]]) for address in addresses]
-    return [result for result in Multicall(calls, block_id=block, require_success=(not return_None_on_failure))().values()]
+    return [result for result in aggregate(calls, block=block, require_success=(not return_None_on_failure)).values()]
 
 
 @log(logger)
@@ -72,7 +107,7 @@ def multicall_same_func_different_contracts_same_input(
     assert input
     addresses = _clean_addresses(addresses)
     calls = [Call(address, [method, input], [[address,apply_func]]) for address in addresses]
-    return [result for result in Multicall(calls, block_id=block)().values()]
+    return [result for result in aggregate(calls, block=block).values()]
 
 
 @log(logger)
@@ -88,7 +123,7 @@ def multicall_same_func_same_contract_different_inputs(
     assert inputs
     address = convert.to_address(address)
     calls = [Call(address, [method, input], [[input,apply_func]]) for input in inputs]
-    return [result for result in Multicall(calls, block_id=block, require_success = not return_None_on_failure)().values()]
+    return [result for result in aggregate(calls, block=block, require_success=(not return_None_on_failure)).values()]
 
 
 @log(logger)
@@ -134,41 +169,63 @@ def multicall_balanceOf(
 @log(logger)
 def fetch_multicall(*calls: Any, block: Optional[Block] = None) -> List[Optional[Any]]:
     # https://github.com/makerdao/multicall
-    multicall_input = []
-    fn_list = []
-    decoded = []
-
-    for contract, fn_name, *fn_inputs in calls:
-        fn = getattr(contract, fn_name)
-
-        # check that there aren't multiple functions with the same name
-        if hasattr(fn, "_get_fn_from_args"):
-            fn = fn._get_fn_from_args(fn_inputs)
+    fn_list, multicall_input = _prepare_multicall_input(calls)
+    sizes = [(len(data) // 2, _estimate_return_size(fn.abi['outputs'])) for fn, (_, data) in zip(fn_list, multicall_input)]
+    result = [
+        response
+        for chunk_result in _dispatch(multicall_input, sizes, lambda chunk: _try_aggregate(chunk, block), lambda e: True)
+        for response in chunk_result
+    ]
+    return _decode_multicall_output(fn_list, result)
 
-        fn_list.append(fn)
-        multicall_input.append((contract, fn.encode_input(*fn_inputs)))
 
+def _try_aggregate(multicall_input: List[Tuple[Any,str]], block: Optional[Block]) -> List[Tuple[bool,bytes]]:
+    data = _encode_try_aggregate(multicall_input)
     if isinstance(block, int) and block < multicall_deploy_block:
         # use state override to resurrect the contract prior to deployment
-        data = multicall2.tryAggregate.encode_input(False, multicall_input)
         call = web3.eth.call(
             {'to': str(multicall2), 'data': data},
             block or 'latest',
             {str(multicall2): {'code': f'0x{multicall2.bytecode}'}},
         )
-        result = multicall2.tryAggregate.decode_output(call)
     else:
-        result = multicall2.tryAggregate.call(
-            False, multicall_input, block_identifier=block or 'latest'
-        )
+        call = web3.eth.call({'to': str(multicall2), 'data': data}, block or 'latest')
+    return _TRY_AGGREGATE.decode(call)
 
-    for fn, (ok, data) in zip(fn_list, result):
-        try:
-            assert ok, "call failed"
-            decoded.append(fn.decode_output(data))
-        except (AssertionError, InsufficientDataBytes):
-            decoded.append(None)
 
+@log(logger)
+def fetch_multicall_series(*calls: Any, blocks: Iterable[Block]) -> List[List[Optional[Any]]]:
+    """
+    Same interface as `fetch_multicall`, but runs the same calls at every block in `blocks`.
+    The calls are encoded once and each block's `tryAggregate` is sent as one request
+    in a JSON-RPC batch, so a 10k block range costs a handful of round trips.
+
+    Returns one list of decoded results per block. If the node fails a block, every result for that block is `None`.
+    """
+    blocks = list(blocks)
+    fn_list, multicall_input = _prepare_multicall_input(calls)
+    data = _encode_try_aggregate(multicall_input)
+    state_override = {str(multicall2): {'code': f'0x{multicall2.bytecode}'}}
+
+    params = []
+    for block in blocks:
+        if isinstance(block, int) and block < multicall_deploy_block:
+            # use state override to resurrect the contract prior to deployment
+            params.append([{'to': str(multicall2), 'data': data}, hex(block), state_override])
+        else:
+            params.append([{'to': str(multicall2), 'data': data}, hex(block) if isinstance(block, int) else block or 'latest'])
+
+    decoded = []
+    for response in jsonrpc_batch('eth_call', params):
+        if response is None:
+            decoded.append([None] * len(fn_list))
+            continue
+        try:
+            result = _TRY_AGGREGATE.decode(HexBytes(response))
+        except (InsufficientDataBytes, ValueError):
+            decoded.append([None] * len(fn_list))
+            continue
+        decoded.append(_decode_multicall_output(fn_list, result))
     return decoded
 
 
@@ -221,6 +278,148 @@ def batch_call(calls: Tuple[Contract,str,List[Any],Block]) -> List[Any]:
     ]
 
 
+def _dispatch(items: List[Any], sizes: List[Tuple[int,int]], send: Callable[[List[Any]], Any], should_bisect: Callable[[Exception], bool]) -> List[Any]:
+    """
+    Sends `items` in chunks that fit `sizes` within our limits, concurrently, and returns the output for each chunk in order.
+    If a chunk fails and `should_bisect(e)`, we send each half of it instead, so one bad call or one oversized chunk
+    doesn't sink the rest. A single item that fails raises.
+    """
+    chunks = [items[start:end] for start, end in _chunk_bounds(sizes)]
+    if len(chunks) <= 1:
+        return _send_or_bisect(chunks[0], send, should_bisect) if chunks else []
+    # the chunks' RPCs count toward the caller's trace and pricer
+    futures = [_executor.submit(metrics.propagate(_send_or_bisect), chunk, send, should_bisect) for chunk in chunks]
+    return [output for future in futures for output in future.result()]
+
+
+def _send_or_bisect(items: List[Any], send: Callable[[List[Any]], Any], should_bisect: Callable[[Exception], bool]) -> List[Any]:
+    metrics.observe('multicall_batch_size', len(items), buckets=metrics.SIZE_BUCKETS)
+    try:
+        return [send(items)]
+    except Exception as e:
+        if len(items) == 1 or not should_bisect(e):
+            raise
+        logger.debug(f'multicall of {len(items)} calls failed, bisecting: {e}')
+        metrics.inc('multicall_bisections_total')
+        half = len(items) // 2
+        return _send_or_bisect(items[:half], send, should_bisect) + _send_or_bisect(items[half:], send, should_bisect)
+
+
+def _chunk_bounds(sizes: List[Tuple[int,int]]) -> Iterator[Tuple[int,int]]:
+    """ Yields `(start, end)` for each chunk, where `sizes` is `(calldata, returndata)` in bytes for each call. """
+    start, calldata, returndata = 0, 0, 0
+    for i, (call_calldata, call_returndata) in enumerate(sizes):
+        if i > start and (
+            i - start >= MULTICALL_MAX_CALLS
+            or calldata + call_calldata > MULTICALL_MAX_CALLDATA
+            or returndata + call_returndata > MULTICALL_MAX_RETURNDATA
+        ):
+            yield start, i
+            start, calldata, returndata = i, 0, 0
+        calldata += call_calldata
+        returndata += call_returndata
+    if start < len(sizes):
+        yield start, len(sizes)
+
+
+def _estimate_call_size(call: Call) -> Tuple[int,int]:
+    args = getattr(call, 'args', None) or []
+    # the selector, the target's word, and a word per arg, plus tryAggregate's framing
+    calldata = 4 + 32 * (len(args) + 3)
+    signature = getattr(call, 'signature', None)
+    output_types = getattr(signature, 'output_types', None)
+    return calldata, _estimate_return_size(output_types) if output_types is not None else 96
+
+
+def _estimate_return_size(outputs: Iterable[Any]) -> int:
+    '''
+    Estimates the returndata for a call with `outputs`, ABI output dicts or type strings.
+    We can't know the length of dynamic types ahead of time, so we budget a generous 1kb for each.
+    '''
+    size = 64
+    for output in outputs:
+        type_ = output['type'] if isinstance(output, dict) else str(output)
+        if '[]' in type_ or type_ in ['string', 'bytes']:
+            size += 1024
+        elif isinstance(output, dict) and output.get('components'):
+            size += _estimate_return_size(output['components']) - 64
+        else:
+            size += 32 * (type_.count(',') + 1)
+    return size
+
+
+def _prepare_multicall_input(calls: Iterable[Any]) -> Tuple[List[Any], List[Tuple[Any,str]]]:
+    multicall_input = []
+    fn_list = []
+
+    for contract, fn_name, *fn_inputs in calls:
+        fn = getattr(contract, fn_name)
+
+        # check that there aren't multiple functions with the same name
+        if hasattr(fn, "_get_fn_from_args"):
+            fn = fn._get_fn_from_args(fn_inputs)
+
+        fn_list.append(fn)
+        template = _template_for(fn)
+        # brownie's encoder converts things like '1 ether' and struct dicts, we only skip it for plain words
+        data = '0x' + template.encode(*fn_inputs).hex() if template.can_encode(fn_inputs) else fn.encode_input(*fn_inputs)
+        multicall_input.append((contract, data))
+
+    return fn_list, multicall_input
+
+
+def _decode_multicall_output(fn_list: List[Any], result: List[Tuple[bool,bytes]]) -> List[Optional[Any]]:
+    decoded = []
+    for fn, (ok, data) in zip(fn_list, result):
+        if not ok:
+            decoded.append(None)
+            continue
+        template = _template_for(fn)
+        try:
+            # a single static word skips brownie's decoder, anything else keeps brownie's named ReturnValue
+            decoded.append(_decode_word(template, data) if template.is_static and len(template.output_types) == 1 else fn.decode_output(data))
+        except (ValueError, InsufficientDataBytes):
+            decoded.append(None)
+    return decoded
+
+
+# the types brownie returns for each kind of static word, bools come back as plain bools
+_BROWNIE_WORD_TYPES = {'uint': Wei, 'int': Wei, 'address': EthAddress, 'bytes32': HexBytes}
+
+
+def _decode_word(template: CallTemplate, data: bytes) -> Any:
+    """ Decodes the single static word `template` returns as the same type `fn.decode_output` would. """
+    value = template.decode(data)
+    brownie_type = _BROWNIE_WORD_TYPES.get(template.output_kinds[0])
+    return value if brownie_type is None else brownie_type(value)
+
+
+def _template_for(fn: Any) -> CallTemplate:
+    """ Returns the `CallTemplate` for brownie ContractCall `fn`, built once per `fn`. """
+    template = getattr(fn, '_call_template', None)
+    if template is None:
+        inputs = ','.join(_abi_type(param) for param in fn.abi['inputs'])
+        outputs = tuple(_abi_type(param) for param in fn.abi['outputs'])
+        template = call_template(f"{fn.abi['name']}({inputs})", outputs)
+        fn._call_template = template
+    return template
+
+
+def _abi_type(param: Dict[str, Any]) -> str:
+    """ Returns the canonical type for abi `param`, expanding tuples into their components. """
+    type_ = param['type']
+    if type_.startswith('tuple'):
+        return f"({','.join(_abi_type(component) for component in param['components'])}){type_[5:]}"
+    return type_
+
+
+def _encode_try_aggregate(multicall_input: List[Tuple[Any,str]]) -> str:
+    return '0x' + _TRY_AGGREGATE.encode(False, [(str(contract), HexBytes(data)) for contract, data in multicall_input]).hex()
+
+
+_TRY_AGGREGATE = call_template('tryAggregate(bool,(address,bytes)[])((bool,bytes)[])')
+
+
 @log(logger)
 def _clean_addresses(
     addresses: Iterable[AnyAddressType]
@@ -6,7 +6,6 @@ import brownie
 from brownie import ZERO_ADDRESS, convert, web3
 from brownie.convert.datatypes import EthAddress
 from eth_utils import encode_hex
-from eth_utils import function_signature_to_4byte_selector as fourbyte
 from y.contracts import Contract, proxy_implementation
 from y.decorators import log
 from y.exceptions import (CalldataPreparationError, ContractNotVerified,
@@ -14,6 +13,7 @@ from y.exceptions import (CalldataPreparationError, ContractNotVerified,
                           call_reverted)
 from y.networks import Network
 from y.typing import Address, AddressOrContract, Block
+from y.utils.call_templates import selector
 from y.utils.cache import memory
 
 from multicall import Call
@@ -357,7 +357,7 @@ def prepare_data(
     method, 
     inputs = Union[None, bytes, int, str, Address, EthAddress, brownie.Contract, Contract]
     ) -> str:
-    method = encode_hex(fourbyte(method))
+    method = encode_hex(selector(method))
 
     if inputs is None:
         return method
@@ -0,0 +1,113 @@
+import logging
+import threading
+import time
+from typing import Callable, Dict, List, Optional, Set
+
+from brownie import web3
+from y.typing import Block
+from y.utils.store import last_finalized_block
+
+logger = logging.getLogger(__name__)
+
+"""
+Tracks the hashes of the blocks near the chain head. Anything at or below `last_finalized_block()` is final and safe to cache
+by number, but an unfinalized block can be replaced by a reorg, so caches key those results by hash instead.
+"""
+
+# how often we check the chain head for a reorg, in seconds
+HEAD_POLL_INTERVAL = 1
+
+# we keep hashes for this many blocks below the last finalized block, in case the node lags a little
+_PRUNE_MARGIN = 10
+
+
+class ReorgTracker:
+    def __init__(self) -> None:
+        self.reorgs = 0
+        self._hashes: Dict[Block, str] = {}
+        self._listeners: List[Callable[[Block, Set[str]], None]] = []
+        self._checked_at = 0.0
+        # only one thread walks the head at a time, everyone else uses what we already know
+        self._check_lock = threading.Lock()
+        self._lock = threading.Lock()
+
+    def __repr__(self) -> str:
+        return f"<ReorgTracker blocks={len(self._hashes)} reorgs={self.reorgs}>"
+
+    def block_hash(self, block: Block) -> str:
+        """ Returns the canonical hash of `block` as of our last head check. """
+        if time.monotonic() - self._checked_at > HEAD_POLL_INTERVAL:
+            self.check_head()
+        with self._lock:
+            block_hash = self._hashes.get(block)
+        if block_hash is None:
+            block_hash = web3.eth.get_block(block).hash.hex()
+            with self._lock:
+                block_hash = self._hashes.setdefault(block, block_hash)
+        return block_hash
+
+    def on_reorg(self, callback: Callable[[Block, Set[str]], None]) -> None:
+        """ `callback(first_reorged_block, stale_hashes)` is called after every reorg we see. """
+        self._listeners.append(callback)
+
+    def check_head(self) -> Optional[Block]:
+        '''
+        Fetches the chain head and walks back through the parent hashes until we reach a recorded block we agree with.
+        Returns the first block that was reorged, or None if there wasn't a reorg.
+        '''
+        if not self._check_lock.acquire(blocking=False):
+            return None
+        try:
+            head = web3.eth.get_block('latest')
+            # blocks below the finalization floor can't reorg, so the walk never needs to reach them
+            self._prune()
+            stale = set()
+            reorged = None
+            with self._lock:
+                # the new chain can be shorter than the one it replaced
+                for number in [number for number in self._hashes if number > head.number]:
+                    stale.add(self._hashes.pop(number))
+                    reorged = number if reorged is None else min(reorged, number)
+                previous = self._hashes.get(head.number)
+                if previous is not None and previous != head.hash.hex():
+                    stale.add(previous)
+                    reorged = head.number if reorged is None else min(reorged, head.number)
+                self._hashes[head.number] = head.hash.hex()
+                lowest = min(self._hashes)
+
+            # We walk back until a recorded hash agrees with the new chain. Blocks we never recorded don't stop the walk,
+            # a reorg can reach past them to blocks we did record, so we keep going while there are recorded blocks below.
+            number, parent = head.number - 1, head.parentHash.hex()
+            while number >= lowest:
+                with self._lock:
+                    known = self._hashes.get(number)
+                if known == parent:
+                    break
+                if known is not None:
+                    stale.add(known)
+                    reorged = number if reorged is None else min(reorged, number)
+                # `parent` is the canonical hash of `number`, so we record it and fetch its parent by hash
+                block = web3.eth.get_block(parent)
+                with self._lock:
+                    self._hashes[number] = parent
+                number, parent = number - 1, block.parentHash.hex()
+
+            self._checked_at = time.monotonic()
+        finally:
+            self._check_lock.release()
+
+        if reorged is not None:
+            self.reorgs += 1
+            logger.warning('reorg detected at block %d, dropping %d stale blocks', reorged, len(stale))
+            for callback in self._listeners:
+                callback(reorged, stale)
+        return reorged
+
+    def _prune(self) -> None:
+        floor = last_finalized_block() - _PRUNE_MARGIN
+        with self._lock:
+            for number in [number for number in self._hashes if number < floor]:
+                del self._hashes[number]
+
+
+reorg_tracker = ReorgTracker()
@@ -0,0 +1,702 @@
+import logging
+import os
+import pickle
+import sqlite3
+import threading
+import time
+from contextlib import contextmanager
+from functools import lru_cache
+from typing import Any, Dict, Iterable, Iterator, List, Optional, Set, Tuple
+
+from brownie import chain
+from cachetools.func import ttl_cache
+from y import convert
+from y.typing import Address, Block
+
+logger = logging.getLogger(__name__)
+
+"""
+A persistent on-disk store for things that never change once they're known, like prices at finalized blocks.
+Unlike joblib's `memory`, which writes one pickle per call, everything lives in a single SQLite database
+shared by every chain and every process.
+"""
+
+STORE_PATH = os.path.join("cache", "ypricemagic.sqlite")
+
+# the max number of prices we keep on disk. When we go over, the oldest entries are evicted first.
+MAX_PRICES = 10_000_000
+
+# blocks this far behind the chain head are considered final and safe to persist
+CONFIRMATIONS = 100
+
+# tokens that couldn't be classified get checked again after this many seconds, in case ypricemagic learns how to price them
+UNKNOWN_BUCKET_TTL = 7 * 24 * 60 * 60
+
+# same for prices we failed to find. The failure might have been transient, or a later release might know how to price the token.
+FAILED_PRICE_TTL = 7 * 24 * 60 * 60
+
+# the number of inserts between eviction checks
+_EVICTION_INTERVAL = 1_000
+
+_SCHEMA = """
+CREATE TABLE IF NOT EXISTS prices (
+    chain INTEGER NOT NULL,
+    token TEXT NOT NULL,
+    block INTEGER NOT NULL,
+    price REAL,
+    checked_at INTEGER,
+    UNIQUE (chain, token, block)
+);
+CREATE TABLE IF NOT EXISTS buckets (
+    chain INTEGER NOT NULL,
+    token TEXT NOT NULL,
+    bucket TEXT,
+    checked_at INTEGER NOT NULL,
+    PRIMARY KEY (chain, token)
+);
+"""
+
+
+class SQLiteStore:
+    """
+    Base class for SQLite backed stores. Each thread gets its own connection.
+    """
+    def __init__(self, path: str = STORE_PATH, schema: str = _SCHEMA) -> None:
+        self.path = path
+        self.schema = schema
+        self._local = threading.local()
+
+    def __repr__(self) -> str:
+        return f"<{type(self).__name__} '{self.path}'>"
+
+    @property
+    def connection(self) -> sqlite3.Connection:
+        connection = getattr(self._local, 'connection', None)
+        if connection is None:
+            if os.path.dirname(self.path):
+                os.makedirs(os.path.dirname(self.path), exist_ok=True)
+            connection = sqlite3.connect(self.path, timeout=60, isolation_level=None)
+            connection.execute("PRAGMA journal_mode=WAL")
+            connection.execute("PRAGMA synchronous=NORMAL")
+            connection.executescript(self.schema)
+            self._migrate(connection)
+            self._local.connection = connection
+        return connection
+
+    def _migrate(self, connection: sqlite3.Connection) -> None:
+        """ Brings tables created by older releases up to date with `self.schema`. `CREATE TABLE IF NOT EXISTS` leaves them as they were. """
+
+    def execute(self, sql: str, params: Iterable[Any] = ()) -> sqlite3.Cursor:
+        return self.connection.execute(sql, tuple(params))
+
+    def executemany(self, sql: str, params: Iterable[Iterable[Any]]) -> sqlite3.Cursor:
+        return self.connection.executemany(sql, params)
+
+    @contextmanager
+    def transaction(self) -> Iterator[sqlite3.Connection]:
+        connection = self.connection
+        connection.execute("BEGIN")
+        try:
+            yield connection
+        except BaseException:
+            connection.execute("ROLLBACK")
+            raise
+        connection.execute("COMMIT")
+
+
+class PriceStore(SQLiteStore):
+    """
+    Persists prices and negative results at finalized blocks, keyed by `(chain, token, block)`,
+    along with the bucket classification for each token.
+    """
+    def __init__(self, path: str = STORE_PATH, max_prices: int = MAX_PRICES) -> None:
+        super().__init__(path)
+        self.max_prices = max_prices
+        self._inserts = 0
+
+    def _migrate(self, connection: sqlite3.Connection) -> None:
+        columns = {column for _, column, *_ in connection.execute("PRAGMA table_info(prices)")}
+        if 'checked_at' not in columns:
+            # `checked_at` is NULL for the failures we stored before, so they're retried once
+            connection.execute("ALTER TABLE prices ADD COLUMN checked_at INTEGER")
+
+    def get_price(self, token: Address, block: Block) -> Tuple[bool, Optional[float]]:
+        '''
+        Returns `(found, price)`. `price` is `None` if we've already failed to price `token` at `block`.
+        Failures older than `FAILED_PRICE_TTL` aren't found, so they get retried.
+        '''
+        row = self.execute(
+            "SELECT price, checked_at FROM prices WHERE chain = ? AND token = ? AND block = ?", (chain.id, str(token), block)
+        ).fetchone()
+        if row is None:
+            return False, None
+        price, checked_at = row
+        if price is None and (checked_at is None or time.time() - checked_at > FAILED_PRICE_TTL):
+            return False, None
+        return True, price
+
+    def set_price(self, token: Address, block: Block, price: Optional[float]) -> None:
+        if not is_finalized(block):
+            return
+        self.execute(
+            "INSERT OR REPLACE INTO prices (chain, token, block, price, checked_at) VALUES (?, ?, ?, ?, ?)",
+            (chain.id, str(token), block, None if price is None else float(price), int(time.time()) if price is None else None)
+        )
+        self._inserts += 1
+        if self._inserts % _EVICTION_INTERVAL == 0:
+            self._evict()
+
+    def get_bucket(self, token: Address) -> Tuple[bool, Optional[str]]:
+        '''
+        Returns `(found, bucket)`. `bucket` is `None` if `token` didn't fit any bucket when we last checked.
+        '''
+        row = self.execute(
+            "SELECT bucket, checked_at FROM buckets WHERE chain = ? AND token = ?", (chain.id, str(token))
+        ).fetchone()
+        if row is None:
+            return False, None
+        bucket, checked_at = row
+        if bucket is None and time.time() - checked_at > UNKNOWN_BUCKET_TTL:
+            return False, None
+        return True, bucket
+
+    def set_bucket(self, token: Address, bucket: Optional[str]) -> None:
+        self.execute(
+            "INSERT OR REPLACE INTO buckets (chain, token, bucket, checked_at) VALUES (?, ?, ?, ?)",
+            (chain.id, str(token), bucket, int(time.time()))
+        )
+
+    def clear(self) -> None:
+        self.execute("DELETE FROM prices WHERE chain = ?", (chain.id,))
+        self.execute("DELETE FROM buckets WHERE chain = ?", (chain.id,))
+
+    def _evict(self) -> None:
+        # rowids grow with every insert, so everything more than `max_prices` rowids behind the newest one is the oldest.
+        # `MAX(rowid)` and a rowid range delete are both index lookups, unlike counting the table.
+        max_rowid = self.execute("SELECT MAX(rowid) FROM prices").fetchone()[0]
+        if max_rowid is not None and max_rowid > self.max_prices:
+            cursor = self.execute("DELETE FROM prices WHERE rowid <= ?", (max_rowid - self.max_prices,))
+            if cursor.rowcount:
+                logger.debug(f'{self} is over capacity, evicted {cursor.rowcount} prices')
+
+
+_POOLS_SCHEMA = """
+CREATE TABLE IF NOT EXISTS uniswap_v2_factories (
+    chain INTEGER NOT NULL,
+    factory BLOB NOT NULL,
+    last_block INTEGER NOT NULL,
+    PRIMARY KEY (chain, factory)
+);
+CREATE TABLE IF NOT EXISTS uniswap_v2_pools (
+    chain INTEGER NOT NULL,
+    factory BLOB NOT NULL,
+    idx INTEGER NOT NULL,
+    pool BLOB NOT NULL,
+    token0 BLOB NOT NULL,
+    token1 BLOB NOT NULL,
+    PRIMARY KEY (chain, factory, pool)
+);
+CREATE INDEX IF NOT EXISTS uniswap_v2_pools_token0 ON uniswap_v2_pools (chain, factory, token0);
+CREATE INDEX IF NOT EXISTS uniswap_v2_pools_token1 ON uniswap_v2_pools (chain, factory, token1);
+"""
+
+# (idx, pool, token0, token1), where `idx` is the pool's index in the factory's `allPairs`
+Pool = Tuple[int, Address, Address, Address]
+
+
+class PoolStore(SQLiteStore):
+    """
+    Persists the pools deployed by each uniswap v2 fork factory, along with the last block we've indexed `PairCreated` events through.
+    Addresses are stored as 20 byte blobs to keep the index compact.
+    """
+    def __init__(self, path: str = STORE_PATH) -> None:
+        super().__init__(path, _POOLS_SCHEMA)
+
+    def get_last_block(self, factory: Address) -> Optional[Block]:
+        row = self.execute(
+            "SELECT last_block FROM uniswap_v2_factories WHERE chain = ? AND factory = ?", (chain.id, _to_blob(factory))
+        ).fetchone()
+        return None if row is None else row[0]
+
+    def add_pools(self, factory: Address, pools: Iterable[Pool], last_block: Optional[Block] = None) -> None:
+        '''
+        Adds `pools` for `factory` and optionally moves its `last_block` forward, in one transaction.
+        '''
+        factory = _to_blob(factory)
+        with self.transaction():
+            self.executemany(
+                "INSERT OR REPLACE INTO uniswap_v2_pools (chain, factory, idx, pool, token0, token1) VALUES (?, ?, ?, ?, ?, ?)",
+                [(chain.id, factory, idx, _to_blob(pool), _to_blob(token0), _to_blob(token1)) for idx, pool, token0, token1 in pools]
+            )
+            if last_block is not None:
+                self.execute(
+                    "INSERT OR REPLACE INTO uniswap_v2_factories (chain, factory, last_block) VALUES (?, ?, ?)", (chain.id, factory, last_block)
+                )
+
+    def get_pool(self, factory: Address, pool: Address) -> Optional[Tuple[Address, Address]]:
+        '''
+        Returns `(token0, token1)` for `pool`, or `None` if `pool` isn't indexed.
+        '''
+        row = self.execute(
+            "SELECT token0, token1 FROM uniswap_v2_pools WHERE chain = ? AND factory = ? AND pool = ?",
+            (chain.id, _to_blob(factory), _to_blob(pool))
+        ).fetchone()
+        return None if row is None else (_from_blob(row[0]), _from_blob(row[1]))
+
+    def get_pools(self, factory: Address) -> Iterator[Address]:
+        cursor = self.execute(
+            "SELECT pool FROM uniswap_v2_pools WHERE chain = ? AND factory = ? ORDER BY idx", (chain.id, _to_blob(factory))
+        )
+        return (_from_blob(pool) for pool, in cursor)
+
+    def get_pools_for_token(self, factory: Address, token: Address) -> Dict[Address, Address]:
+        '''
+        Returns `{pool: paired_with}` for each pool that contains `token`.
+        '''
+        factory, token = _to_blob(factory), _to_blob(token)
+        cursor = self.execute(
+            """
+            SELECT pool, token1 FROM uniswap_v2_pools WHERE chain = ? AND factory = ? AND token0 = ?
+            UNION ALL
+            SELECT pool, token0 FROM uniswap_v2_pools WHERE chain = ? AND factory = ? AND token1 = ?
+            """,
+            (chain.id, factory, token, chain.id, factory, token)
+        )
+        return {_from_blob(pool): _from_blob(paired_with) for pool, paired_with in cursor}
+
+    def get_tokens(self, factory: Address) -> Iterator[Address]:
+        factory = _to_blob(factory)
+        cursor = self.execute(
+            """
+            SELECT token0 FROM uniswap_v2_pools WHERE chain = ? AND factory = ?
+            UNION
+            SELECT token1 FROM uniswap_v2_pools WHERE chain = ? AND factory = ?
+            """,
+            (chain.id, factory, chain.id, factory)
+        )
+        return (_from_blob(token) for token, in cursor)
+
+    def get_indices(self, factory: Address) -> Set[int]:
+        cursor = self.execute("SELECT idx FROM uniswap_v2_pools WHERE chain = ? AND factory = ?", (chain.id, _to_blob(factory)))
+        return {idx for idx, in cursor}
+
+    def count_pools(self, factory: Address) -> int:
+        return self.execute(
+            "SELECT COUNT(*) FROM uniswap_v2_pools WHERE chain = ? AND factory = ?", (chain.id, _to_blob(factory))
+        ).fetchone()[0]
+
+    def clear(self) -> None:
+        self.execute("DELETE FROM uniswap_v2_pools WHERE chain = ?", (chain.id,))
+        self.execute("DELETE FROM uniswap_v2_factories WHERE chain = ?", (chain.id,))
+
+
+_V3_POOLS_SCHEMA = """
+CREATE TABLE IF NOT EXISTS uniswap_v3_factories (
+    chain INTEGER NOT NULL,
+    factory BLOB NOT NULL,
+    last_block INTEGER NOT NULL,
+    PRIMARY KEY (chain, factory)
+);
+CREATE TABLE IF NOT EXISTS uniswap_v3_pools (
+    chain INTEGER NOT NULL,
+    factory BLOB NOT NULL,
+    pool BLOB NOT NULL,
+    token0 BLOB NOT NULL,
+    token1 BLOB NOT NULL,
+    fee INTEGER NOT NULL,
+    PRIMARY KEY (chain, factory, pool)
+);
+CREATE INDEX IF NOT EXISTS uniswap_v3_pools_token0 ON uniswap_v3_pools (chain, factory, token0);
+CREATE INDEX IF NOT EXISTS uniswap_v3_pools_token1 ON uniswap_v3_pools (chain, factory, token1);
+"""
+
+# (pool, token0, token1, fee)
+V3Pool = Tuple[Address, Address, Address, int]
+
+
+class V3PoolStore(SQLiteStore):
+    """
+    Persists the pools deployed by each uniswap v3 factory, along with the last block we've indexed `PoolCreated` events through.
+    """
+    def __init__(self, path: str = STORE_PATH) -> None:
+        super().__init__(path, _V3_POOLS_SCHEMA)
+
+    def get_last_block(self, factory: Address) -> Optional[Block]:
+        row = self.execute(
+            "SELECT last_block FROM uniswap_v3_factories WHERE chain = ? AND factory = ?", (chain.id, _to_blob(factory))
+        ).fetchone()
+        return None if row is None else row[0]
+
+    def add_pools(self, factory: Address, pools: Iterable[V3Pool], last_block: Optional[Block] = None) -> None:
+        '''
+        Adds `pools` for `factory` and optionally moves its `last_block` forward, in one transaction.
+        '''
+        factory = _to_blob(factory)
+        with self.transaction():
+            self.executemany(
+                "INSERT OR REPLACE INTO uniswap_v3_pools (chain, factory, pool, token0, token1, fee) VALUES (?, ?, ?, ?, ?, ?)",
+                [(chain.id, factory, _to_blob(pool), _to_blob(token0), _to_blob(token1), fee) for pool, token0, token1, fee in pools]
+            )
+            if last_block is not None:
+                self.execute(
+                    "INSERT OR REPLACE INTO uniswap_v3_factories (chain, factory, last_block) VALUES (?, ?, ?)", (chain.id, factory, last_block)
+                )
+
+    def get_pools_for_token(self, factory: Address, token: Address) -> Dict[Address, Tuple[Address, int]]:
+        '''
+        Returns `{pool: (paired_with, fee)}` for each pool that contains `token`.
+        '''
+        factory, token = _to_blob(factory), _to_blob(token)
+        cursor = self.execute(
+            """
+            SELECT pool, token1, fee FROM uniswap_v3_pools WHERE chain = ? AND factory = ? AND token0 = ?
+            UNION ALL
+            SELECT pool, token0, fee FROM uniswap_v3_pools WHERE chain = ? AND factory = ? AND token1 = ?
+            """,
+            (chain.id, factory, token, chain.id, factory, token)
+        )
+        return {_from_blob(pool): (_from_blob(paired_with), fee) for pool, paired_with, fee in cursor}
+
+    def count_pools(self, factory: Address) -> int:
+        return self.execute(
+            "SELECT COUNT(*) FROM uniswap_v3_pools WHERE chain = ? AND factory = ?", (chain.id, _to_blob(factory))
+        ).fetchone()[0]
+
+    def clear(self) -> None:
+        self.execute("DELETE FROM uniswap_v3_pools WHERE chain = ?", (chain.id,))
+        self.execute("DELETE FROM uniswap_v3_factories WHERE chain = ?", (chain.id,))
+
+
+_LOGS_SCHEMA = """
+CREATE TABLE IF NOT EXISTS log_chunks (
+    chain INTEGER NOT NULL,
+    key TEXT NOT NULL,
+    from_block INTEGER NOT NULL,
+    to_block INTEGER NOT NULL,
+    logs BLOB NOT NULL,
+    PRIMARY KEY (chain, key, from_block)
+);
+"""
+
+
+class LogStore(SQLiteStore):
+    """
+    Persists `eth_getLogs` responses for finalized block ranges.
+
+    Each row is one fetched chunk of `[from_block, to_block]` for a normalized filter `key`. Together, the chunks
+    for a key record which blocks we've already covered, so a request only needs to fetch the gaps between them,
+    no matter how the block ranges line up with previous requests.
+    """
+    def __init__(self, path: str = STORE_PATH) -> None:
+        super().__init__(path, _LOGS_SCHEMA)
+    
+    def get_gaps(self, key: str, from_block: Block, to_block: Block) -> List[Tuple[Block, Block]]:
+        '''
+        Returns the `(start, end)` ranges within `[from_block, to_block]` that we haven't fetched for `key`.
+        '''
+        gaps, start = [], from_block
+        for chunk_start, chunk_end in self.execute(
+            "SELECT from_block, to_block FROM log_chunks WHERE chain = ? AND key = ? AND from_block <= ? AND to_block >= ? ORDER BY from_block",
+            (chain.id, key, to_block, from_block)
+        ):
+            if chunk_start > start:
+                gaps.append((start, chunk_start - 1))
+            start = max(start, chunk_end + 1)
+        if start <= to_block:
+            gaps.append((start, to_block))
+        return gaps
+    
+    def get_logs(self, key: str, from_block: Block, to_block: Block) -> List[Any]:
+        '''
+        Returns the stored logs for `key` between `from_block` and `to_block`, in block order.
+        '''
+        logs = []
+        for chunk, in self.execute(
+            "SELECT logs FROM log_chunks WHERE chain = ? AND key = ? AND from_block <= ? AND to_block >= ? ORDER BY from_block",
+            (chain.id, key, to_block, from_block)
+        ):
+            logs.extend(log for log in pickle.loads(chunk) if from_block <= log['blockNumber'] <= to_block)
+        return logs
+    
+    def add_chunk(self, key: str, from_block: Block, to_block: Block, logs: List[Any]) -> None:
+        if not is_finalized(to_block):
+            return
+        self.execute(
+            "INSERT OR REPLACE INTO log_chunks (chain, key, from_block, to_block, logs) VALUES (?, ?, ?, ?, ?)",
+            (chain.id, key, from_block, to_block, pickle.dumps(list(logs), protocol=pickle.HIGHEST_PROTOCOL))
+        )
+
+    def clear(self) -> None:
+        self.execute("DELETE FROM log_chunks WHERE chain = ?", (chain.id,))
+
+
+_TIMESTAMPS_SCHEMA = """
+CREATE TABLE IF NOT EXISTS block_timestamps (
+    chain INTEGER NOT NULL,
+    block INTEGER NOT NULL,
+    timestamp INTEGER NOT NULL,
+    PRIMARY KEY (chain, block)
+);
+CREATE INDEX IF NOT EXISTS block_timestamps_timestamp ON block_timestamps (chain, timestamp);
+"""
+
+
+class TimestampStore(SQLiteStore):
+    """
+    Persists the timestamp of every finalized block we've looked at. Block timestamps never decrease,
+    so the blocks we already know bracket any timestamp we search for next.
+    """
+    def __init__(self, path: str = STORE_PATH) -> None:
+        super().__init__(path, _TIMESTAMPS_SCHEMA)
+    
+    def get_timestamps(self, blocks: Iterable[Block]) -> Dict[Block, int]:
+        '''
+        Returns `{block: timestamp}` for each of `blocks` we know.
+        '''
+        blocks = list(blocks)
+        timestamps = {}
+        # sqlite limits the number of parameters in a query
+        for i in range(0, len(blocks), 500):
+            chunk = blocks[i:i+500]
+            timestamps.update(self.execute(
+                f"SELECT block, timestamp FROM block_timestamps WHERE chain = ? AND block IN ({','.join('?' * len(chunk))})",
+                (chain.id, *chunk)
+            ))
+        return timestamps
+    
+    def set_timestamps(self, timestamps: Dict[Block, int]) -> None:
+        self.executemany(
+            "INSERT OR REPLACE INTO block_timestamps (chain, block, timestamp) VALUES (?, ?, ?)",
+            [(chain.id, block, timestamp) for block, timestamp in timestamps.items() if is_finalized(block)]
+        )
+    
+    def bracket(self, timestamp: int) -> Tuple[Optional[Tuple[Block, int]], Optional[Tuple[Block, int]]]:
+        '''
+        Returns the known `(block, timestamp)` pairs closest to `timestamp`: the last one at or before it and the first one after it.
+        Either is `None` if we don't know any blocks on that side.
+        '''
+        before = self.execute(
+            "SELECT block, timestamp FROM block_timestamps WHERE chain = ? AND timestamp <= ? ORDER BY timestamp DESC, block DESC LIMIT 1",
+            (chain.id, timestamp)
+        ).fetchone()
+        after = self.execute(
+            "SELECT block, timestamp FROM block_timestamps WHERE chain = ? AND timestamp > ? ORDER BY timestamp, block LIMIT 1",
+            (chain.id, timestamp)
+        ).fetchone()
+        return before, after
+
+    def clear(self) -> None:
+        self.execute("DELETE FROM block_timestamps WHERE chain = ?", (chain.id,))
+
+
+_CREATION_BLOCKS_SCHEMA = """
+CREATE TABLE IF NOT EXISTS creation_blocks (
+    chain INTEGER NOT NULL,
+    address TEXT NOT NULL,
+    block INTEGER NOT NULL,
+    PRIMARY KEY (chain, address)
+);
+"""
+
+
+class CreationBlockStore(SQLiteStore):
+    """
+    Persists the block each contract was deployed at.
+    """
+    def __init__(self, path: str = STORE_PATH) -> None:
+        super().__init__(path, _CREATION_BLOCKS_SCHEMA)
+    
+    def get_creation_blocks(self, addresses: Iterable[Address]) -> Dict[Address, Block]:
+        '''
+        Returns `{address: creation_block}` for each of `addresses` we know.
+        '''
+        addresses = [str(address) for address in addresses]
+        blocks = {}
+        # sqlite limits the number of parameters in a query
+        for i in range(0, len(addresses), 500):
+            chunk = addresses[i:i+500]
+            blocks.update(self.execute(
+                f"SELECT address, block FROM creation_blocks WHERE chain = ? AND address IN ({','.join('?' * len(chunk))})",
+                (chain.id, *chunk)
+            ))
+        return blocks
+    
+    def set_creation_blocks(self, blocks: Dict[Address, Block]) -> None:
+        self.executemany(
+            "INSERT OR REPLACE INTO creation_blocks (chain, address, block) VALUES (?, ?, ?)",
+            [(chain.id, str(address), block) for address, block in blocks.items() if is_finalized(block)]
+        )
+
+    def clear(self) -> None:
+        self.execute("DELETE FROM creation_blocks WHERE chain = ?", (chain.id,))
+
+
+_ROUNDS_SCHEMA = """
+CREATE TABLE IF NOT EXISTS chainlink_aggregators (
+    chain INTEGER NOT NULL,
+    aggregator BLOB NOT NULL,
+    last_block INTEGER NOT NULL,
+    PRIMARY KEY (chain, aggregator)
+);
+CREATE TABLE IF NOT EXISTS chainlink_rounds (
+    chain INTEGER NOT NULL,
+    aggregator BLOB NOT NULL,
+    block INTEGER NOT NULL,
+    answer INTEGER NOT NULL,
+    PRIMARY KEY (chain, aggregator, block)
+) WITHOUT ROWID;
+"""
+
+
+class RoundStore(SQLiteStore):
+    """
+    Persists the answers reported by each chainlink aggregator, one row per block with an update,
+    along with the last block we've indexed `AnswerUpdated` events through.
+    """
+    def __init__(self, path: str = STORE_PATH) -> None:
+        super().__init__(path, _ROUNDS_SCHEMA)
+
+    def get_last_block(self, aggregator: Address) -> Optional[Block]:
+        row = self.execute(
+            "SELECT last_block FROM chainlink_aggregators WHERE chain = ? AND aggregator = ?", (chain.id, _to_blob(aggregator))
+        ).fetchone()
+        return None if row is None else row[0]
+
+    def add_rounds(self, aggregator: Address, rounds: Iterable[Tuple[Block, int]], last_block: Block) -> None:
+        '''
+        Adds `(block, answer)` rounds for `aggregator` and moves its `last_block` forward, in one transaction.
+        If there are several rounds in one block, the last one wins.
+        '''
+        aggregator = _to_blob(aggregator)
+        with self.transaction():
+            self.executemany(
+                "INSERT OR REPLACE INTO chainlink_rounds (chain, aggregator, block, answer) VALUES (?, ?, ?, ?)",
+                # sqlite integers are 64 bit, the odd answer that doesn't fit is stored as text
+                [(chain.id, aggregator, block, answer if -2**63 <= answer < 2**63 else str(answer)) for block, answer in rounds]
+            )
+            self.execute(
+                "INSERT OR REPLACE INTO chainlink_aggregators (chain, aggregator, last_block) VALUES (?, ?, ?)", (chain.id, aggregator, last_block)
+            )
+
+    def get_rounds(self, aggregator: Address) -> Tuple[List[Block], List[int]]:
+        '''
+        Returns `(blocks, answers)` for `aggregator`, in block order.
+        '''
+        blocks, answers = [], []
+        for block, answer in self.execute(
+            "SELECT block, answer FROM chainlink_rounds WHERE chain = ? AND aggregator = ? ORDER BY block", (chain.id, _to_blob(aggregator))
+        ):
+            blocks.append(block)
+            answers.append(int(answer))
+        return blocks, answers
+
+    def clear(self) -> None:
+        self.execute("DELETE FROM chainlink_rounds WHERE chain = ?", (chain.id,))
+        self.execute("DELETE FROM chainlink_aggregators WHERE chain = ?", (chain.id,))
+
+
+_RESERVES_SCHEMA = """
+CREATE TABLE IF NOT EXISTS uniswap_v2_reserve_pools (
+    chain INTEGER NOT NULL,
+    pool BLOB NOT NULL,
+    last_block INTEGER NOT NULL,
+    PRIMARY KEY (chain, pool)
+);
+CREATE TABLE IF NOT EXISTS uniswap_v2_reserves (
+    chain INTEGER NOT NULL,
+    pool BLOB NOT NULL,
+    block INTEGER NOT NULL,
+    reserve0 TEXT NOT NULL,
+    reserve1 TEXT NOT NULL,
+    PRIMARY KEY (chain, pool, block)
+) WITHOUT ROWID;
+"""
+
+
+class ReserveStore(SQLiteStore):
+    """
+    Persists the reserves of uniswap v2 style pools, one row per block with a `Sync` event,
+    along with the last block we've ingested each pool's `Sync` events through.
+    Reserves are uint112 so they're stored as text.
+    """
+    def __init__(self, path: str = STORE_PATH) -> None:
+        super().__init__(path, _RESERVES_SCHEMA)
+
+    def get_last_blocks(self, pools: Iterable[Address]) -> Dict[Address, Block]:
+        '''
+        Returns `{pool: last_block}` for each of `pools` we track.
+        '''
+        pools = list(pools)
+        last_blocks = {}
+        # sqlite limits the number of parameters in a query
+        for i in range(0, len(pools), 500):
+            chunk = pools[i:i+500]
+            last_blocks.update(
+                (_from_blob(pool), last_block) for pool, last_block in self.execute(
+                    f"SELECT pool, last_block FROM uniswap_v2_reserve_pools WHERE chain = ? AND pool IN ({','.join('?' * len(chunk))})",
+                    (chain.id, *map(_to_blob, chunk))
+                )
+            )
+        return last_blocks
+
+    def add_reserves(self, reserves: Iterable[Tuple[Address, Block, int, int]], pools: Iterable[Address] = (), last_block: Optional[Block] = None) -> None:
+        '''
+        Adds `(pool, block, reserve0, reserve1)` rows. If `last_block` is passed, also moves the `last_block` of each of `pools` forward.
+        If a pool synced several times in one block, the last one wins.
+        '''
+        with self.transaction():
+            self.executemany(
+                "INSERT OR REPLACE INTO uniswap_v2_reserves (chain, pool, block, reserve0, reserve1) VALUES (?, ?, ?, ?, ?)",
+                [(chain.id, _to_blob(pool), block, str(reserve0), str(reserve1)) for pool, block, reserve0, reserve1 in reserves]
+            )
+            if last_block is not None:
+                self.executemany(
+                    "INSERT OR REPLACE INTO uniswap_v2_reserve_pools (chain, pool, last_block) VALUES (?, ?, ?)",
+                    [(chain.id, _to_blob(pool), last_block) for pool in pools]
+                )
+
+    def get_reserves(self, pool: Address, block: Block) -> Tuple[int, int]:
+        '''
+        Returns `pool`'s `(reserve0, reserve1)` as of `block`. A pool that hasn't synced yet has no reserves.
+        '''
+        row = self.execute(
+            "SELECT reserve0, reserve1 FROM uniswap_v2_reserves WHERE chain = ? AND pool = ? AND block <= ? ORDER BY block DESC LIMIT 1",
+            (chain.id, _to_blob(pool), block)
+        ).fetchone()
+        return (0, 0) if row is None else (int(row[0]), int(row[1]))
+
+    def clear(self) -> None:
+        self.execute("DELETE FROM uniswap_v2_reserves WHERE chain = ?", (chain.id,))
+        self.execute("DELETE FROM uniswap_v2_reserve_pools WHERE chain = ?", (chain.id,))
+
+
+def _to_blob(address: Address) -> bytes:
+    return bytes.fromhex(str(address)[2:])
+
+
+@lru_cache(maxsize=None)
+def _from_blob(blob: bytes) -> Address:
+    return convert.to_address('0x' + blob.hex())
+
+
+@ttl_cache(ttl=1)
+def _chain_height() -> int:
+    return chain.height
+
+
+def last_finalized_block() -> Block:
+    return _chain_height() - CONFIRMATIONS
+
+
+def is_finalized(block: Block) -> bool:
+    return block <= last_finalized_block()
+
+
+price_store = PriceStore()
+pool_store = PoolStore()
+v3_pool_store = V3PoolStore()
+log_store = LogStore()
+timestamp_store = TimestampStore()
+creation_block_store = CreationBlockStore()
+round_store = RoundStore()
+reserve_store = ReserveStore()